@@ -0,0 +1,43 @@
+#include "alloc.h"
+
+#include "fatal_error.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+_Thread_local uint64_t alloc_allocations = 0;
+_Thread_local uint64_t alloc_bytes = 0;
+
+static void* alloc_count(void* data, uint64_t size) {
+    /* An empty allocation may come back as NULL */
+    if (data == NULL && size != 0) {
+        fatal_error("out of memory");
+    }
+    ++alloc_allocations;
+    alloc_bytes += size;
+    return data;
+}
+
+void* xmalloc(uint64_t size) {
+    return alloc_count(malloc(size), size);
+}
+
+void* xcalloc(uint64_t length, uint64_t size) {
+    return alloc_count(calloc(length, size), length * size);
+}
+
+void* xrealloc(void* data, uint64_t size) {
+    return alloc_count(realloc(data, size), size);
+}
+
+char* xstrdup(const char* c_str) {
+    return xstrndup(c_str, strlen(c_str));
+}
+
+char* xstrndup(const char* c_str, uint64_t size) {
+    uint64_t length = strnlen(c_str, size);
+    char* copy = xmalloc(length + 1);
+    memcpy(copy, c_str, length);
+    copy[length] = '\0';
+    return copy;
+}
@@ -0,0 +1,19 @@
+#ifndef MALLARD_ALLOC_H
+#define MALLARD_ALLOC_H
+
+#include <stdint.h>
+
+/* Every allocation of the assembler goes through these. Running out of
+   memory is a fatal error, so the result is never NULL. */
+void* xmalloc(uint64_t size);
+void* xcalloc(uint64_t length, uint64_t size);
+void* xrealloc(void* data, uint64_t size);
+char* xstrdup(const char* c_str);
+char* xstrndup(const char* c_str, uint64_t size);
+
+/* Allocations made by this thread and their bytes, a reallocation counts
+   with its new size */
+extern _Thread_local uint64_t alloc_allocations;
+extern _Thread_local uint64_t alloc_bytes;
+
+#endif /* ifndef MALLARD_ALLOC_H */
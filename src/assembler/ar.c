@@ -0,0 +1,32 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ansi.h"
+#include "archive.h"
+#include "fatal_error.h"
+#include "version.h"
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fatal_error("required argument");
+    }
+
+    if (strcmp(argv[1], "--version") == 0) {
+        if (argc != 2) {
+            fatal_error("'--version' should be the only argument");
+        }
+        printf(ANSI_BOLD_GREEN "Mallard" ANSI_RESET " archiver "
+                ANSI_BOLD MALLARD_VERSION ANSI_RESET "\n");
+        return 0;
+    }
+    if (argc < 3) {
+        fatal_error("usage: mallard-ar <archive> <object>...");
+    }
+
+    /* The archive is replaced as a whole, members are never updated */
+    archive_create(argv[1], (const char**) argv + 2, argc - 2);
+
+    return 0;
+}
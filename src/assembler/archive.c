@@ -0,0 +1,297 @@
+#include "archive.h"
+
+#include "alloc.h"
+#include "elf.h"
+#include "fatal_error.h"
+#include "file.h"
+#include "symbol_table.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* The layout, every part starts 8 byte aligned:
+
+     header
+     members   the name, offset and size of each object
+     slots     every defined symbol, hashed
+     names     member and symbol names, NUL terminated
+     objects   each member's bytes
+
+   The slots are a power of two and at most half full, a lookup probes
+   linearly from the FNV-1a hash of the name. */
+
+static const uint8_t archive_magic[8] = {'!', '<', 'm', 'l', 'a', 'r', '>',
+                                         '\n'};
+
+struct archive_header {
+    uint8_t magic[8];
+    uint64_t members_length;
+    uint64_t slots_length;
+    uint64_t names_size;
+};
+
+struct archive_member_entry {
+    uint64_t name;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct archive_slot {
+    uint64_t hash;
+    uint32_t name;
+    /* One more than the member's index, an empty slot is 0 */
+    uint32_t member;
+};
+
+static uint64_t archive_hash(struct str* name) {
+    uint64_t h = 0xCBF29CE484222325;
+    for (uint64_t i = 0; i < name->size; ++i) {
+        h ^= name->data[i];
+        h *= 0x100000001B3;
+    }
+    return h;
+}
+
+static uint64_t archive_align(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t) 7;
+}
+
+static struct str archive_name(struct archive* archive, uint64_t offset) {
+    if (offset >= archive->names.size) {
+        fatal_error("archive: name out of bounds");
+    }
+    uint8_t* data = archive->names.data + offset;
+    uint8_t* end = memchr(data, '\0', archive->names.size - offset);
+    if (end == NULL) {
+        fatal_error("archive: name not terminated");
+    }
+    struct str name = {
+        .data = data,
+        .size = end - data,
+    };
+    return name;
+}
+
+bool archive_matches(struct str* source) {
+    return source->size >= sizeof(archive_magic)
+           && memcmp(source->data, archive_magic, sizeof(archive_magic)) == 0;
+}
+
+void archive_open(struct archive* archive, struct str* source) {
+    if (!archive_matches(source)
+        || source->size < sizeof(struct archive_header)) {
+        fatal_error("archive: not an archive");
+    }
+    struct archive_header header;
+    memcpy(&header, source->data, sizeof(header));
+
+    uint64_t members_size
+        = header.members_length * sizeof(struct archive_member_entry);
+    uint64_t slots_size = header.slots_length * sizeof(struct archive_slot);
+    if (header.members_length > source->size
+        || header.slots_length > source->size
+        || header.names_size > source->size
+        || (header.slots_length & (header.slots_length - 1)) != 0
+        || sizeof(header) + members_size + slots_size + header.names_size
+           > source->size) {
+        fatal_error("archive: tables out of bounds");
+    }
+    archive->source = *source;
+    archive->members_length = header.members_length;
+    archive->slots_length = header.slots_length;
+    archive->members = source->data + sizeof(header);
+    archive->slots = archive->members + members_size;
+    archive->names.data = (uint8_t*) archive->slots + slots_size;
+    archive->names.size = header.names_size;
+}
+
+uint64_t archive_lookup(struct archive* archive, struct str* name) {
+    if (archive->slots_length == 0) {
+        return archive->members_length;
+    }
+    uint64_t h = archive_hash(name);
+    uint64_t mask = archive->slots_length - 1;
+    for (uint64_t i = 0; i < archive->slots_length; ++i) {
+        struct archive_slot slot;
+        memcpy(&slot,
+               archive->slots + ((h + i) & mask) * sizeof(struct archive_slot),
+               sizeof(slot));
+        if (slot.member == 0) {
+            break;
+        }
+        if (slot.hash != h) {
+            continue;
+        }
+        struct str slot_name = archive_name(archive, slot.name);
+        if (slot_name.size == name->size
+            && memcmp(slot_name.data, name->data, name->size) == 0) {
+            if (slot.member > archive->members_length) {
+                fatal_error("archive: member out of bounds");
+            }
+            return slot.member - 1;
+        }
+    }
+    return archive->members_length;
+}
+
+static struct archive_member_entry archive_member_entry(
+    struct archive* archive,
+    uint64_t index
+) {
+    struct archive_member_entry entry;
+    memcpy(&entry,
+           archive->members + index * sizeof(struct archive_member_entry),
+           sizeof(entry));
+    return entry;
+}
+
+struct str archive_member(struct archive* archive, uint64_t index) {
+    struct archive_member_entry entry = archive_member_entry(archive, index);
+    if (entry.offset > archive->source.size
+        || entry.size > archive->source.size - entry.offset) {
+        fatal_error("archive: member out of bounds");
+    }
+    struct str member = {
+        .data = archive->source.data + entry.offset,
+        .size = entry.size,
+    };
+    return member;
+}
+
+struct str archive_member_name(struct archive* archive, uint64_t index) {
+    return archive_name(archive, archive_member_entry(archive, index).name);
+}
+
+static uint64_t archive_names_add(uint8_t* names,
+                                  uint64_t* names_size,
+                                  struct str* name) {
+    uint64_t offset = *names_size;
+    memcpy(names + offset, name->data, name->size);
+    names[offset + name->size] = '\0';
+    *names_size += name->size + 1;
+    return offset;
+}
+
+void archive_create(const char* output_path,
+                    const char** paths,
+                    uint64_t length) {
+    struct str* sources = xcalloc(length + 1, sizeof(struct str));
+    struct elf_object* objects = xcalloc(length + 1, sizeof(struct elf_object));
+    struct str* member_names = xcalloc(length + 1, sizeof(struct str));
+    file_open_read_batch(paths, sources, length);
+
+    /* Size every table first, the archive is built in one buffer */
+    struct symbol_table* symbols = symbol_table_create();
+    uint64_t symbols_length = 0;
+    uint64_t names_size = 0;
+    uint64_t objects_size = 0;
+    for (uint64_t i = 0; i < length; ++i) {
+        elf_object_read(&objects[i], &sources[i], symbols);
+        const char* name = strrchr(paths[i], '/');
+        name = name == NULL ? paths[i] : name + 1;
+        member_names[i].data = (uint8_t*) name;
+        member_names[i].size = strlen(name);
+        names_size += member_names[i].size + 1;
+        for (uint64_t j = 0; j < objects[i].functions_length; ++j) {
+            names_size += objects[i].functions[j].name.size + 1;
+        }
+        for (uint64_t j = 0; j < objects[i].data_length; ++j) {
+            names_size += objects[i].data[j].name.size + 1;
+        }
+        symbols_length += objects[i].functions_length
+                          + objects[i].data_length;
+        objects_size += archive_align(sources[i].size);
+    }
+    if (names_size > UINT32_MAX || length >= UINT32_MAX) {
+        fatal_error("archive: too many members");
+    }
+    uint64_t slots_length = 2;
+    while (slots_length < symbols_length * 2) {
+        slots_length *= 2;
+    }
+
+    uint64_t members_offset = sizeof(struct archive_header);
+    uint64_t slots_offset = members_offset
+                            + length * sizeof(struct archive_member_entry);
+    uint64_t names_offset = slots_offset
+                            + slots_length * sizeof(struct archive_slot);
+    uint64_t objects_offset = archive_align(names_offset + names_size);
+    uint64_t image_size = objects_offset + objects_size;
+    uint8_t* image = xcalloc(1, image_size);
+
+    struct archive_header header = {
+        .members_length = length,
+        .slots_length = slots_length,
+        .names_size = names_size,
+    };
+    memcpy(header.magic, archive_magic, sizeof(archive_magic));
+    memcpy(image, &header, sizeof(header));
+
+    struct archive archive;
+    struct str image_str = {
+        .data = image,
+        .size = image_size,
+    };
+    archive_open(&archive, &image_str);
+
+    struct archive_member_entry* members
+        = (struct archive_member_entry*) (image + members_offset);
+    struct archive_slot* slots
+        = (struct archive_slot*) (image + slots_offset);
+    uint8_t* names = image + names_offset;
+    uint64_t mask = slots_length - 1;
+    names_size = 0;
+    uint64_t offset = objects_offset;
+    for (uint64_t i = 0; i < length; ++i) {
+        members[i].name = archive_names_add(names, &names_size,
+                                            &member_names[i]);
+        members[i].offset = offset;
+        members[i].size = sources[i].size;
+        memcpy(image + offset, sources[i].data, sources[i].size);
+        offset += archive_align(sources[i].size);
+
+        uint64_t defined = objects[i].functions_length
+                           + objects[i].data_length;
+        for (uint64_t j = 0; j < defined; ++j) {
+            struct str* name = NULL;
+            if (j < objects[i].functions_length) {
+                name = &objects[i].functions[j].name;
+            }
+            else {
+                name = &objects[i].data[j - objects[i].functions_length].name;
+            }
+            if (archive_lookup(&archive, name) != length) {
+                fatal_error("archive: symbol defined by more than one member");
+            }
+            uint64_t h = archive_hash(name);
+            uint64_t index = h & mask;
+            while (slots[index].member != 0) {
+                index = (index + 1) & mask;
+            }
+            slots[index].hash = h;
+            slots[index].name = archive_names_add(names, &names_size, name);
+            slots[index].member = i + 1;
+        }
+    }
+
+    struct iovec iov = {
+        .iov_base = image,
+        .iov_len = image_size,
+    };
+    struct file_write write = {
+        .path = output_path,
+        .iov = &iov,
+        .iov_length = 1,
+    };
+    file_write_batch(&write, 1);
+
+    free(image);
+    for (uint64_t i = 0; i < length; ++i) {
+        elf_object_free(&objects[i]);
+        file_close_mmap(&sources[i]);
+    }
+    symbol_table_destroy(symbols);
+    free(member_names);
+    free(objects);
+    free(sources);
+}
@@ -0,0 +1,35 @@
+#ifndef MALLARD_ARCHIVE_H
+#define MALLARD_ARCHIVE_H
+
+#include "str.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A read only view of an archive of relocatable objects, with an index from
+   each defined symbol to the member that defines it */
+struct archive {
+    struct str source;
+    uint64_t members_length;
+    uint64_t slots_length;
+    const uint8_t* members;
+    const uint8_t* slots;
+    struct str names;
+};
+
+/* Archives start with these bytes, so they can be told apart from objects */
+bool archive_matches(struct str* source);
+/* Checks the archive's tables, the source must outlive the archive */
+void archive_open(struct archive* archive, struct str* source);
+/* The index of the member that defines name, or members_length when no
+   member does */
+uint64_t archive_lookup(struct archive* archive, struct str* name);
+struct str archive_member(struct archive* archive, uint64_t index);
+struct str archive_member_name(struct archive* archive, uint64_t index);
+
+/* Writes the objects at paths into one archive at output_path */
+void archive_create(const char* output_path,
+                    const char** paths,
+                    uint64_t length);
+
+#endif /* ifndef MALLARD_ARCHIVE_H */
@@ -0,0 +1,137 @@
+#include "arena.h"
+
+#include "alloc.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_CHUNK_SIZE_MIN (64 * 1024)
+#define ARENA_CHUNK_SIZE_MAX (64 * 1024 * 1024)
+#define ARENA_ALIGNMENT _Alignof(max_align_t)
+
+struct arena_chunk {
+    struct arena_chunk* next;
+    uint64_t size;
+    uint64_t capacity;
+    _Alignas(max_align_t) uint8_t data[];
+};
+
+struct arena {
+    struct arena_chunk* chunks;
+    /* Each new chunk is twice as large as the last, up to the maximum */
+    uint64_t chunk_capacity;
+
+    uint64_t allocations;
+    uint64_t chunks_length;
+};
+
+struct arena* arena_create(void) {
+    struct arena* arena = xcalloc(1, sizeof(struct arena));
+    arena->chunk_capacity = ARENA_CHUNK_SIZE_MIN;
+    return arena;
+}
+
+void arena_destroy(struct arena* arena) {
+    struct arena_chunk* chunk = arena->chunks;
+    while (chunk != NULL) {
+        struct arena_chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+void arena_reset(struct arena* arena) {
+    /* The newest chunk is the largest, the rest are freed */
+    struct arena_chunk* chunk = arena->chunks;
+    if (chunk == NULL) {
+        return;
+    }
+    struct arena_chunk* next = chunk->next;
+    while (next != NULL) {
+        struct arena_chunk* after = next->next;
+        free(next);
+        next = after;
+    }
+    memset(chunk->data, 0, chunk->size);
+    chunk->size = 0;
+    chunk->next = NULL;
+    arena->allocations = 0;
+    arena->chunks_length = 1;
+}
+
+static uint64_t arena_align(uint64_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~((uint64_t) ARENA_ALIGNMENT - 1);
+}
+
+static struct arena_chunk* arena_chunk_create(struct arena* arena,
+                                              uint64_t size) {
+    uint64_t capacity = arena->chunk_capacity;
+    if (capacity < size) {
+        capacity = size;
+    }
+    if (arena->chunk_capacity < ARENA_CHUNK_SIZE_MAX) {
+        arena->chunk_capacity *= 2;
+    }
+
+    /* calloc hands out fresh pages for large chunks, so zeroing is free */
+    struct arena_chunk* chunk
+        = xcalloc(1, sizeof(struct arena_chunk) + capacity);
+    chunk->size = 0;
+    chunk->capacity = capacity;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    ++(arena->chunks_length);
+    return chunk;
+}
+
+void* arena_alloc(struct arena* arena, uint64_t size) {
+    size = arena_align(size);
+    struct arena_chunk* chunk = arena->chunks;
+    if (chunk == NULL || (chunk->size + size) > chunk->capacity) {
+        chunk = arena_chunk_create(arena, size);
+    }
+    void* data = chunk->data + chunk->size;
+    chunk->size += size;
+    ++(arena->allocations);
+    return data;
+}
+
+void* arena_array_grow(struct arena* arena,
+                       void* array,
+                       uint64_t* capacity,
+                       uint64_t element_size) {
+    /* Doubling keeps the abandoned copies smaller than the final array */
+    uint64_t new_capacity = *capacity == 0 ? 16 : *capacity * 2;
+    uint64_t size = arena_align(*capacity * element_size);
+    uint64_t new_size = arena_align(new_capacity * element_size);
+
+    /* The last allocation in a chunk can grow in place */
+    struct arena_chunk* chunk = arena->chunks;
+    if (array != NULL && chunk != NULL && size <= chunk->size) {
+        uintptr_t end = (uintptr_t) (chunk->data + chunk->size);
+        if ((uintptr_t) array + size == end
+            && chunk->size - size + new_size <= chunk->capacity) {
+            chunk->size = chunk->size - size + new_size;
+            *capacity = new_capacity;
+            return array;
+        }
+    }
+
+    void* new_array = arena_alloc(arena, new_size);
+    if (array != NULL) {
+        memcpy(new_array, array, size);
+    }
+    *capacity = new_capacity;
+    return new_array;
+}
+
+uint64_t arena_allocations(struct arena* arena) {
+    return arena->allocations;
+}
+
+uint64_t arena_chunks(struct arena* arena) {
+    return arena->chunks_length;
+}
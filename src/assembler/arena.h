@@ -0,0 +1,26 @@
+#ifndef MALLARD_ARENA_H
+#define MALLARD_ARENA_H
+
+#include <stdint.h>
+
+/* A bump allocator, everything allocated from an arena is released together
+   by arena_destroy. Memory from an arena is always zeroed. */
+struct arena;
+
+struct arena* arena_create(void);
+void arena_destroy(struct arena* arena);
+/* Releases everything allocated from the arena at once, keeping its
+   largest chunk for the next allocations */
+void arena_reset(struct arena* arena);
+void* arena_alloc(struct arena* arena, uint64_t size);
+void* arena_array_grow(struct arena* arena,
+                       void* array,
+                       uint64_t* capacity,
+                       uint64_t element_size);
+
+/* Number of arena_alloc calls, and the number of those that needed memory
+   from the system */
+uint64_t arena_allocations(struct arena* arena);
+uint64_t arena_chunks(struct arena* arena);
+
+#endif /* ifndef MALLARD_ARENA_H */
@@ -1,6 +1,9 @@
 #ifndef MALLARD_AST_NODE_H
 #define MALLARD_AST_NODE_H
 
+#include "arena.h"
+#include "ir.h"
+#include "isa.h"
 #include "str_table.h"
 #include "token.h"
 
@@ -14,33 +17,45 @@ struct ast_node {
 };
 
 struct executable_address_tuple {
-    struct token* function;
-    struct token* imm_token;
+    struct token function;
+    struct token imm_token;
     uint64_t imm;
 };
 
+/* What an executable's output file holds */
+enum output_format {
+    OUTPUT_FORMAT_ELF,
+    /* The .text image as it is laid out in memory, starting at code */
+    OUTPUT_FORMAT_BINARY,
+    /* The same image as Intel HEX records */
+    OUTPUT_FORMAT_IHEX,
+};
+
 struct executable_ast_node {
     uint64_t kind;
-    struct token* output_path;
+    struct token output_path;
     struct executable_address_tuple* addresses[ADDRESSES_MAX];
     uint64_t addresses_length;
-    struct token* code_token;
-    struct token* entry_token;
-    struct token* files[FILES_MAX];
+    struct token code_token;
+    struct token entry_token;
+    struct token files[FILES_MAX];
     uint64_t files_length;
+    struct token output_format_token;
 
     uint32_t code_address;
+    enum output_format output_format;
 };
 
 struct unit_ast_node {
     uint64_t kind;
     struct ast_node** ast_nodes;
     uint64_t length;
+    uint64_t capacity;
 };
 
 struct function_ast_node {
     uint64_t kind;
-    struct token* name;
+    struct token name;
     struct instructions_ast_node* insts;
 };
 
@@ -48,134 +63,109 @@ struct instructions_ast_node {
     uint64_t kind;
     void** ast_nodes;
     uint64_t length;
-};
-
-struct itype_ast_node {
-    uint64_t kind;
-    struct token* mnemonic;
-    struct token* rd_token;
-    struct token* rs1_token;
-    struct token* imm_token;
-
-    uint8_t opcode;
-    uint8_t rd;
-    uint8_t funct;
-    uint8_t rs1;
-    uint16_t imm;
-};
-
-struct stype_ast_node {
-    uint64_t kind;
-    struct token* mnemonic;
-    struct token* rs1_token;
-    struct token* rs2_token;
-    struct token* imm_token;
-
-    uint8_t opcode;
-    uint8_t funct;
-    uint8_t rs1;
-    uint8_t rs2;
-    uint16_t imm;
-};
-
-struct utype_ast_node {
-    uint64_t kind;
-    struct token* mnemonic;
-    struct token* rd_token;
-    struct token* imm_token;
+    uint64_t capacity;
 
-    uint8_t opcode;
-    uint8_t rd;
-    uint32_t imm;
+    /* Emitted by analysis, in the same order as ast_nodes */
+    struct ir_instruction* ir;
+    uint64_t ir_length;
+    uint64_t code_size;
 };
 
-struct ujtype_ast_node {
+/* Every instruction in ISA_INSTRUCTIONS, operands the format does not use are
+   left empty */
+struct instruction_ast_node {
     uint64_t kind;
-    struct token* mnemonic;
-    struct token* rd_token;
-    struct token* offset_token;
+    struct token mnemonic;
+    struct token rd_token;
+    struct token rs1_token;
+    struct token rs2_token;
+    struct token imm_token;
 
     bool needs_function_table;
 
-    uint8_t opcode;
+    enum isa_instruction instruction;
     uint8_t rd;
-    int32_t offset;
+    uint8_t rs1;
+    uint8_t rs2;
+    int32_t imm;
 };
 
 struct load_immediate_ast_node {
     uint64_t kind;
-    struct token* rd_token;
-    struct token* imm_token;
+    struct token rd_token;
+    struct token imm_token;
 
     bool needs_function_table;
 };
 
 struct label_ast_node {
     uint64_t kind;
-    struct token* name;
+    struct token name;
 
     uint64_t offset;
 };
 
 struct uninitialized_data_ast_node {
     uint64_t kind;
-    struct token* name;
-    struct token* size_value_token;
-    struct token* size_suffix_token;
+    struct token name;
+    struct token size_value_token;
+    struct token size_suffix_token;
 
-    uint64_t offset;
     uint32_t size;
 };
 
 bool is_unit_ast_node(struct ast_node* node);
 bool is_executable_ast_node(struct ast_node* node);
 bool is_function_ast_node(struct ast_node* node);
-bool is_ujtype_ast_node(struct ast_node* node);
+bool is_instruction_ast_node(struct ast_node* node);
 bool is_load_immediate_ast_node(struct ast_node* node);
 bool is_label_ast_node(struct ast_node* node);
 bool is_uninitialized_data_ast_node(struct ast_node* node);
 
-struct unit_ast_node* create_empty_unit_ast_node(void);
-void unit_ast_node_push(struct unit_ast_node* unit, struct ast_node* node);
-struct executable_ast_node* create_empty_executable_ast_node(void);
-void executable_ast_node_add_address(struct executable_ast_node* exec,
+/* Nodes are allocated from the arena and released with it */
+struct unit_ast_node* create_empty_unit_ast_node(struct arena* arena);
+void unit_ast_node_push(struct arena* arena,
+                        struct unit_ast_node* unit,
+                        struct ast_node* node);
+struct executable_ast_node* create_empty_executable_ast_node(
+    struct arena* arena
+);
+void executable_ast_node_add_address(struct arena* arena,
+                                     struct executable_ast_node* exec,
                                      struct token* function,
                                      struct token* address);
 void executable_ast_node_add_file(struct executable_ast_node* exec,
                                   struct token* token);
-struct function_ast_node* create_empty_function_ast_node(void);
-struct instructions_ast_node* create_empty_instructions_ast_node(void);
-void instructions_ast_node_push(struct instructions_ast_node* instructions,
+struct function_ast_node* create_empty_function_ast_node(struct arena* arena);
+struct instructions_ast_node* create_empty_instructions_ast_node(
+    struct arena* arena
+);
+void instructions_ast_node_push(struct arena* arena,
+                                struct instructions_ast_node* instructions,
                                 void* node);
 
-struct itype_ast_node* create_itype_ast_node(struct token* mnemonic,
-                                             struct token* rd,
-                                             struct token* rs1,
-                                             struct token* imm);
-struct stype_ast_node* create_stype_ast_node(struct token* mnemonic,
-                                             struct token* rs1,
-                                             struct token* rs2,
-                                             struct token* imm);
-struct utype_ast_node* create_utype_ast_node(struct token* mnemonic,
-                                             struct token* rd,
-                                             struct token* imm);
-struct ujtype_ast_node* create_ujtype_ast_node(struct token* mnemonic,
-                                               struct token* rd,
-                                               struct token* offset);
+struct instruction_ast_node* create_instruction_ast_node(
+    struct arena* arena,
+    struct token* mnemonic,
+    struct token* rd,
+    struct token* rs1,
+    struct token* rs2,
+    struct token* imm
+);
 struct load_immediate_ast_node* create_load_immediate_ast_node(
+    struct arena* arena,
     struct token* rd,
     struct token* imm
 );
-struct label_ast_node* create_label_ast_node(struct token* name);
+struct label_ast_node* create_label_ast_node(struct arena* arena,
+                                             struct token* name);
 struct uninitialized_data_ast_node* create_uninitialized_data_ast_node(
+    struct arena* arena,
     struct token* name,
     struct token* size_value_token,
     struct token* size_suffix_token
 );
 
-void ast_node_analyze(struct ast_node* ast_node);
-bool ast_node_machine_code_is_compressible(void* ast_node);
-uint16_t ast_node_machine_code_u16(void* ast_node);
-uint32_t ast_node_machine_code_u32(void* ast_node);
+void ast_node_analyze(struct arena* arena, struct ast_node* ast_node);
 
 #endif /* ifndef MALLARD_AST_NODE_H */
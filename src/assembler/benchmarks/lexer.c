@@ -0,0 +1,102 @@
+#include "fatal_error.h"
+#include "lexer.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define INPUT_SIZE (32 * 1024 * 1024)
+#define ITERATIONS 5
+
+static struct str generate_input(uint64_t target_size) {
+    const char* function =
+        "func message_%" PRIu64 " {\n"
+        "    lui a1, 0x10000\n"
+        "    addiw a0, x0, 0x4d\n"
+        "    sb a0, 0(a1)\n"
+        "    addiw a0, x0, 0x61\n"
+        "    sd a0, 0(a1)\n"
+        "    jal ra, qemu_exit_success\n"
+        "    jalr x0, 0(ra)\n"
+        "}\n"
+        "\n";
+    uint8_t* data = malloc(target_size + 4096);
+    if (data == NULL) {
+        fatal_error("out of memory");
+    }
+    uint64_t size = 0;
+    uint64_t index = 0;
+    while (size < target_size) {
+        size += sprintf((char*) data + size, function, index);
+        ++index;
+    }
+    struct str str = {
+        .data = data,
+        .size = size,
+    };
+    return str;
+}
+
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+    struct str input = generate_input(INPUT_SIZE);
+    enum lexer_backend backends[] = {
+        LEXER_BACKEND_SCALAR,
+        LEXER_BACKEND_SSE2,
+        LEXER_BACKEND_AVX2,
+    };
+    for (uint64_t i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i) {
+        if (!lexer_backend_supported(backends[i])) {
+            continue;
+        }
+        double best = 0;
+        uint64_t length = 0;
+        for (int j = 0; j < ITERATIONS; ++j) {
+            double start = seconds();
+            struct symbol_table* symbols = symbol_table_create();
+            struct tokens tokens
+                = lex_with_backend(&input, symbols, backends[i]);
+            double elapsed = seconds() - start;
+            if (best == 0 || elapsed < best) {
+                best = elapsed;
+            }
+            length = tokens.length;
+            token_free(&tokens);
+            symbol_table_destroy(symbols);
+        }
+        printf("lex %-8s %8.1f MB/s (%" PRIu64 " tokens)\n",
+               lexer_backend_c_str(backends[i]),
+               (input.size / 1e6) / best, length);
+    }
+
+    struct thread_pool* thread_pool
+        = thread_pool_create(thread_pool_default_threads());
+    double best = 0;
+    uint64_t length = 0;
+    for (int j = 0; j < ITERATIONS; ++j) {
+        double start = seconds();
+        struct symbol_table* symbols = symbol_table_create();
+        struct tokens tokens = lex_parallel(&input, symbols, thread_pool);
+        double elapsed = seconds() - start;
+        if (best == 0 || elapsed < best) {
+            best = elapsed;
+        }
+        length = tokens.length;
+        token_free(&tokens);
+        symbol_table_destroy(symbols);
+    }
+    printf("lex parallel (%" PRIu64 " threads) %8.1f MB/s (%" PRIu64
+           " tokens)\n",
+           thread_pool_threads(thread_pool), (input.size / 1e6) / best, length);
+    thread_pool_destroy(thread_pool);
+
+    free(input.data);
+    return 0;
+}
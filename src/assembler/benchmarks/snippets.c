@@ -0,0 +1,85 @@
+#include "compile.h"
+#include "mallard.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define SNIPPETS 200000
+#define ITERATIONS 5
+
+/* Snippets the size a test generator produces, a few instructions each */
+static const char* snippets[] = {
+    "addiw a0, x0, 0x4d\n",
+    "lui a1, 0x10000\n"
+    "addiw a0, x0, 0x4d\n"
+    "sb a0, 0(a1)\n",
+    "lui a0, 0x5\n"
+    "addiw a0, a0, 0x555\n"
+    "lui a1, 0x100\n"
+    "sw a0, 0(a1)\n"
+    "jalr x0, 0(ra)\n",
+};
+
+#define SNIPPETS_LENGTH (sizeof(snippets) / sizeof(snippets[0]))
+
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+    uint64_t sizes[SNIPPETS_LENGTH];
+    for (uint64_t i = 0; i < SNIPPETS_LENGTH; ++i) {
+        sizes[i] = strlen(snippets[i]);
+    }
+
+    /* One context for every snippet */
+    struct mallard_context* context = mallard_context_create();
+    double best = 0;
+    uint64_t bytes = 0;
+    for (int j = 0; j < ITERATIONS; ++j) {
+        double start = seconds();
+        bytes = 0;
+        for (uint64_t i = 0; i < SNIPPETS; ++i) {
+            uint64_t index = i % SNIPPETS_LENGTH;
+            struct mallard_result result
+                = mallard_assemble(context, snippets[index], sizes[index]);
+            bytes += result.size;
+        }
+        double elapsed = seconds() - start;
+        if (best == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    mallard_context_destroy(context);
+    printf("mallard_assemble     %10.0f snippets/s (%" PRIu64 " bytes)\n",
+           SNIPPETS / best, bytes);
+
+    /* A fresh symbol table, arena and buffers for every snippet */
+    best = 0;
+    for (int j = 0; j < ITERATIONS; ++j) {
+        double start = seconds();
+        bytes = 0;
+        for (uint64_t i = 0; i < SNIPPETS; ++i) {
+            uint64_t index = i % SNIPPETS_LENGTH;
+            struct str input = {
+                .data = (uint8_t*) snippets[index],
+                .size = sizes[index],
+            };
+            struct vector code = compile_instructions(&input);
+            bytes += code.size;
+            free(code.data);
+        }
+        double elapsed = seconds() - start;
+        if (best == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    printf("compile_instructions %10.0f snippets/s (%" PRIu64 " bytes)\n",
+           SNIPPETS / best, bytes);
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include "fatal_error.h"
+#include "str_table.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(uint64_t length) {
+    /* Keys look like generated function names */
+    struct str* keys = malloc(length * sizeof(struct str));
+    char* names = malloc(length * 32);
+    if (keys == NULL || names == NULL) {
+        fatal_error("out of memory");
+    }
+    for (uint64_t i = 0; i < length; ++i) {
+        char* name = names + i * 32;
+        keys[i].data = (uint8_t*) name;
+        keys[i].size = snprintf(name, 32, "function_%" PRIu64, i);
+    }
+
+    double start = seconds();
+    struct str_table* str_table = str_table_create();
+    for (uint64_t i = 0; i < length; ++i) {
+        str_table_insert(str_table, &keys[i], &keys[i]);
+    }
+    double insert = seconds() - start;
+
+    start = seconds();
+    for (uint64_t i = 0; i < length; ++i) {
+        struct str_table_entry* entry = str_table_get(str_table, &keys[i]);
+        if (entry == NULL || entry->val != &keys[i]) {
+            fatal_error("lookup failed");
+        }
+    }
+    double lookup = seconds() - start;
+
+    printf("str_table %8" PRIu64 " keys: insert %6.1f ns/key, "
+           "lookup %6.1f ns/key\n",
+           length, insert * 1e9 / length, lookup * 1e9 / length);
+
+    str_table_destroy(str_table);
+    free(names);
+    free(keys);
+}
+
+int main(void) {
+    run(1000);
+    run(100000);
+    run(1000000);
+    return 0;
+}
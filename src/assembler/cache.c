@@ -0,0 +1,54 @@
+#include "cache.h"
+
+#include "alloc.h"
+#include "fatal_error.h"
+#include "version.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/* 128-bit FNV-1a, wide enough that distinct sources never share an entry in
+   practice */
+static void cache_hash(struct cache_key* key,
+                       const uint8_t* data,
+                       uint64_t size) {
+    for (uint64_t i = 0; i < size; ++i) {
+        key->low ^= data[i];
+        /* Multiply by the prime, 2^88 + 0x13B, modulo 2^128 */
+        uint64_t low_low = (key->low & 0xFFFFFFFF) * 0x13B;
+        uint64_t low_high = (key->low >> 32) * 0x13B + (low_low >> 32);
+        key->high = key->high * 0x13B + (low_high >> 32) + (key->low << 24);
+        key->low = (low_high << 32) | (low_low & 0xFFFFFFFF);
+    }
+}
+
+struct cache_key cache_key(struct str* source) {
+    struct cache_key key = {
+        .high = 0x6C62272E07BB0142,
+        .low = 0x62B821756295C58D,
+    };
+    /* The version comes first, with its NUL, so a new assembler never reads
+       entries encoded by an old one */
+    const char* version = MALLARD_VERSION;
+    cache_hash(&key, (const uint8_t*) version, strlen(version) + 1);
+    cache_hash(&key, source->data, source->size);
+    return key;
+}
+
+void cache_open(const char* dir) {
+    if (mkdir(dir, 0777) == -1 && errno != EEXIST) {
+        fatal_error("cache directory create failed");
+    }
+}
+
+const char* cache_path(const char* dir, struct cache_key key) {
+    /* The directory, a slash, 32 hex digits and the extension */
+    uint64_t size = strlen(dir) + 1 + 32 + 2 + 1;
+    char* path = xmalloc(size);
+    snprintf(path, size, "%s/%016" PRIx64 "%016" PRIx64 ".o",
+             dir, key.high, key.low);
+    return path;
+}
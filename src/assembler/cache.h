@@ -0,0 +1,22 @@
+#ifndef MALLARD_CACHE_H
+#define MALLARD_CACHE_H
+
+#include "str.h"
+
+#include <stdint.h>
+
+/* Relocatable objects of previously assembled files, each named by the hash
+   of its source and the assembler version. An entry never changes once
+   written, a different source or version is a different entry. */
+struct cache_key {
+    uint64_t high;
+    uint64_t low;
+};
+
+struct cache_key cache_key(struct str* source);
+/* Creates the directory when it does not exist yet */
+void cache_open(const char* dir);
+/* The path of the key's entry in dir, the caller frees it */
+const char* cache_path(const char* dir, struct cache_key key);
+
+#endif /* ifndef MALLARD_CACHE_H */
@@ -1,218 +1,843 @@
 #include "compile.h"
 
+#include "alloc.h"
 #include "ast_node.h"
+#include "cache.h"
 #include "fatal_error.h"
 #include "file.h"
+#include "ihex.h"
 #include "lexer.h"
 #include "parser.h"
+#include "str_table.h"
+#include "thread_pool.h"
+#include "trace.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-static struct vector instructions_init() {
-    uint64_t capacity = 4096;
-    uint8_t* data = malloc(capacity);
-    if (data == NULL) {
-        exit(1);
-    }
-    uint64_t size = 0;
-    struct vector vector = {
-        .capacity = capacity,
-        .data = data,
-        .size = size,
+void instructions_encode(struct instructions_ast_node* insts,
+                         uint8_t* data,
+                         struct fixups* fixups) {
+    uint64_t offset = 0;
+    for (uint64_t i = 0; i < insts->ir_length; ++i) {
+        struct ir_instruction* ir = &insts->ir[i];
+        if (ir->flags & IR_FLAG_CALL) {
+            fixups_push(fixups, offset, FIXUP_JAL, ir->symbol);
+        }
+        offset += ir_instruction_encode(ir, data + offset);
+    }
+}
+
+static void fixup_jal(struct function_table_entry* entry,
+                      uint8_t* code,
+                      struct elf_file* elf_file,
+                      struct fixup* fixup) {
+    uint64_t current_address = entry->address + fixup->offset;
+
+    struct function_table_entry* target_entry
+        = elf_file_get_function(elf_file, fixup->symbol);
+    if (target_entry == NULL) {
+        fatal_error("function call to unknown function");
+    }
+    uint64_t target_address = target_entry->address;
+
+    int32_t offset = target_address - current_address;
+    if (offset >= (1 << 20)) {
+        fatal_error("function call is out of range >= 1 MiB");
+    }
+    else if (offset < -(1 << 20)) {
+        fatal_error("function call is out of range < -1 MiB");
+    }
+    else if ((offset & 0x1) == 0x1) {
+        fatal_error("function call must be aligned by 2");
+    }
+
+    /* Keep the opcode and rd, replace the offset */
+    uint8_t* data = code + fixup->offset;
+    uint32_t val;
+    memcpy(&val, data, sizeof(val));
+    val &= 0xFFF;
+    val |= isa_encode_format(ISA_FORMAT_J, 0, 0, 0, 0, 0, 0, offset);
+    memcpy(data, &val, sizeof(val));
+}
+
+void function_encode(struct function_table_entry* entry, uint8_t* code) {
+    if (entry->function_ast_node == NULL) {
+        /* Linked from an object, the fixups came with it */
+        memcpy(code, entry->code, entry->size);
+        return;
+    }
+    entry->fixups.length = 0;
+    instructions_encode(entry->function_ast_node->insts, code,
+                        &entry->fixups);
+}
+
+void function_patch(struct function_table_entry* entry,
+                    uint8_t* code,
+                    struct elf_file* elf_file) {
+    /* Every function already has its final address */
+    for (uint64_t i = 0; i < entry->fixups.length; ++i) {
+        struct fixup* fixup = &entry->fixups.data[i];
+        switch (fixup->kind) {
+        case FIXUP_JAL:
+            fixup_jal(entry, code, elf_file, fixup);
+            break;
+        default:
+            fatal_error("unknown fixup kind");
+        }
+    }
+}
+
+struct vector compile_instructions(struct str* str) {
+    struct symbol_table* symbols = symbol_table_create();
+    struct arena* arena = arena_create();
+    struct tokens tokens = lex(str, symbols);
+    struct instructions_ast_node* insts = parse_instructions(&tokens, arena);
+    struct vector instructions = {
+        .capacity = insts->code_size,
+        .data = xmalloc(insts->code_size == 0 ? 1 : insts->code_size),
+        .size = insts->code_size,
     };
-    return vector;
+    /* Nothing else is linked, so there is nothing to call */
+    struct fixups fixups = { 0 };
+    instructions_encode(insts, instructions.data, &fixups);
+    if (fixups.length != 0) {
+        fatal_error("function call to unknown function");
+    }
+    free(fixups.data);
+    arena_destroy(arena);
+    token_free(&tokens);
+    symbol_table_destroy(symbols);
+    return instructions;
 }
 
-static void instructions_push_u16(struct vector* instructions, uint16_t val) {
-    if (instructions->capacity < (instructions->size + sizeof(val))) {
-        exit(1);
+const char* str_to_c_str(struct str* str) {
+    char* buffer = xcalloc(1, str->size + 1);
+    memcpy(buffer, str->data, str->size);
+    return buffer;
+}
+
+/* One phase on the calling thread, measured for the time report and
+   recorded in the trace when the options ask for them */
+struct compile_sample {
+    struct time_sample time;
+    struct trace_span span;
+};
+
+static void compile_sample_start(const struct compile_options* options,
+                                 struct compile_sample* sample) {
+    if (options->time_report != NULL) {
+        time_sample_start(&sample->time);
+    }
+    if (options->trace != NULL) {
+        trace_span_begin(&sample->span);
     }
-    uint16_t* data = (uint16_t*) (instructions->data + instructions->size);
-    *data = val;
-    instructions->size += sizeof(val);
 }
 
-static void instructions_push_u32(struct vector* instructions, uint32_t val) {
-    if (instructions->capacity < (instructions->size + sizeof(val))) {
-        exit(1);
+static void compile_sample_stop(const struct compile_options* options,
+                                struct compile_sample* sample,
+                                enum time_phase phase,
+                                struct time_report_file* report_file,
+                                const char* detail) {
+    struct time_report* time_report = options->time_report;
+    if (time_report != NULL) {
+        time_sample_stop(&sample->time, &time_report->phases[phase],
+                         report_file == NULL
+                         ? NULL : &report_file->phases[phase]);
+    }
+    if (options->trace != NULL) {
+        trace_span_end(options->trace, &sample->span, time_phase_name(phase),
+                       detail, detail == NULL ? 0 : strlen(detail));
     }
-    uint32_t* data = (uint32_t*) (instructions->data + instructions->size);
-    *data = val;
-    instructions->size += sizeof(val);
 }
 
-static struct vector instructions_create(struct instructions_ast_node* insts) {
-    struct vector instructions = instructions_init();
-    uint64_t offset = 0;
-    for (uint64_t i = 0; i < insts->length; ++i) {
-        struct ast_node* ast_node = insts->ast_nodes[i];
+const char* compile_path(const struct compile_options* options,
+                         struct str* path) {
+    if (options->root == NULL || (path->size > 0 && path->data[0] == '/')) {
+        return str_to_c_str(path);
+    }
+    uint64_t root_size = strlen(options->root);
+    char* buffer = xcalloc(1, root_size + 1 + path->size + 1);
+    memcpy(buffer, options->root, root_size);
+    buffer[root_size] = '/';
+    memcpy(buffer + root_size + 1, path->data, path->size);
+    return buffer;
+}
 
-        if (is_label_ast_node(ast_node)) {
-            struct label_ast_node* label = (struct label_ast_node*) ast_node;
-            label->offset = offset;
-            continue;
-        }
-        else if (is_load_immediate_ast_node(ast_node)) {
+/* One file of an executable, lexed, parsed and analyzed independently of
+   the others */
+struct compile_file {
+    struct str path;
+    /* The path opened, after the root is applied */
+    const char* open_path;
+    struct symbol_table* symbols;
+    /* Lexes the file on the pool when not NULL, otherwise the file itself is
+       a job on the pool */
+    struct thread_pool* thread_pool;
+    struct thread_pool* analyze_pool;
+    /* Indexed by worker, analysis allocates from its worker's arena */
+    struct arena** worker_arenas;
+    struct arena* arena;
+    struct unit_ast_node* unit;
+
+    /* Read before the job starts. Immediates point into the source, so the
+       last function analyzed releases it. */
+    struct str source;
+    uint64_t references;
+
+    /* The file's entry in the cache, NULL without one */
+    const char* cache_path;
+    /* Loaded from the cache instead of assembled, the object's code points
+       into the entry */
+    bool cached;
+    /* Assembled and written to the cache, only once for files with the same
+       contents */
+    bool cache_store;
+    struct str cache_entry;
+    struct elf_object object;
+
+    const struct compile_options* options;
+    /* The file's entry in the time report, NULL without one */
+    struct time_report_file* report_file;
+};
+
+struct analyze_job {
+    struct compile_file* file;
+    struct ast_node* node;
+};
+
+static void compile_file_release(struct compile_file* file) {
+    if (__atomic_sub_fetch(&file->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        file_close_mmap(&file->source);
+    }
+}
+
+static void analyze_job_run(void* arg) {
+    struct analyze_job* job = arg;
+    struct compile_file* file = job->file;
+    uint64_t worker = thread_pool_worker_index(file->analyze_pool);
+    struct compile_sample sample;
+    compile_sample_start(file->options, &sample);
+    ast_node_analyze(file->worker_arenas[worker], job->node);
+    compile_sample_stop(file->options, &sample, TIME_PHASE_ANALYZE,
+                        file->report_file, file->open_path);
+    compile_file_release(file);
+}
+
+static void compile_file_run(void* arg) {
+    struct compile_file* file = arg;
+    const struct compile_options* options = file->options;
+    struct compile_sample sample;
+    compile_sample_start(options, &sample);
+    struct tokens tokens;
+    if (file->thread_pool != NULL) {
+        tokens = lex_parallel(&file->source, file->symbols, file->thread_pool);
+    }
+    else {
+        /* Lex into a private table, the shared one only takes the lock once
+           per file */
+        struct symbol_table* symbols = symbol_table_create();
+        tokens = lex(&file->source, symbols);
+        token_rebind(&tokens, file->symbols);
+        symbol_table_destroy(symbols);
+    }
+    compile_sample_stop(options, &sample, TIME_PHASE_LEX,
+                        file->report_file, file->open_path);
+
+    /* Every AST node lives until the executable is written */
+    compile_sample_start(options, &sample);
+    file->arena = arena_create();
+    file->unit = parse_unit(&tokens, file->arena);
+    /* Identifiers are interned, nothing after parsing needs the tokens */
+    token_free(&tokens);
+    compile_sample_stop(options, &sample, TIME_PHASE_PARSE,
+                        file->report_file, file->open_path);
+
+    /* Each function is analyzed and lowered as its own job */
+    file->references = 1;
+    struct unit_ast_node* unit = file->unit;
+    for (uint64_t i = 0; i < unit->length; ++i) {
+        struct ast_node* node = unit->ast_nodes[i];
+        if (!is_function_ast_node(node)) {
+            compile_sample_start(options, &sample);
+            ast_node_analyze(file->arena, node);
+            compile_sample_stop(options, &sample, TIME_PHASE_ANALYZE,
+                                file->report_file, file->open_path);
             continue;
         }
+        struct analyze_job* job = arena_alloc(file->arena,
+                                              sizeof(struct analyze_job));
+        job->file = file;
+        job->node = node;
+        __atomic_add_fetch(&file->references, 1, __ATOMIC_RELAXED);
+        thread_pool_submit(file->analyze_pool, analyze_job_run, job);
+    }
+    compile_file_release(file);
+}
+
+/* One executable block, laid out and written on its own */
+struct compile_executable {
+    struct executable_ast_node* exec;
+    /* Indexed like exec->files */
+    struct compile_file** files;
+    /* Encodes on the pool when not NULL, otherwise the executable itself is
+       a job on the pool */
+    struct thread_pool* thread_pool;
+    struct elf_file* elf_file;
+    /* The bytes to write, in the executable's output format */
+    struct iovec output;
+    /* Owns output's data when it is not part of the ELF file */
+    struct vector encoded;
+    const struct compile_options* options;
+    /* The output path, to show in the trace */
+    const char* output_path;
+};
 
-        if (ast_node_machine_code_is_compressible(ast_node)) {
-            instructions_push_u16(&instructions,
-                                  ast_node_machine_code_u16(ast_node));
-            offset += 2;
+static void compile_add_unit(struct elf_file* elf_file,
+                             struct unit_ast_node* unit) {
+    for (uint64_t i = 0; i < unit->length; ++i) {
+        struct ast_node* node = unit->ast_nodes[i];
+        if (is_function_ast_node(node)) {
+            /* Encoded once the layout is known */
+            struct function_ast_node* func = (struct function_ast_node*) node;
+            elf_add_function(elf_file, func);
+        }
+        else if (is_uninitialized_data_ast_node(node)) {
+            struct uninitialized_data_ast_node* data
+                = (struct uninitialized_data_ast_node*) node;
+            elf_add_uninitialized_data(elf_file, data);
         }
         else {
-            instructions_push_u32(&instructions,
-                                  ast_node_machine_code_u32(ast_node));
-            offset += 4;
+            fatal_error("compile unhandled ast node");
         }
     }
-    return instructions;
 }
 
-static bool ujtype_fixup(struct function_table_entry* recreate_entry,
-                         struct str_table* function_table,
-                         uint64_t current_offset,
-                         struct ujtype_ast_node* ujtype) {
-    if (!ujtype->needs_function_table) {
-        return false;
+static void compile_executable_run(void* arg) {
+    struct compile_executable* executable = arg;
+    struct executable_ast_node* exec = executable->exec;
+    struct compile_sample sample;
+    compile_sample_start(executable->options, &sample);
+    struct elf_file* elf_file = elf_create_empty();
+    elf_file_set_code_start(elf_file, exec->code_address);
+    elf_file_set_trace(elf_file, executable->options->trace);
+
+    /* Merge in file order, the function order in the output is the same no
+       matter which file finished first */
+    for (uint64_t i = 0; i < exec->files_length; ++i) {
+        struct compile_file* file = executable->files[i];
+        if (file->cached) {
+            elf_add_relocatable(elf_file, &file->object);
+        }
+        else {
+            compile_add_unit(elf_file, file->unit);
+        }
     }
-    /* Compute the offset */
-    uint64_t current_address = recreate_entry->address + current_offset;
 
-    struct str_table_entry* target_str_entry
-        = str_table_get(function_table, &(ujtype->offset_token->str));
-    struct function_table_entry* target_entry
-        = (struct function_table_entry*) target_str_entry->val;
-    uint64_t target_address = target_entry->address;
+    elf_file_set_addresses(elf_file, exec->addresses, exec->addresses_length);
+    elf_file_set_entry(elf_file, &exec->entry_token);
+    elf_file_finalize(elf_file, executable->thread_pool);
+    /* Every executable is written in one batch once all are finalized */
+    executable->elf_file = elf_file;
+    executable->output = compile_output(exec, elf_file,
+                                        &executable->encoded);
+    compile_sample_stop(executable->options, &sample, TIME_PHASE_FINALIZE,
+                        NULL, executable->output_path);
+}
 
-    int32_t offset = target_address - current_address;
-    if (offset >= (1 << 20)) {
-        fatal_error("function call is out of range >= 1 MiB");
+struct iovec compile_output(struct executable_ast_node* exec,
+                            struct elf_file* elf_file,
+                            struct vector* encoded) {
+    struct vector* output = NULL;
+    switch (exec->output_format) {
+    case OUTPUT_FORMAT_ELF:
+        output = elf_file_image(elf_file);
+        break;
+    case OUTPUT_FORMAT_BINARY:
+        /* .data has no contents yet, so the image ends with .text */
+        output = elf_file_text(elf_file);
+        break;
+    case OUTPUT_FORMAT_IHEX: {
+        struct vector* text = elf_file_text(elf_file);
+        *encoded = ihex_encode(elf_file_code_start(elf_file),
+                               text->data, text->size,
+                               elf_file_entry(elf_file));
+        output = encoded;
+        break;
     }
-    else if (offset < -(1 << 20)) {
-        fatal_error("function call is out of range < -1 MiB");
     }
-    else if ((offset & 0x1) == 0x1) {
-        fatal_error("function call must be aligned by 2");
+    struct iovec iov = {
+        .iov_base = output->data,
+        .iov_len = output->size,
+    };
+    return iov;
+}
+
+uint64_t compile_check_executables(struct unit_ast_node* unit) {
+    if (unit->length == 0) {
+        fatal_error("expected at least one executable in unit");
     }
-    ujtype->offset = offset;
+    uint64_t files_length = 0;
+    struct str_table* output_paths = str_table_create();
+    for (uint64_t i = 0; i < unit->length; ++i) {
+        struct ast_node* node = unit->ast_nodes[i];
+        if (!is_executable_ast_node(node)) {
+            fatal_error("expected executable ast node");
+        }
+        struct executable_ast_node* exec = (struct executable_ast_node*) node;
+        if (str_table_get(output_paths, &exec->output_path.str) != NULL) {
+            fatal_error("executables must have different output paths");
+        }
+        str_table_insert(output_paths, &exec->output_path.str, exec);
+        files_length += exec->files_length;
+    }
+    str_table_destroy(output_paths);
+    return files_length;
+}
 
-    return true;
+static void depfile_append(struct vector* depfile,
+                           const char* data,
+                           uint64_t size) {
+    if (depfile->size + size > depfile->capacity) {
+        uint64_t capacity = depfile->capacity == 0
+                            ? 4096 : depfile->capacity * 2;
+        while (capacity < depfile->size + size) {
+            capacity *= 2;
+        }
+        depfile->data = xrealloc(depfile->data, capacity);
+        depfile->capacity = capacity;
+    }
+    memcpy(depfile->data + depfile->size, data, size);
+    depfile->size += size;
 }
 
-void instructions_recreate(struct function_table_entry* recreate_entry,
-                           struct str_table* function_table) {
-    struct instructions_ast_node* insts
-        = recreate_entry->function_ast_node->insts;
+/* Escapes the characters Make and ninja treat specially in a path */
+static void depfile_append_path(struct vector* depfile, const char* path) {
+    for (const char* c = path; *c != '\0'; ++c) {
+        if (*c == ' ' || *c == '#') {
+            depfile_append(depfile, "\\", 1);
+        }
+        else if (*c == '$') {
+            depfile_append(depfile, "$", 1);
+        }
+        depfile_append(depfile, c, 1);
+    }
+}
 
-    uint64_t offset = 0;
-    for (uint64_t i = 0; i < insts->length; ++i) {
-        struct ast_node* ast_node = insts->ast_nodes[i];
+/* One rule, the output depends on every file the executable lists */
+static void depfile_append_rule(struct vector* depfile,
+                                const char* output_path,
+                                struct compile_file** files,
+                                uint64_t files_length) {
+    depfile_append_path(depfile, output_path);
+    depfile_append(depfile, ":", 1);
+    for (uint64_t i = 0; i < files_length; ++i) {
+        depfile_append(depfile, " ", 1);
+        depfile_append_path(depfile, files[i]->open_path);
+    }
+    depfile_append(depfile, "\n", 1);
+}
+
+/* Builds every executable of an analyzed unit. All files share symbols, so
+   names compare as integers across files. */
+static void compile_unit(struct unit_ast_node* unit,
+                         struct symbol_table* symbols,
+                         const struct compile_options* options) {
+    uint64_t files_length = compile_check_executables(unit);
+    struct time_report* time_report = options->time_report;
+    struct compile_sample sample;
 
-        bool fixup = false;
-        if (is_ujtype_ast_node(ast_node)) {
-            struct ujtype_ast_node* ujtype = (struct ujtype_ast_node*) ast_node;
-            fixup = ujtype_fixup(recreate_entry, function_table,
-                                 offset, ujtype);
+    uint64_t jobs = options->jobs;
+    if (jobs == 0) {
+        jobs = thread_pool_default_threads();
+    }
+    struct thread_pool* thread_pool = thread_pool_create(jobs);
+
+    uint64_t workers = thread_pool_threads(thread_pool);
+    struct arena** worker_arenas = xcalloc(workers + 1, sizeof(struct arena*));
+    for (uint64_t i = 0; i <= workers; ++i) {
+        worker_arenas[i] = arena_create();
+    }
+
+    /* Every file is lexed and parsed once, no matter how many executables
+       list it */
+    struct compile_file* files = xcalloc(files_length + 1,
+                                         sizeof(struct compile_file));
+    struct compile_executable* executables
+        = xcalloc(unit->length, sizeof(struct compile_executable));
+    struct compile_file** executable_files
+        = xcalloc(files_length + 1, sizeof(struct compile_file*));
+    struct str_table* file_table = str_table_create();
+    files_length = 0;
+    uint64_t executable_files_length = 0;
+    for (uint64_t i = 0; i < unit->length; ++i) {
+        struct executable_ast_node* exec
+            = (struct executable_ast_node*) unit->ast_nodes[i];
+        executables[i].exec = exec;
+        executables[i].options = options;
+        executables[i].output_path = str_to_c_str(&exec->output_path.str);
+        executables[i].files = executable_files + executable_files_length;
+        for (uint64_t j = 0; j < exec->files_length; ++j) {
+            struct str* path = &exec->files[j].str;
+            struct str_table_entry* entry = str_table_get(file_table, path);
+            struct compile_file* file = NULL;
+            if (entry != NULL) {
+                file = entry->val;
+            }
+            else {
+                file = &files[files_length++];
+                file->path = *path;
+                file->symbols = symbols;
+                file->analyze_pool = thread_pool;
+                file->worker_arenas = worker_arenas;
+                file->options = options;
+                str_table_insert(file_table, path, file);
+            }
+            executable_files[executable_files_length++] = file;
         }
-        else if (is_load_immediate_ast_node(ast_node)) {
-            continue;
+    }
+    str_table_destroy(file_table);
+
+    const char** paths = xcalloc(files_length + 1, sizeof(const char*));
+    struct str* sources = xcalloc(files_length + 1, sizeof(struct str));
+    for (uint64_t i = 0; i < files_length; ++i) {
+        paths[i] = compile_path(options, &files[i].path);
+        files[i].open_path = paths[i];
+    }
+    compile_sample_start(options, &sample);
+    file_open_read_batch(paths, sources, files_length);
+    struct time_report_file* report_files = NULL;
+    if (time_report != NULL) {
+        report_files = time_report_add_files(time_report, files_length);
+    }
+    for (uint64_t i = 0; i < files_length; ++i) {
+        files[i].source = sources[i];
+        if (report_files != NULL) {
+            files[i].report_file = &report_files[i];
+            report_files[i].path = xstrdup(paths[i]);
+            report_files[i].size = sources[i].size;
         }
+    }
+    free(sources);
+    free(paths);
 
-        if (ast_node_machine_code_is_compressible(ast_node)) {
-            if (fixup) {
-                uint16_t* data
-                    = (uint16_t*) (recreate_entry->instructions->data + offset);
-                *data = ast_node_machine_code_u16(ast_node);
+    /* Cached files are read here, reading interns their names and nothing
+       else may intern while files are lexed */
+    uint64_t cache_misses = 0;
+    if (options->cache_dir != NULL) {
+        cache_open(options->cache_dir);
+        for (uint64_t i = 0; i < files_length; ++i) {
+            struct compile_file* file = &files[i];
+            struct cache_key key = cache_key(&file->source);
+            file->cache_path = cache_path(options->cache_dir, key);
+            if (!file_try_open_read_mmap(file->cache_path,
+                                         &file->cache_entry)) {
+                file->cache_store = true;
+                for (uint64_t j = 0; j < i; ++j) {
+                    if (files[j].cache_store
+                        && strcmp(files[j].cache_path, file->cache_path)
+                           == 0) {
+                        file->cache_store = false;
+                        break;
+                    }
+                }
+                cache_misses += file->cache_store;
+                continue;
             }
-            offset += 2;
+            elf_object_read(&file->object, &file->cache_entry, symbols);
+            file->cached = true;
+            file_close_mmap(&file->source);
         }
-        else {
-            if (fixup) {
-                uint32_t* data
-                    = (uint32_t*) (recreate_entry->instructions->data + offset);
-                *data = ast_node_machine_code_u32(ast_node);
+    }
+    compile_sample_stop(options, &sample, TIME_PHASE_READ, NULL, NULL);
+
+    if (files_length == 1) {
+        /* A single large file is split and lexed on every core instead */
+        if (!files[0].cached) {
+            files[0].thread_pool = thread_pool;
+            compile_file_run(&files[0]);
+        }
+    }
+    else {
+        for (uint64_t i = 0; i < files_length; ++i) {
+            if (!files[i].cached) {
+                thread_pool_submit(thread_pool, compile_file_run, &files[i]);
             }
-            offset += 4;
         }
     }
-}
+    thread_pool_wait(thread_pool);
 
-struct vector compile_instructions(struct str* str) {
-    struct tokens tokens = lex(str);
-    struct instructions_ast_node* insts = parse_instructions(&tokens);
-    return instructions_create(insts);
-}
+    if (unit->length == 1) {
+        /* A single executable encodes its functions on every core instead */
+        executables[0].thread_pool = thread_pool;
+        compile_executable_run(&executables[0]);
+    }
+    else {
+        for (uint64_t i = 0; i < unit->length; ++i) {
+            thread_pool_submit(thread_pool, compile_executable_run,
+                               &executables[i]);
+        }
+        thread_pool_wait(thread_pool);
+    }
 
-static const char* str_to_c_str(struct str* str) {
-    char* buffer = calloc(1, str->size + 1);
-    if (buffer == NULL) {
-        fatal_error("out of memory");
+    /* Files that missed the cache are stored as objects, and depfiles
+       list what each output was built from. Both are written in the same
+       batch as the executables. */
+    uint64_t depfiles_length = 0;
+    if (options->depfile) {
+        depfiles_length = options->depfile_path != NULL ? 1 : unit->length;
     }
-    memcpy(buffer, str->data, str->size);
-    return buffer;
+    uint64_t writes_length = unit->length + cache_misses + depfiles_length;
+    struct file_write* writes = xcalloc(writes_length,
+                                        sizeof(struct file_write));
+    struct elf_file** cache_objects = xcalloc(cache_misses + 1,
+                                              sizeof(struct elf_file*));
+    struct iovec* cache_iovs = xcalloc(cache_misses + 1,
+                                       sizeof(struct iovec));
+    struct vector* depfiles = xcalloc(depfiles_length + 1,
+                                      sizeof(struct vector));
+    struct iovec* depfile_iovs = xcalloc(depfiles_length + 1,
+                                         sizeof(struct iovec));
+    for (uint64_t i = 0; i < unit->length; ++i) {
+        writes[i].path = executables[i].output_path;
+        writes[i].iov = &executables[i].output;
+        writes[i].iov_length = 1;
+    }
+    cache_misses = 0;
+    compile_sample_start(options, &sample);
+    for (uint64_t i = 0; i < files_length; ++i) {
+        struct compile_file* file = &files[i];
+        if (!file->cache_store) {
+            continue;
+        }
+        struct elf_file* elf_file = elf_create_empty();
+        elf_file_set_trace(elf_file, options->trace);
+        compile_add_unit(elf_file, file->unit);
+        elf_file_finalize_object(elf_file, symbols, thread_pool);
+        struct vector* image = elf_file_image(elf_file);
+        cache_iovs[cache_misses].iov_base = image->data;
+        cache_iovs[cache_misses].iov_len = image->size;
+        cache_objects[cache_misses] = elf_file;
+        struct file_write* write = &writes[unit->length + cache_misses];
+        write->path = file->cache_path;
+        write->iov = &cache_iovs[cache_misses];
+        write->iov_length = 1;
+        ++cache_misses;
+    }
+    compile_sample_stop(options, &sample, TIME_PHASE_FINALIZE, NULL, NULL);
+    thread_pool_destroy(thread_pool);
+
+    struct file_write* depfile_writes = writes + unit->length + cache_misses;
+    for (uint64_t i = 0; i < unit->length && depfiles_length != 0; ++i) {
+        uint64_t index = options->depfile_path != NULL ? 0 : i;
+        depfile_append_rule(&depfiles[index], writes[i].path,
+                            executables[i].files,
+                            executables[i].exec->files_length);
+        depfile_iovs[index].iov_base = depfiles[index].data;
+        depfile_iovs[index].iov_len = depfiles[index].size;
+        depfile_writes[index].iov = &depfile_iovs[index];
+        depfile_writes[index].iov_length = 1;
+        if (options->depfile_path != NULL) {
+            depfile_writes[index].path = options->depfile_path;
+            continue;
+        }
+        uint64_t size = strlen(writes[i].path) + 3;
+        char* path = xmalloc(size);
+        snprintf(path, size, "%s.d", writes[i].path);
+        depfile_writes[index].path = path;
+    }
+
+    compile_sample_start(options, &sample);
+    file_write_batch(writes, writes_length);
+    compile_sample_stop(options, &sample, TIME_PHASE_WRITE, NULL, NULL);
+    for (uint64_t i = 0; i < unit->length; ++i) {
+        free((void*) writes[i].path);
+        free(executables[i].encoded.data);
+        elf_file_destroy(executables[i].elf_file);
+    }
+    for (uint64_t i = 0; i < cache_misses; ++i) {
+        elf_file_destroy(cache_objects[i]);
+    }
+    for (uint64_t i = 0; i < depfiles_length; ++i) {
+        if (options->depfile_path == NULL) {
+            free((void*) depfile_writes[i].path);
+        }
+        free(depfiles[i].data);
+    }
+    free(depfile_iovs);
+    free(depfiles);
+    free(cache_iovs);
+    free(cache_objects);
+    free(writes);
+
+    for (uint64_t i = 0; i < files_length; ++i) {
+        if (files[i].cached) {
+            elf_object_free(&files[i].object);
+            file_close_mmap(&files[i].cache_entry);
+        }
+        else {
+            arena_destroy(files[i].arena);
+        }
+        free((void*) files[i].cache_path);
+        free((void*) files[i].open_path);
+    }
+    free(executable_files);
+    free(executables);
+    free(files);
+    for (uint64_t i = 0; i <= workers; ++i) {
+        arena_destroy(worker_arenas[i]);
+    }
+    free(worker_arenas);
 }
 
-void compile(struct str* str) {
-    struct tokens tokens = lex(str);
-    struct ast_node* node = parse(&tokens);
+void compile(struct str* str, uint64_t jobs) {
+    struct compile_options options = {
+        .jobs = jobs,
+    };
+    compile_with_options(str, &options);
+}
+
+void compile_with_options(struct str* str,
+                          const struct compile_options* options) {
+    struct time_report* time_report = options->time_report;
+    uint64_t start = time_report_now();
+    struct compile_sample sample;
+    compile_sample_start(options, &sample);
+    struct symbol_table* symbols = symbol_table_create();
+    struct arena* arena = arena_create();
+    struct tokens tokens = lex(str, symbols);
+    compile_sample_stop(options, &sample, TIME_PHASE_LEX, NULL, NULL);
+    compile_sample_start(options, &sample);
+    struct ast_node* node = parse(&tokens, arena);
+    compile_sample_stop(options, &sample, TIME_PHASE_PARSE, NULL, NULL);
 
     if (!is_unit_ast_node(node)) {
         fatal_error("expected unit ast node");
     }
-    struct unit_ast_node* unit = (struct unit_ast_node*) node;
-    if (unit->length != 1) {
-        fatal_error("expected single node in unit");
+    compile_unit((struct unit_ast_node*) node, symbols, options);
+
+    arena_destroy(arena);
+    token_free(&tokens);
+    symbol_table_destroy(symbols);
+    if (time_report != NULL) {
+        time_report->nanoseconds += time_report_now() - start;
     }
-    node = unit->ast_nodes[0];
-    if (!is_executable_ast_node(node)) {
-        fatal_error("expected executable ast node");
+}
+
+void compile_fd(int fd, const struct compile_options* options) {
+    struct time_report* time_report = options->time_report;
+    uint64_t start = time_report_now();
+    struct compile_sample sample;
+    struct symbol_table* symbols = symbol_table_create();
+    struct arena* arena = arena_create();
+    struct file_stream stream;
+    file_stream_open(&stream, fd);
+    struct tokens tokens;
+    token_init(&tokens, stream.data, symbols);
+    struct unit_ast_node* unit = create_empty_unit_ast_node(arena);
+
+    /* Each chunk is lexed, parsed and analyzed as soon as it arrives, while
+       the writer produces the next one */
+    uint64_t lexed = 0;
+    uint64_t parsed = 0;
+    bool more = true;
+    while (more) {
+        compile_sample_start(options, &sample);
+        more = file_stream_read(&stream);
+        compile_sample_stop(options, &sample, TIME_PHASE_READ, NULL, NULL);
+        struct str input = {
+            .data = stream.data,
+            .size = stream.size,
+        };
+        compile_sample_start(options, &sample);
+        lexed = lex_incremental(&tokens, &input, lexed, !more);
+        compile_sample_stop(options, &sample, TIME_PHASE_LEX, NULL, NULL);
+        uint64_t analyzed = unit->length;
+        compile_sample_start(options, &sample);
+        parsed = parse_unit_items(&tokens, parsed, !more, arena, unit);
+        compile_sample_stop(options, &sample, TIME_PHASE_PARSE, NULL, NULL);
+        compile_sample_start(options, &sample);
+        for (uint64_t i = analyzed; i < unit->length; ++i) {
+            ast_node_analyze(arena, unit->ast_nodes[i]);
+        }
+        compile_sample_stop(options, &sample, TIME_PHASE_ANALYZE, NULL,
+                            NULL);
     }
+    compile_unit(unit, symbols, options);
 
-    struct executable_ast_node* exec = (struct executable_ast_node*) node;
-    struct elf_file* elf_file = elf_create_empty();
-    elf_file_set_code_start(elf_file, exec->code_address);
+    arena_destroy(arena);
+    token_free(&tokens);
+    file_stream_close(&stream);
+    symbol_table_destroy(symbols);
+    if (time_report != NULL) {
+        time_report->nanoseconds += time_report_now() - start;
+    }
+}
 
-    for (uint64_t i = 0; i < exec->files_length; ++i) {
-        const char* path = str_to_c_str(&exec->files[i]->str);
-        struct str str = file_open_read_mmap(path);
-        struct tokens tokens = lex(&str);
-        struct ast_node* node = parse(&tokens);
-        if (!is_unit_ast_node(node)) {
-            fatal_error("expected unit ast node");
-        }
-        struct unit_ast_node* unit = (struct unit_ast_node*) node;
-        for (uint64_t j = 0; j < unit->length; ++j) {
-            node = unit->ast_nodes[j];
-            if (is_function_ast_node(node)) {
-                struct function_ast_node* func = (struct function_ast_node*) node;
-                struct vector* instructions = calloc(1, sizeof(struct vector));
-                if (instructions == NULL) {
-                    fatal_error("out of memory");
-                }
-                *instructions = instructions_create(func->insts);
-                elf_add_function(elf_file, func, instructions);
-            }
-            else if (is_uninitialized_data_ast_node(node)) {
-                struct uninitialized_data_ast_node* data
-                    = (struct uninitialized_data_ast_node*) node;
-                elf_add_uninitialized_data(elf_file, data);
-            }
-            else {
-                fatal_error("compile unhandled ast node");
-            }
+struct elf_file* compile_relocatable(struct str* str,
+                                     struct symbol_table* symbols,
+                                     struct thread_pool* thread_pool,
+                                     struct compile_relocatable* relocatable) {
+    relocatable->arena = arena_create();
+    /* Lexed into the caller's tokens, so an error partway loses nothing */
+    token_init(&relocatable->tokens, NULL, symbols);
+    lex_reuse(&relocatable->tokens, str);
+    struct ast_node* node = parse(&relocatable->tokens, relocatable->arena);
+    if (!is_unit_ast_node(node)) {
+        fatal_error("expected unit ast node");
+    }
+
+    struct unit_ast_node* unit = (struct unit_ast_node*) node;
+    relocatable->elf_file = elf_create_empty();
+    struct elf_file* elf_file = relocatable->elf_file;
+    for (uint64_t i = 0; i < unit->length; ++i) {
+        node = unit->ast_nodes[i];
+        if (is_function_ast_node(node)) {
+            elf_add_function(elf_file, (struct function_ast_node*) node);
+        }
+        else if (is_uninitialized_data_ast_node(node)) {
+            elf_add_uninitialized_data(
+                elf_file, (struct uninitialized_data_ast_node*) node
+            );
+        }
+        else {
+            fatal_error("objects only hold functions and data");
         }
-        /* The memory mapping needs to exist for tokens */
-        // file_close_mmap(&str);
     }
+    elf_file_finalize_object(elf_file, symbols, thread_pool);
 
-    elf_file_set_addresses(elf_file, exec->addresses, exec->addresses_length);
-    elf_file_set_entry(elf_file, exec->entry_token);
-    elf_file_finalize(elf_file);
+    /* The image holds everything, the AST is only needed to encode it */
+    relocatable->elf_file = NULL;
+    compile_relocatable_free(relocatable);
+    return elf_file;
+}
 
-    const char* output_path = str_to_c_str(&exec->output_path->str);
+void compile_relocatable_free(struct compile_relocatable* relocatable) {
+    if (relocatable->elf_file != NULL) {
+        elf_file_destroy(relocatable->elf_file);
+    }
+    if (relocatable->arena != NULL) {
+        arena_destroy(relocatable->arena);
+    }
+    token_free(&relocatable->tokens);
+    relocatable->elf_file = NULL;
+    relocatable->arena = NULL;
+}
+
+void compile_object(struct str* str, const char* output_path, uint64_t jobs) {
+    struct symbol_table* symbols = symbol_table_create();
+    if (jobs == 0) {
+        jobs = thread_pool_default_threads();
+    }
+    struct thread_pool* thread_pool = thread_pool_create(jobs);
+    struct compile_relocatable relocatable = { 0 };
+    struct elf_file* elf_file = compile_relocatable(str, symbols, thread_pool,
+                                                    &relocatable);
+    thread_pool_destroy(thread_pool);
     elf_write(elf_file, output_path);
+
+    elf_file_destroy(elf_file);
+    symbol_table_destroy(symbols);
 }
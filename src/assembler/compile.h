@@ -1,14 +1,94 @@
 #ifndef MALLARD_COMPILE_H
 #define MALLARD_COMPILE_H
 
+#include "ast_node.h"
 #include "elf.h"
 #include "str.h"
+#include "time_report.h"
+#include "tokens.h"
+#include "trace.h"
 #include "vector.h"
 
+#include <sys/uio.h>
+
+struct compile_options {
+    /* Threads to use, one per core when 0 */
+    uint64_t jobs;
+    /* Reuses the encoded functions of unchanged files from this directory
+       and stores the rest there, when not NULL */
+    const char* cache_dir;
+    /* Relative paths in files lists are found here instead of the working
+       directory, when not NULL */
+    const char* root;
+    /* Writes a Makefile rule with each executable's files, every rule to
+       depfile_path or each to its output path with .d appended when
+       NULL */
+    bool depfile;
+    const char* depfile_path;
+    /* Adds the time, allocations and hardware counters of each phase and
+       file to this report, when not NULL */
+    struct time_report* time_report;
+    /* Records a span for each phase, file and function on the thread that
+       ran it, when not NULL */
+    struct trace* trace;
+};
+
 struct vector compile_instructions(struct str* str);
-void compile(struct str* str);
+/* Builds the executable described by str, with jobs threads or one per
+   core when jobs is 0 */
+void compile(struct str* str, uint64_t jobs);
+void compile_with_options(struct str* str,
+                          const struct compile_options* options);
+/* Like compile, but reads the unit from fd as it arrives, such as from a
+   pipe */
+void compile_fd(int fd, const struct compile_options* options);
+/* Assembles one source file into a relocatable object for mallard-ld */
+void compile_object(struct str* str, const char* output_path, uint64_t jobs);
+/* What compile_relocatable allocates while it runs, starting zeroed. The
+   caller keeps it so that after an error jumps out of compile_relocatable
+   compile_relocatable_free releases everything. */
+struct compile_relocatable {
+    struct arena* arena;
+    struct tokens tokens;
+    struct elf_file* elf_file;
+};
+
+/* Assembles one source file into a finalized relocatable object in memory,
+   its image is read back with elf_object_read. The caller owns the
+   returned file, relocatable is left zeroed. */
+struct elf_file* compile_relocatable(struct str* str,
+                                     struct symbol_table* symbols,
+                                     struct thread_pool* thread_pool,
+                                     struct compile_relocatable* relocatable);
+void compile_relocatable_free(struct compile_relocatable* relocatable);
+
+/* A NUL terminated copy of str, the caller frees it */
+const char* str_to_c_str(struct str* str);
+/* The path to open for a file an executable lists, the caller frees it */
+const char* compile_path(const struct compile_options* options,
+                         struct str* path);
+/* Checks that every node of the unit is an executable with its own output
+   path, returns how many files they list in total */
+uint64_t compile_check_executables(struct unit_ast_node* unit);
+/* The bytes to write for a finalized executable in its output format. When
+   they are not part of the ELF file encoded owns them, the caller frees
+   its data. */
+struct iovec compile_output(struct executable_ast_node* exec,
+                            struct elf_file* elf_file,
+                            struct vector* encoded);
 
-void instructions_recreate(struct function_table_entry* recreate_entry,
-                           struct str_table* function_table);
+/* Writes a function's machine code to data, which must have room for
+   code_size bytes, and records the calls to patch. The function itself is
+   only read, several executables may encode it at once. */
+void instructions_encode(struct instructions_ast_node* insts,
+                         uint8_t* data,
+                         struct fixups* fixups);
+/* Encodes a function at its final address into code, the function's slot
+   in the .text image, and records its fixups */
+void function_encode(struct function_table_entry* entry, uint8_t* code);
+/* Applies the fixups, once every function has an address */
+void function_patch(struct function_table_entry* entry,
+                    uint8_t* code,
+                    struct elf_file* elf_file);
 
 #endif /* ifndef MALLARD_COMPILE_H */
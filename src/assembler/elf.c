@@ -1,10 +1,12 @@
 #include "elf.h"
 
+#include "alloc.h"
 #include "compile.h"
 #include "fatal_error.h"
 #include "file.h"
 #include "parser.h"
 #include "str_table.h"
+#include "trace.h"
 
 #include <stdint.h>
 #include <stdlib.h>
@@ -19,6 +21,9 @@
 #define ELF_STRTAB_SECTION_INDEX   5
 #define ELF_SHSTRTAB_SECTION_INDEX 6
 #define ELF_NUM_SECTIONS           7
+/* Only relocatable objects have relocations */
+#define ELF_RELA_TEXT_SECTION_INDEX 7
+#define ELF_NUM_OBJECT_SECTIONS     8
 
 #define EV_NONE    0
 #define EV_CURRENT 1
@@ -101,6 +106,12 @@
 
 #define ST_VISIBILITY(o) ((o)&0x3)
 
+#define R_SYM(info)        ((info) >> 32)
+#define R_TYPE(info)       ((info) & 0xffffffff)
+#define R_INFO(sym, type)  (((uint64_t) (sym) << 32) + (type))
+
+#define R_RISCV_JAL 17
+
 #define STV_DEFAULT   0
 #define STV_INTERNAL  1
 #define STV_HIDDEN    2
@@ -166,9 +177,20 @@ struct elf_symbol {
     uint64_t size;
 };
 
+struct elf_rela {
+    uint64_t offset;
+    uint64_t info;
+    int64_t addend;
+};
+
 struct elf_file {
     bool set_entry;
     bool set_code_start;
+    /* Calls are left as relocations instead of patched */
+    bool relocatable;
+    /* Records layout, and encoding and patching each function, when not
+       NULL */
+    struct trace* trace;
 
     struct token* entry;
 
@@ -184,15 +206,20 @@ struct elf_file {
     struct str_table* function_table;
     struct str_table* object_table;
 
+    /* Functions indexed by the symbol of their name */
+    struct function_table_entry** function_symbols;
+    uint64_t function_symbols_length;
+
     struct executable_address_tuple** addresses;
     uint64_t addresses_length;
 
     struct elf_header* header;
 
     struct vector symtab;
-    struct elf_symbol* text_symbol;
-    struct elf_symbol* data_symbol;
-    struct elf_symbol* bss_symbol;
+    /* Indices into symtab, which moves as it grows */
+    uint32_t text_symbol;
+    uint32_t data_symbol;
+    uint32_t bss_symbol;
 
     struct vector strtab;
     struct vector shstrtab;
@@ -201,14 +228,24 @@ struct elf_file {
     struct elf_program_header* object_program_header;
 
     struct vector section_headers;
+    struct vector rela_text;
+
+    /* The whole file once finalized */
+    struct vector image;
+    /* The .text section within the image, every function is encoded at its
+       offset */
+    struct vector text;
+};
+
+struct object_table_entry {
+    struct str* name;
+    uint64_t size;
+    uint64_t offset;
 };
 
 static struct elf_program_header* elf_program_header_create_empty() {
     struct elf_program_header* elf_program_header
-        = calloc(1, sizeof(struct elf_program_header));
-    if (elf_program_header == NULL) {
-        fatal_error("out of memory");
-    }
+        = xcalloc(1, sizeof(struct elf_program_header));
     return elf_program_header;
 }
 
@@ -222,33 +259,47 @@ static struct elf_section_header* elf_section_header_get(
 
 static void symtab_create_empty(struct vector* symtab) {
     uint64_t capacity = 4096;
-    uint8_t* data = calloc(1, capacity);
-    if (data == NULL) {
-        fatal_error("out of memory");
-    }
+    uint8_t* data = xcalloc(1, capacity);
     uint64_t size = 0;
     symtab->capacity = capacity;
     symtab->data = data;
     symtab->size = size;
 }
 
-static struct elf_symbol* symtab_next(struct vector* symtab) {
+static void vector_reserve(struct vector* vector, uint64_t size) {
+    if (size <= vector->capacity) {
+        return;
+    }
+    uint64_t capacity = vector->capacity * 2;
+    if (capacity < size) {
+        capacity = size;
+    }
+    uint8_t* data = xrealloc(vector->data, capacity);
+    memset(data + vector->capacity, 0, capacity - vector->capacity);
+    vector->data = data;
+    vector->capacity = capacity;
+}
+
+static struct elf_symbol* symtab_get(struct vector* symtab, uint32_t index) {
+    struct elf_symbol* data = (struct elf_symbol*) symtab->data;
+    return &data[index];
+}
+
+/* Pointers to symbols are only valid until the next symbol is added */
+static uint32_t symtab_next(struct vector* symtab) {
     size_t len = sizeof(struct elf_symbol);
-    if ((symtab->size + len) > symtab->capacity) {
+    if ((symtab->size / len) >= UINT32_MAX) {
         fatal_error("symbols out of space");
     }
+    vector_reserve(symtab, symtab->size + len);
     uint32_t index = symtab->size / len;
-    struct elf_symbol* data = (struct elf_symbol*) symtab->data;
     symtab->size += len;
-    return &data[index];
+    return index;
 }
 
 static void strtab_create_empty(struct vector* strtab) {
     uint64_t capacity = 4096;
-    uint8_t* data = calloc(1, capacity);
-    if (data == NULL) {
-        fatal_error("out of memory");
-    }
+    uint8_t* data = xcalloc(1, capacity);
     /* The size is 0 because we expect index 0 to always be null */
     uint64_t size = 1;
     strtab->capacity = capacity;
@@ -258,9 +309,10 @@ static void strtab_create_empty(struct vector* strtab) {
 
 static uint32_t strtab_add_from_c_str(struct vector* strtab, const char* str) {
     size_t len = strlen(str) + 1;
-    if ((strtab->size + len) > strtab->capacity) {
+    if ((strtab->size + len) > UINT32_MAX) {
         fatal_error("strtab out of space");
     }
+    vector_reserve(strtab, strtab->size + len);
     uint32_t next_index = strtab->size;
     memcpy(&strtab->data[next_index], str, len);
     strtab->size += len;
@@ -269,9 +321,10 @@ static uint32_t strtab_add_from_c_str(struct vector* strtab, const char* str) {
 
 static uint32_t strtab_add_from_str(struct vector* strtab, struct str* str) {
     size_t len = str->size + 1;
-    if ((strtab->size + len) > strtab->capacity) {
+    if ((strtab->size + len) > UINT32_MAX) {
         fatal_error("strtab out of space");
     }
+    vector_reserve(strtab, strtab->size + len);
     uint32_t next_index = strtab->size;
     memcpy(&strtab->data[next_index], str->data, str->size);
     strtab->size += len;
@@ -280,10 +333,7 @@ static uint32_t strtab_add_from_str(struct vector* strtab, struct str* str) {
 
 static void elf_section_headers_init(struct vector* section_headers) {
     uint64_t capacity = sizeof(struct elf_section_header) * ELF_NUM_SECTIONS;
-    struct elf_section_header* data = calloc(1, capacity);
-    if (data == NULL) {
-        fatal_error("out of memory");
-    }
+    struct elf_section_header* data = xcalloc(1, capacity);
     uint64_t size = capacity;
 
     section_headers->capacity = capacity;
@@ -292,20 +342,14 @@ static void elf_section_headers_init(struct vector* section_headers) {
 }
 
 struct elf_file* elf_create_empty() {
-    struct elf_file* elf_file = calloc(1, sizeof(struct elf_file));
-    if (elf_file == NULL) {
-        fatal_error("out of memory");
-    }
+    struct elf_file* elf_file = xcalloc(1, sizeof(struct elf_file));
     elf_file->set_entry = false;
     elf_file->set_code_start = false;
     elf_file->data_size = 0;
     elf_file->bss_size = 0;
 
     struct elf_header* elf_header
-        = calloc(1, sizeof(struct elf_header));
-    if (elf_header == NULL) {
-        fatal_error("out of memory");
-    }
+        = xcalloc(1, sizeof(struct elf_header));
     elf_file->header = elf_header;
 
     elf_file->function_table = str_table_create();
@@ -349,20 +393,22 @@ struct elf_file* elf_create_empty() {
 
     elf_section_headers_init(&elf_file->section_headers);
 
-    struct elf_symbol* null_symbol = symtab_next(symtab);
+    uint32_t null_index = symtab_next(symtab);
+    struct elf_symbol* null_symbol = symtab_get(symtab, null_index);
     null_symbol->name = 0;
     null_symbol->info = ST_INFO(STB_LOCAL, STT_NOTYPE);
     null_symbol->other = ST_VISIBILITY(STV_DEFAULT);
     null_symbol->shndx = SHN_UNDEF;
     null_symbol->size = 0;
 
-    struct elf_symbol* text_symbol = symtab_next(symtab);
+    uint32_t text_index = symtab_next(symtab);
+    struct elf_symbol* text_symbol = symtab_get(symtab, text_index);
     text_symbol->name = strtab_add_from_c_str(strtab, ".text");
     text_symbol->info = ST_INFO(STB_LOCAL, STT_SECTION);
     text_symbol->other = ST_VISIBILITY(STV_DEFAULT);
     text_symbol->shndx = ELF_TEXT_SECTION_INDEX;
     text_symbol->size = 0;
-    elf_file->text_symbol = text_symbol;
+    elf_file->text_symbol = text_index;
 
     struct elf_section_header* text_header
         = elf_section_header_get(elf_file, ELF_TEXT_SECTION_INDEX);
@@ -374,21 +420,23 @@ struct elf_file* elf_create_empty() {
     text_header->addralign = 2;
     text_header->entsize = 0;
 
-    struct elf_symbol* data_symbol = symtab_next(symtab);
+    uint32_t data_index = symtab_next(symtab);
+    struct elf_symbol* data_symbol = symtab_get(symtab, data_index);
     data_symbol->name = strtab_add_from_c_str(strtab, ".data");
     data_symbol->info = ST_INFO(STB_LOCAL, STT_SECTION);
     data_symbol->other = ST_VISIBILITY(STV_DEFAULT);
     data_symbol->shndx = ELF_DATA_SECTION_INDEX;
     data_symbol->size = 0;
-    elf_file->data_symbol = data_symbol;
+    elf_file->data_symbol = data_index;
 
-    struct elf_symbol* bss_symbol = symtab_next(symtab);
+    uint32_t bss_index = symtab_next(symtab);
+    struct elf_symbol* bss_symbol = symtab_get(symtab, bss_index);
     bss_symbol->name = strtab_add_from_c_str(strtab, ".bss");
     bss_symbol->info = ST_INFO(STB_LOCAL, STT_SECTION);
     bss_symbol->other = ST_VISIBILITY(STV_DEFAULT);
     bss_symbol->shndx = ELF_BSS_SECTION_INDEX;
     bss_symbol->size = 0;
-    elf_file->bss_symbol = bss_symbol;
+    elf_file->bss_symbol = bss_index;
 
     struct elf_section_header* data_header
         = elf_section_header_get(elf_file, ELF_DATA_SECTION_INDEX);
@@ -454,6 +502,10 @@ void elf_file_set_entry(struct elf_file* elf_file, struct token* name) {
     elf_file->set_entry = true;
 }
 
+void elf_file_set_trace(struct elf_file* elf_file, struct trace* trace) {
+    elf_file->trace = trace;
+}
+
 void elf_file_set_code_start(struct elf_file* elf_file, uint64_t address) {
     if (elf_file->set_code_start) {
         fatal_error("code program header already set");
@@ -477,80 +529,264 @@ void elf_file_set_addresses(struct elf_file* elf_file,
     elf_file->addresses_length = addresses_length;
 }
 
-void elf_add_function(struct elf_file* elf_file,
-                      struct function_ast_node* function_ast_node,
-                      struct vector* instructions) {
-    struct str* function_name = &(function_ast_node->name->str);
+void fixups_push(struct fixups* fixups,
+                 uint64_t offset,
+                 enum fixup_kind kind,
+                 uint32_t symbol) {
+    if (fixups->length == fixups->capacity) {
+        fixups->capacity = fixups->capacity == 0 ? 16 : fixups->capacity * 2;
+        fixups->data = xrealloc(fixups->data,
+                                fixups->capacity * sizeof(struct fixup));
+    }
+    struct fixup* fixup = &fixups->data[fixups->length];
+    fixup->offset = offset;
+    fixup->symbol = symbol;
+    fixup->kind = kind;
+    ++(fixups->length);
+}
 
-    struct elf_symbol* symbol = symtab_next(&elf_file->symtab);
+static struct function_table_entry* elf_add_function_entry(
+    struct elf_file* elf_file,
+    struct str* function_name,
+    uint32_t function_symbol,
+    uint64_t size
+) {
+    uint32_t symtab_index = symtab_next(&elf_file->symtab);
+    struct elf_symbol* symbol = symtab_get(&elf_file->symtab, symtab_index);
     symbol->name
         = strtab_add_from_str(&elf_file->strtab, function_name);
     symbol->info = ST_INFO(STB_LOCAL, STT_FUNC);
     symbol->other = ST_VISIBILITY(STV_DEFAULT);
     symbol->shndx = ELF_TEXT_SECTION_INDEX;
-    symbol->size = instructions->size;
+    symbol->size = size;
 
     struct function_table_entry* entry
-        = calloc(1, sizeof(struct function_table_entry));
-    entry->function_ast_node = function_ast_node;
-    entry->instructions = instructions;
-    entry->symbol = symbol;
+        = xcalloc(1, sizeof(struct function_table_entry));
+    entry->symtab_index = symtab_index;
+    entry->size = size;
     entry->address = 0;
     str_table_insert(elf_file->function_table, function_name, entry);
-}
 
-static bool instructions_need_function_table(struct instructions_ast_node* insts) {
-    for (uint64_t i = 0; i < insts->length; ++i) {
-        struct ast_node* ast_node = insts->ast_nodes[i];
-        if (is_ujtype_ast_node(ast_node)) {
-            struct ujtype_ast_node* ujtype = (struct ujtype_ast_node*) ast_node;
-            if (!ujtype->needs_function_table) {
-                continue;
-            }
-            if (ujtype->offset_token->kind != TOKEN_IDENTIFIER) {
-                fatal_error("expected offset to function nanme");
-            }
-            return true;
+    if (function_symbol >= elf_file->function_symbols_length) {
+        uint64_t length = elf_file->function_symbols_length * 2;
+        if (length <= function_symbol) {
+            length = function_symbol + 1;
+        }
+        elf_file->function_symbols = xrealloc(
+            elf_file->function_symbols,
+            length * sizeof(struct function_table_entry*)
+        );
+        for (uint64_t i = elf_file->function_symbols_length; i < length; ++i) {
+            elf_file->function_symbols[i] = NULL;
         }
+        elf_file->function_symbols_length = length;
+    }
+    if (elf_file->function_symbols[function_symbol] != NULL) {
+        fatal_error("function defined more than once");
+    }
+    elf_file->function_symbols[function_symbol] = entry;
+    return entry;
+}
+
+void elf_add_function(struct elf_file* elf_file,
+                      struct function_ast_node* function_ast_node) {
+    struct function_table_entry* entry = elf_add_function_entry(
+        elf_file, &function_ast_node->name.str,
+        function_ast_node->name.symbol, function_ast_node->insts->code_size
+    );
+    entry->function_ast_node = function_ast_node;
+}
+
+void elf_add_function_code(struct elf_file* elf_file,
+                           struct str* name,
+                           uint32_t symbol,
+                           const uint8_t* code,
+                           uint64_t size,
+                           struct fixups* fixups) {
+    struct function_table_entry* entry
+        = elf_add_function_entry(elf_file, name, symbol, size);
+    entry->code = code;
+    /* Each executable patches its own copy */
+    if (fixups->length != 0) {
+        entry->fixups.data = xmalloc(fixups->length * sizeof(struct fixup));
+        memcpy(entry->fixups.data, fixups->data,
+               fixups->length * sizeof(struct fixup));
+        entry->fixups.length = fixups->length;
+        entry->fixups.capacity = fixups->length;
+    }
+}
+
+struct function_table_entry* elf_file_get_function(struct elf_file* elf_file,
+                                                   uint32_t symbol) {
+    if (symbol >= elf_file->function_symbols_length) {
+        return NULL;
+    }
+    return elf_file->function_symbols[symbol];
+}
+
+void elf_add_object(struct elf_file* elf_file,
+                    struct str* name,
+                    uint64_t size) {
+    /* The object may be shared with other executables, so its offset in
+       this one is kept here */
+    struct object_table_entry* entry
+        = xcalloc(1, sizeof(struct object_table_entry));
+    entry->name = name;
+    entry->size = size;
+    entry->offset = elf_file->bss_size;
+    elf_file->bss_size += size;
+    str_table_insert(elf_file->object_table, name, entry);
+}
+
+void elf_add_relocatable(struct elf_file* elf_file,
+                         struct elf_object* object) {
+    for (uint64_t i = 0; i < object->functions_length; ++i) {
+        struct elf_object_function* function = &object->functions[i];
+        elf_add_function_code(elf_file, &function->name, function->symbol,
+                              function->code, function->size,
+                              &function->fixups);
+    }
+    for (uint64_t i = 0; i < object->data_length; ++i) {
+        struct elf_object_data* data = &object->data[i];
+        elf_add_object(elf_file, &data->name, data->size);
     }
-    return false;
 }
 
 void elf_add_uninitialized_data(
     struct elf_file* elf_file,
     struct uninitialized_data_ast_node* uninitialized_data_ast_node
 ) {
-    uninitialized_data_ast_node->offset = elf_file->bss_size;
-    elf_file->bss_size += uninitialized_data_ast_node->size;
-    str_table_insert(elf_file->object_table,
-                     &(uninitialized_data_ast_node->name->str),
-                     uninitialized_data_ast_node);
+    elf_add_object(elf_file, &uninitialized_data_ast_node->name.str,
+                   uninitialized_data_ast_node->size);
+}
+
+/* Each function is encoded and then patched as separate jobs, a worker
+   that runs out steals whichever is oldest elsewhere */
+struct function_job {
+    struct elf_file* elf_file;
+    struct str* name;
+    struct function_table_entry* entry;
+    struct thread_pool* thread_pool;
+};
+
+static uint8_t* function_job_code(struct function_job* job) {
+    struct elf_file* elf_file = job->elf_file;
+    return elf_file->text.data + (job->entry->address - elf_file->code_start);
+}
+
+/* Spans are only recorded for a trace, the clock is not read otherwise */
+static void function_job_begin(struct function_job* job,
+                               struct trace_span* span) {
+    if (job->elf_file->trace != NULL) {
+        trace_span_begin(span);
+    }
+}
+
+static void function_job_end(struct function_job* job,
+                             struct trace_span* span,
+                             const char* name) {
+    struct trace* trace = job->elf_file->trace;
+    if (trace != NULL) {
+        trace_span_end(trace, span, name, (const char*) job->name->data,
+                       job->name->size);
+    }
+}
+
+static void function_job_patch(void* arg) {
+    struct function_job* job = arg;
+    struct trace_span span;
+    function_job_begin(job, &span);
+    function_patch(job->entry, function_job_code(job), job->elf_file);
+    function_job_end(job, &span, "fixup");
+}
+
+static void function_job_encode(void* arg) {
+    struct function_job* job = arg;
+    struct trace_span span;
+    function_job_begin(job, &span);
+    function_encode(job->entry, function_job_code(job));
+    function_job_end(job, &span, "encode");
+    if (job->entry->fixups.length == 0 || job->elf_file->relocatable) {
+        return;
+    }
+    if (job->thread_pool != NULL) {
+        thread_pool_submit(job->thread_pool, function_job_patch, job);
+    }
+    else {
+        function_job_patch(job);
+    }
+}
+
+/* Encodes every function at its address in .text, which must be laid out */
+static void elf_file_encode(struct elf_file* elf_file,
+                            struct thread_pool* thread_pool) {
+    uint64_t functions_length = str_table_size(elf_file->function_table);
+    struct function_job* jobs = xcalloc(functions_length + 1,
+                                        sizeof(struct function_job));
+    uint64_t length = 0;
+    struct str_table_entry* function_entry
+        = str_table_iterator(elf_file->function_table);
+    while (function_entry != NULL) {
+        struct function_table_entry* entry = function_entry->val;
+        if (entry->address == 0 && !elf_file->relocatable) {
+            fatal_error("function address not set");
+        }
+        jobs[length].elf_file = elf_file;
+        jobs[length].name = function_entry->key;
+        jobs[length].entry = entry;
+        jobs[length].thread_pool = thread_pool;
+        ++length;
+        str_table_iterator_next(elf_file->function_table, &function_entry);
+    }
+
+    /* Functions write disjoint slots and only read other addresses */
+    for (uint64_t i = 0; i < length; ++i) {
+        if (thread_pool != NULL) {
+            thread_pool_submit(thread_pool, function_job_encode, &jobs[i]);
+        }
+        else {
+            function_job_encode(&jobs[i]);
+        }
+    }
+    if (thread_pool != NULL) {
+        thread_pool_wait(thread_pool);
+    }
+    free(jobs);
 }
 
-void elf_file_finalize(struct elf_file* elf_file) {
+void elf_file_finalize(struct elf_file* elf_file,
+                       struct thread_pool* thread_pool) {
     if (!elf_file->set_code_start) {
         fatal_error("elf file code start not set");
     }
     if (!elf_file->set_entry) {
         fatal_error("elf file entry address not set");
     }
+    struct trace_span span;
+    if (elf_file->trace != NULL) {
+        trace_span_begin(&span);
+    }
 
     struct str_table_entry* function_entry = NULL;
 
     for (uint64_t i = 0; i < elf_file->addresses_length; ++i) {
         struct executable_address_tuple* tuple = elf_file->addresses[i];
-        struct str* function_name = &(tuple->function->str);
-        function_entry = str_table_get(elf_file->function_table, function_name);
-        if (function_entry == NULL) {
+        struct function_table_entry* entry
+            = elf_file_get_function(elf_file, tuple->function.symbol);
+        if (entry == NULL) {
             fatal_error("address set for unknown function");
         }
         uint64_t address = tuple->imm;
+        if (address < elf_file->code_start) {
+            fatal_error("function address comes before start of code");
+        }
 
-        struct function_table_entry* entry = function_entry->val;
         entry->address = address;
-        entry->symbol->value = address;
+        struct elf_symbol* symbol
+            = symtab_get(&elf_file->symtab, entry->symtab_index);
+        symbol->value = address;
 
-        uint64_t code_end = address + entry->instructions->size;
+        uint64_t code_end = address + entry->size;
         if (code_end <= elf_file->code_start) {
             fatal_error("end of code needs to come after start");
         }
@@ -569,9 +805,11 @@ void elf_file_finalize(struct elf_file* elf_file) {
         if (entry->address == 0) {
             uint64_t address = elf_file->code_start + elf_file->code_size;
             entry->address = address;
-            entry->symbol->value = address;
+            struct elf_symbol* symbol
+                = symtab_get(&elf_file->symtab, entry->symtab_index);
+            symbol->value = address;
 
-            elf_file->code_size += entry->instructions->size;
+            elf_file->code_size += entry->size;
         }
 
         str_table_iterator_next(elf_file->function_table, &function_entry);
@@ -592,22 +830,17 @@ void elf_file_finalize(struct elf_file* elf_file) {
     struct str_table_entry* object_entry
         = str_table_iterator(elf_file->object_table);
     while (object_entry != NULL) {
-        struct ast_node* node = object_entry->val;
-
-        if (is_uninitialized_data_ast_node(node)) {
-            struct uninitialized_data_ast_node* uninitialized
-                = (struct uninitialized_data_ast_node*) node;
-
-            struct str* object_name = &(uninitialized->name->str);
-            struct elf_symbol* symbol = symtab_next(&elf_file->symtab);
-            symbol->name
-                = strtab_add_from_str(&elf_file->strtab, object_name);
-            symbol->info = ST_INFO(STB_LOCAL, STT_OBJECT);
-            symbol->other = ST_VISIBILITY(STV_DEFAULT);
-            symbol->shndx = ELF_BSS_SECTION_INDEX;
-            symbol->value = elf_file->bss_start + uninitialized->offset;
-            symbol->size = uninitialized->size;
-        }
+        struct object_table_entry* entry = object_entry->val;
+        struct elf_symbol* symbol = symtab_get(
+            &elf_file->symtab, symtab_next(&elf_file->symtab)
+        );
+        symbol->name
+            = strtab_add_from_str(&elf_file->strtab, entry->name);
+        symbol->info = ST_INFO(STB_LOCAL, STT_OBJECT);
+        symbol->other = ST_VISIBILITY(STV_DEFAULT);
+        symbol->shndx = ELF_BSS_SECTION_INDEX;
+        symbol->value = elf_file->bss_start + entry->offset;
+        symbol->size = entry->size;
 
         str_table_iterator_next(elf_file->object_table, &object_entry);
     }
@@ -622,12 +855,11 @@ void elf_file_finalize(struct elf_file* elf_file) {
     elf_file->object_program_header->alignment = 0x1000;
 
     {
-        function_entry = str_table_get(elf_file->function_table,
-                                       &elf_file->entry->str);
-        if (function_entry == NULL) {
+        struct function_table_entry* entry
+            = elf_file_get_function(elf_file, elf_file->entry->symbol);
+        if (entry == NULL) {
             fatal_error("entry function does not exist");
         }
-        struct function_table_entry* entry = function_entry->val;
         if (entry->address == 0) {
             fatal_error("entry function address not set");
         }
@@ -647,7 +879,8 @@ void elf_file_finalize(struct elf_file* elf_file) {
     text_header->address = elf_file->code_start;
     text_header->size = elf_file->code_size;
 
-    elf_file->text_symbol->value = elf_file->code_start;
+    symtab_get(&elf_file->symtab, elf_file->text_symbol)->value
+        = elf_file->code_start;
 
     /* .data section and symbol */
     struct elf_section_header* data_header
@@ -655,14 +888,16 @@ void elf_file_finalize(struct elf_file* elf_file) {
     data_header->address = elf_file->data_start;
     data_header->size = elf_file->data_size;
 
-    elf_file->data_symbol->value = elf_file->data_start;
+    symtab_get(&elf_file->symtab, elf_file->data_symbol)->value
+        = elf_file->data_start;
 
     struct elf_section_header* bss_header
         = elf_section_header_get(elf_file, ELF_BSS_SECTION_INDEX);
     bss_header->address = elf_file->data_start;
     bss_header->size = elf_file->bss_size;
 
-    elf_file->bss_symbol->value = elf_file->bss_start;
+    symtab_get(&elf_file->symtab, elf_file->bss_symbol)->value
+        = elf_file->bss_start;
 
     struct elf_section_header* symtab_header
         = elf_section_header_get(elf_file, ELF_SYMTAB_SECTION_INDEX);
@@ -706,100 +941,498 @@ void elf_file_finalize(struct elf_file* elf_file) {
     current_offset += elf_file->shstrtab.size;
     elf_file->header->section_header_offset = current_offset;
 
-    /* Final check for jumps to a label */
+    /* The whole file is one buffer, .text is encoded straight into it */
+    uint64_t image_size = current_offset + elf_file->section_headers.size;
+    elf_file->image.data = xcalloc(1, image_size);
+    elf_file->image.capacity = image_size;
+    elf_file->image.size = image_size;
+
+    /* Every function has an address, encode them in place. Gaps between
+       functions stay zero. */
+    elf_file->text.data = elf_file->image.data + text_header->offset;
+    elf_file->text.capacity = elf_file->code_size;
+    elf_file->text.size = elf_file->code_size;
+    if (elf_file->trace != NULL) {
+        trace_span_end(elf_file->trace, &span, "layout", NULL, 0);
+    }
+    elf_file_encode(elf_file, thread_pool);
+
+    uint8_t* image = elf_file->image.data;
+    memcpy(image, elf_file->header, sizeof(struct elf_header));
+    memcpy(image + elf_file->header->program_header_offset,
+           elf_file->code_program_header,
+           sizeof(struct elf_program_header));
+    memcpy(image + elf_file->header->program_header_offset
+           + sizeof(struct elf_program_header),
+           elf_file->object_program_header,
+           sizeof(struct elf_program_header));
+    memcpy(image + symtab_header->offset,
+           elf_file->symtab.data, elf_file->symtab.size);
+    memcpy(image + strtab_header->offset,
+           elf_file->strtab.data, elf_file->strtab.size);
+    memcpy(image + shstrtab_header->offset,
+           elf_file->shstrtab.data, elf_file->shstrtab.size);
+    memcpy(image + elf_file->header->section_header_offset,
+           elf_file->section_headers.data, elf_file->section_headers.size);
+}
+
+static uint64_t elf_align(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+void elf_file_finalize_object(struct elf_file* elf_file,
+                              struct symbol_table* symbols,
+                              struct thread_pool* thread_pool) {
+    elf_file->relocatable = true;
+    elf_file->header->type = ET_REL;
+
+    /* Functions are laid out in order from offset 0 of .text, every symbol
+       other than the section symbols is global */
+    struct str_table_entry* function_entry
+        = str_table_iterator(elf_file->function_table);
+    while (function_entry != NULL) {
+        struct function_table_entry* entry = function_entry->val;
+        entry->address = elf_file->code_size;
+        struct elf_symbol* symbol
+            = symtab_get(&elf_file->symtab, entry->symtab_index);
+        symbol->info = ST_INFO(STB_GLOBAL, STT_FUNC);
+        symbol->value = entry->address;
+        elf_file->code_size += entry->size;
+        str_table_iterator_next(elf_file->function_table, &function_entry);
+    }
+
+    struct str_table_entry* object_entry
+        = str_table_iterator(elf_file->object_table);
+    while (object_entry != NULL) {
+        struct object_table_entry* entry = object_entry->val;
+        struct elf_symbol* symbol = symtab_get(
+            &elf_file->symtab, symtab_next(&elf_file->symtab)
+        );
+        symbol->name = strtab_add_from_str(&elf_file->strtab, entry->name);
+        symbol->info = ST_INFO(STB_GLOBAL, STT_OBJECT);
+        symbol->other = ST_VISIBILITY(STV_DEFAULT);
+        symbol->shndx = ELF_BSS_SECTION_INDEX;
+        symbol->value = entry->offset;
+        symbol->size = entry->size;
+        str_table_iterator_next(elf_file->object_table, &object_entry);
+    }
+
+    /* The fixups decide the symbol table, so .text is encoded before the
+       image size is known and copied in after */
+    uint8_t* text = xmalloc(elf_file->code_size + 1);
+    elf_file->text.data = text;
+    elf_file->text.capacity = elf_file->code_size;
+    elf_file->text.size = elf_file->code_size;
+    elf_file_encode(elf_file, thread_pool);
+
+    /* Every call becomes a relocation, even within this object, so the
+       linker may place each function on its own. Functions from other
+       objects get one undefined symbol each. */
+    uint32_t* undefined = xcalloc(symbol_table_length(symbols) + 1,
+                                  sizeof(uint32_t));
+    struct vector* rela_text = &elf_file->rela_text;
     function_entry = str_table_iterator(elf_file->function_table);
     while (function_entry != NULL) {
         struct function_table_entry* entry = function_entry->val;
-        if (entry->address == 0) {
-            fatal_error("function address not set");
-        }
+        for (uint64_t i = 0; i < entry->fixups.length; ++i) {
+            struct fixup* fixup = &entry->fixups.data[i];
+            struct function_table_entry* target
+                = elf_file_get_function(elf_file, fixup->symbol);
+            uint32_t symtab_index = 0;
+            if (target != NULL) {
+                symtab_index = target->symtab_index;
+            }
+            else if (undefined[fixup->symbol] != 0) {
+                symtab_index = undefined[fixup->symbol];
+            }
+            else {
+                struct str name = symbol_table_str(symbols, fixup->symbol);
+                symtab_index = symtab_next(&elf_file->symtab);
+                struct elf_symbol* symbol
+                    = symtab_get(&elf_file->symtab, symtab_index);
+                symbol->name = strtab_add_from_str(&elf_file->strtab, &name);
+                symbol->info = ST_INFO(STB_GLOBAL, STT_NOTYPE);
+                symbol->other = ST_VISIBILITY(STV_DEFAULT);
+                symbol->shndx = SHN_UNDEF;
+                undefined[fixup->symbol] = symtab_index;
+            }
 
-        struct function_ast_node* function_ast_node = entry->function_ast_node;
-        if (instructions_need_function_table(function_ast_node->insts)) {
-            instructions_recreate(entry, elf_file->function_table);
+            vector_reserve(rela_text, rela_text->size
+                                      + sizeof(struct elf_rela));
+            struct elf_rela* rela
+                = (struct elf_rela*) (rela_text->data + rela_text->size);
+            rela->offset = entry->address + fixup->offset;
+            rela->info = R_INFO(symtab_index, R_RISCV_JAL);
+            rela->addend = 0;
+            rela_text->size += sizeof(struct elf_rela);
         }
-
         str_table_iterator_next(elf_file->function_table, &function_entry);
     }
-}
+    free(undefined);
+
+    struct vector* section_headers = &elf_file->section_headers;
+    vector_reserve(section_headers,
+                   sizeof(struct elf_section_header)
+                   * ELF_NUM_OBJECT_SECTIONS);
+    section_headers->size = sizeof(struct elf_section_header)
+                            * ELF_NUM_OBJECT_SECTIONS;
+    struct elf_section_header* rela_header
+        = elf_section_header_get(elf_file, ELF_RELA_TEXT_SECTION_INDEX);
+    rela_header->name = strtab_add_from_c_str(&elf_file->shstrtab,
+                                              ".rela.text");
+    rela_header->type = SHT_RELA;
+    rela_header->flags = SHF_INFO_LINK;
+    rela_header->link = ELF_SYMTAB_SECTION_INDEX;
+    rela_header->info = ELF_TEXT_SECTION_INDEX;
+    rela_header->addralign = 8;
+    rela_header->entsize = sizeof(struct elf_rela);
+    rela_header->size = rela_text->size;
 
-void elf_write(struct elf_file* elf_file, const char* output_path) {
-    int fd = file_open_write(output_path);
+    struct elf_section_header* text_header
+        = elf_section_header_get(elf_file, ELF_TEXT_SECTION_INDEX);
+    text_header->size = elf_file->code_size;
+    struct elf_section_header* data_header
+        = elf_section_header_get(elf_file, ELF_DATA_SECTION_INDEX);
+    struct elf_section_header* bss_header
+        = elf_section_header_get(elf_file, ELF_BSS_SECTION_INDEX);
+    bss_header->size = elf_file->bss_size;
+    struct elf_section_header* symtab_header
+        = elf_section_header_get(elf_file, ELF_SYMTAB_SECTION_INDEX);
+    symtab_header->size = elf_file->symtab.size;
+    /* Only the null and section symbols are local */
+    symtab_header->info = 4;
+    struct elf_section_header* strtab_header
+        = elf_section_header_get(elf_file, ELF_STRTAB_SECTION_INDEX);
+    strtab_header->size = elf_file->strtab.size;
+    struct elf_section_header* shstrtab_header
+        = elf_section_header_get(elf_file, ELF_SHSTRTAB_SECTION_INDEX);
+    shstrtab_header->size = elf_file->shstrtab.size;
 
-    ssize_t bytes_expected = sizeof(struct elf_header);
-    ssize_t bytes_written = write(fd, elf_file->header, bytes_expected);
-    if (bytes_written != bytes_expected) {
-        fatal_error("write failed (header)");
-    }
+    /* No program headers, the tables that hold 8 byte fields are aligned */
+    uint64_t current_offset = sizeof(struct elf_header);
+    text_header->offset = current_offset;
+    current_offset += text_header->size;
+    data_header->offset = current_offset;
+    bss_header->offset = current_offset;
+    current_offset = elf_align(current_offset, 8);
+    symtab_header->offset = current_offset;
+    current_offset += symtab_header->size;
+    rela_header->offset = current_offset;
+    current_offset += rela_header->size;
+    strtab_header->offset = current_offset;
+    current_offset += strtab_header->size;
+    shstrtab_header->offset = current_offset;
+    current_offset += shstrtab_header->size;
+    current_offset = elf_align(current_offset, 8);
+    elf_file->header->section_header_offset = current_offset;
+    elf_file->header->section_header_num_entries = ELF_NUM_OBJECT_SECTIONS;
+    elf_file->header->section_header_string_index = ELF_SHSTRTAB_SECTION_INDEX;
 
-    bytes_expected = sizeof(struct elf_program_header);
-    bytes_written = write(fd, elf_file->code_program_header, bytes_expected);
-    if (bytes_written != bytes_expected) {
-        fatal_error("write failed (code program header)");
+    uint64_t image_size = current_offset + section_headers->size;
+    elf_file->image.data = xcalloc(1, image_size);
+    elf_file->image.capacity = image_size;
+    elf_file->image.size = image_size;
+
+    uint8_t* image = elf_file->image.data;
+    memcpy(image + text_header->offset, text, elf_file->code_size);
+    free(text);
+    elf_file->text.data = image + text_header->offset;
+
+    memcpy(image, elf_file->header, sizeof(struct elf_header));
+    memcpy(image + symtab_header->offset,
+           elf_file->symtab.data, elf_file->symtab.size);
+    if (rela_text->size != 0) {
+        memcpy(image + rela_header->offset, rela_text->data, rela_text->size);
     }
+    memcpy(image + strtab_header->offset,
+           elf_file->strtab.data, elf_file->strtab.size);
+    memcpy(image + shstrtab_header->offset,
+           elf_file->shstrtab.data, elf_file->shstrtab.size);
+    memcpy(image + elf_file->header->section_header_offset,
+           section_headers->data, section_headers->size);
+}
 
-    bytes_expected = sizeof(struct elf_program_header);
-    bytes_written = write(fd, elf_file->object_program_header, bytes_expected);
-    if (bytes_written != bytes_expected) {
-        fatal_error("write failed (data program header)");
-    }
+struct vector* elf_file_image(struct elf_file* elf_file) {
+    return &elf_file->image;
+}
 
-    /* Write all the code to the text section */
-    off_t off = lseek(fd, 0, SEEK_CUR);
-    if (off == -1) {
-        fatal_error("lseek");
-    }
-    off_t code_start = off;
+struct vector* elf_file_text(struct elf_file* elf_file) {
+    return &elf_file->text;
+}
+
+uint64_t elf_file_code_start(struct elf_file* elf_file) {
+    return elf_file->code_start;
+}
+
+uint64_t elf_file_entry(struct elf_file* elf_file) {
+    return elf_file->header->entry;
+}
+
+void elf_file_destroy(struct elf_file* elf_file) {
     struct str_table_entry* function_entry
         = str_table_iterator(elf_file->function_table);
     while (function_entry != NULL) {
         struct function_table_entry* entry = function_entry->val;
-        if (entry->address == 0) {
-            fatal_error("function address not set");
-        }
+        free(entry->fixups.data);
+        free(entry);
+        str_table_iterator_next(elf_file->function_table, &function_entry);
+    }
+    struct str_table_entry* object_entry
+        = str_table_iterator(elf_file->object_table);
+    while (object_entry != NULL) {
+        free(object_entry->val);
+        str_table_iterator_next(elf_file->object_table, &object_entry);
+    }
+    str_table_destroy(elf_file->function_table);
+    str_table_destroy(elf_file->object_table);
+    free(elf_file->function_symbols);
+    free(elf_file->header);
+    free(elf_file->code_program_header);
+    free(elf_file->object_program_header);
+    free(elf_file->symtab.data);
+    free(elf_file->strtab.data);
+    free(elf_file->shstrtab.data);
+    free(elf_file->section_headers.data);
+    free(elf_file->rela_text.data);
+    free(elf_file->image.data);
+    free(elf_file);
+}
 
-        uint64_t code_offset = entry->address - elf_file->code_start;
-        off = lseek(fd, code_start + code_offset, SEEK_SET);
-        if (off == -1) {
-            fatal_error("lseek");
-        }
+void elf_write(struct elf_file* elf_file, const char* output_path) {
+    struct iovec iov = {
+        .iov_base = elf_file->image.data,
+        .iov_len = elf_file->image.size,
+    };
+    struct file_write write = {
+        .path = output_path,
+        .iov = &iov,
+        .iov_length = 1,
+    };
+    file_write_batch(&write, 1);
+}
 
-        bytes_expected = entry->instructions->size;
-        bytes_written = write(fd, entry->instructions->data, bytes_expected);
-        if (bytes_written != bytes_expected) {
-            fatal_error("write failed (instructions)");
-        }
+static const uint8_t* elf_object_range(struct str* source,
+                                       uint64_t offset,
+                                       uint64_t size) {
+    if (offset > source->size || size > source->size - offset) {
+        fatal_error("object: section out of bounds");
+    }
+    return source->data + offset;
+}
 
-        str_table_iterator_next(elf_file->function_table, &function_entry);
+static struct str elf_object_name(struct str* strtab, uint32_t name) {
+    if (name >= strtab->size) {
+        fatal_error("object: symbol name out of bounds");
     }
-    off = lseek(fd, code_start + elf_file->code_size, SEEK_SET);
-    if (off == -1) {
-        fatal_error("lseek");
+    uint8_t* data = strtab->data + name;
+    uint8_t* end = memchr(data, '\0', strtab->size - name);
+    if (end == NULL) {
+        fatal_error("object: symbol name not terminated");
     }
+    struct str str = {
+        .data = data,
+        .size = end - data,
+    };
+    return str;
+}
 
-    bytes_expected = elf_file->symtab.size;
-    bytes_written = write(fd, elf_file->symtab.data, bytes_expected);
-    if (bytes_written != bytes_expected) {
-        fatal_error("write failed (symtab)");
+static int elf_object_function_cmp(const void* lhs, const void* rhs) {
+    const struct elf_object_function* left = lhs;
+    const struct elf_object_function* right = rhs;
+    if (left->code != right->code) {
+        return left->code < right->code ? -1 : 1;
+    }
+    /* An empty function shares its start with the next one, which is the
+       one a relocation there belongs to */
+    if (left->size != right->size) {
+        return left->size < right->size ? -1 : 1;
+    }
+    /* qsort is not stable, the symbol table order is kept instead */
+    if (left->symtab_index != right->symtab_index) {
+        return left->symtab_index < right->symtab_index ? -1 : 1;
     }
+    return 0;
+}
 
-    bytes_expected = elf_file->strtab.size;
-    bytes_written = write(fd, elf_file->strtab.data, bytes_expected);
-    if (bytes_written != bytes_expected) {
-        fatal_error("write failed (strtab)");
+void elf_object_read(struct elf_object* object,
+                     struct str* source,
+                     struct symbol_table* symbols) {
+    struct elf_header header;
+    memcpy(&header, elf_object_range(source, 0, sizeof(header)),
+           sizeof(header));
+    if (header.magic[0] != 0x7F || header.magic[1] != 'E'
+        || header.magic[2] != 'L' || header.magic[3] != 'F') {
+        fatal_error("object: not an ELF file");
+    }
+    if (header.bitness != 2 || header.endianness != 1
+        || header.type != ET_REL || header.machine != EM_RISCV) {
+        fatal_error("object: not a 64-bit RISC-V relocatable object");
+    }
+    if (header.section_header_entry_size
+        != sizeof(struct elf_section_header)) {
+        fatal_error("object: unexpected section header size");
     }
+    uint64_t sections_length = header.section_header_num_entries;
+    struct elf_section_header* sections
+        = xcalloc(sections_length + 1, sizeof(struct elf_section_header));
+    memcpy(sections,
+           elf_object_range(source, header.section_header_offset,
+                            sections_length
+                            * sizeof(struct elf_section_header)),
+           sections_length * sizeof(struct elf_section_header));
+
+    /* One executable section and one symbol table, like the objects this
+       assembler writes */
+    uint64_t text_index = 0;
+    uint64_t symtab_index = 0;
+    for (uint64_t i = 1; i < sections_length; ++i) {
+        if (sections[i].type == SHT_PROGBITS
+            && (sections[i].flags & SHF_EXECINSTR)) {
+            if (text_index != 0) {
+                fatal_error("object: more than one code section");
+            }
+            text_index = i;
+        }
+        else if (sections[i].type == SHT_SYMTAB) {
+            if (symtab_index != 0) {
+                fatal_error("object: more than one symbol table");
+            }
+            symtab_index = i;
+        }
+    }
+    if (symtab_index == 0 || sections[symtab_index].link >= sections_length) {
+        fatal_error("object: no symbol table");
+    }
+    struct elf_section_header* symtab_header = &sections[symtab_index];
+    struct elf_section_header* strtab_header
+        = &sections[symtab_header->link];
+    struct str strtab = {
+        .data = (uint8_t*) elf_object_range(source, strtab_header->offset,
+                                            strtab_header->size),
+        .size = strtab_header->size,
+    };
+    const uint8_t* text = NULL;
+    uint64_t text_size = 0;
+    if (text_index != 0) {
+        text_size = sections[text_index].size;
+        text = elf_object_range(source, sections[text_index].offset,
+                                text_size);
+    }
+
+    /* Relocations name symbols by index, so every named symbol is interned
+       up front */
+    uint64_t symbols_length = symtab_header->size / sizeof(struct elf_symbol);
+    const uint8_t* symtab_data
+        = elf_object_range(source, symtab_header->offset,
+                           symbols_length * sizeof(struct elf_symbol));
+    uint32_t* symbol_ids = xcalloc(symbols_length + 1, sizeof(uint32_t));
+    object->functions = xcalloc(symbols_length + 1,
+                                sizeof(struct elf_object_function));
+    object->data = xcalloc(symbols_length + 1, sizeof(struct elf_object_data));
+    object->functions_length = 0;
+    object->data_length = 0;
+    for (uint64_t i = 1; i < symbols_length; ++i) {
+        struct elf_symbol symbol;
+        memcpy(&symbol, symtab_data + i * sizeof(struct elf_symbol),
+               sizeof(symbol));
+        struct str name = elf_object_name(&strtab, symbol.name);
+        if (name.size == 0) {
+            continue;
+        }
+        symbol_ids[i] = symbol_table_intern(symbols, name.data, name.size);
 
-    bytes_expected = elf_file->shstrtab.size;
-    bytes_written = write(fd, elf_file->shstrtab.data, bytes_expected);
-    if (bytes_written != bytes_expected) {
-        fatal_error("write failed (shstrtab)");
+        if (ST_TYPE(symbol.info) == STT_FUNC) {
+            if (symbol.shndx != text_index || text_index == 0) {
+                fatal_error("object: function outside of code section");
+            }
+            if (symbol.value > text_size
+                || symbol.size > text_size - symbol.value) {
+                fatal_error("object: function out of bounds");
+            }
+            struct elf_object_function* function
+                = &object->functions[object->functions_length++];
+            function->name = name;
+            function->symbol = symbol_ids[i];
+            function->code = text + symbol.value;
+            function->size = symbol.size;
+            function->symtab_index = i;
+        }
+        else if (ST_TYPE(symbol.info) == STT_OBJECT) {
+            if (symbol.shndx >= sections_length
+                || sections[symbol.shndx].type != SHT_NOBITS) {
+                fatal_error("object: only uninitialized data is supported");
+            }
+            struct elf_object_data* data
+                = &object->data[object->data_length++];
+            data->name = name;
+            data->size = symbol.size;
+        }
     }
+    qsort(object->functions, object->functions_length,
+          sizeof(struct elf_object_function), elf_object_function_cmp);
+
+    /* Each relocation becomes a fixup of the function that contains it */
+    for (uint64_t i = 1; i < sections_length; ++i) {
+        struct elf_section_header* rela_header = &sections[i];
+        if (rela_header->type != SHT_RELA) {
+            continue;
+        }
+        if (rela_header->info != text_index
+            || rela_header->link != symtab_index) {
+            fatal_error("object: relocations for an unknown section");
+        }
+        uint64_t relas_length = rela_header->size / sizeof(struct elf_rela);
+        const uint8_t* rela_data
+            = elf_object_range(source, rela_header->offset,
+                               relas_length * sizeof(struct elf_rela));
+        for (uint64_t j = 0; j < relas_length; ++j) {
+            struct elf_rela rela;
+            memcpy(&rela, rela_data + j * sizeof(struct elf_rela),
+                   sizeof(rela));
+            if (R_TYPE(rela.info) != R_RISCV_JAL || rela.addend != 0) {
+                fatal_error("object: unsupported relocation");
+            }
+            uint64_t symbol = R_SYM(rela.info);
+            if (symbol == 0 || symbol >= symbols_length
+                || symbol_ids[symbol] == 0) {
+                fatal_error("object: relocation against unnamed symbol");
+            }
 
-    bytes_expected = elf_file->section_headers.size;
-    bytes_written = write(fd, elf_file->section_headers.data, bytes_expected);
-    if (bytes_written != bytes_expected) {
-        fatal_error("write failed (section headers)");
+            /* The last function starting at or before the relocation */
+            const uint8_t* target = text + rela.offset;
+            uint64_t low = 0;
+            uint64_t high = object->functions_length;
+            while (low < high) {
+                uint64_t middle = low + (high - low) / 2;
+                if (object->functions[middle].code <= target) {
+                    low = middle + 1;
+                }
+                else {
+                    high = middle;
+                }
+            }
+            if (low == 0) {
+                fatal_error("object: relocation outside of a function");
+            }
+            struct elf_object_function* function
+                = &object->functions[low - 1];
+            uint64_t offset = target - function->code;
+            if (offset + 4 > function->size) {
+                fatal_error("object: relocation outside of a function");
+            }
+            fixups_push(&function->fixups, offset, FIXUP_JAL,
+                        symbol_ids[symbol]);
+        }
     }
 
-    file_close(fd);
+    free(symbol_ids);
+    free(sections);
+}
+
+void elf_object_free(struct elf_object* object) {
+    for (uint64_t i = 0; i < object->functions_length; ++i) {
+        free(object->functions[i].fixups.data);
+    }
+    free(object->functions);
+    free(object->data);
 }
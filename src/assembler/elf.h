@@ -2,32 +2,124 @@
 #define MALLARD_ELF_H
 
 #include "ast_node.h"
+#include "symbol_table.h"
+#include "thread_pool.h"
 #include "token.h"
+#include "trace.h"
 #include "vector.h"
 
 struct elf_file;
 
+enum fixup_kind {
+    /* The offset field of a jal, relative to the jal */
+    FIXUP_JAL,
+};
+
+/* A word in a function's machine code that depends on another function's
+   address, recorded when the function is first encoded */
+struct fixup {
+    uint64_t offset;
+    uint32_t symbol;
+    uint32_t kind;
+};
+
+struct fixups {
+    struct fixup* data;
+    uint64_t length;
+    uint64_t capacity;
+};
+
+void fixups_push(struct fixups* fixups,
+                 uint64_t offset,
+                 enum fixup_kind kind,
+                 uint32_t symbol);
+
 struct function_table_entry {
+    /* Either the function to encode, or its machine code from an object */
     struct function_ast_node* function_ast_node;
-    struct vector* instructions;
-    struct elf_symbol* symbol;
+    const uint8_t* code;
+    struct fixups fixups;
+    uint32_t symtab_index;
     uint64_t address;
+    uint64_t size;
 };
 
+/* A function of a relocatable object, its name and code point into the
+   object's source */
+struct elf_object_function {
+    struct str name;
+    uint32_t symbol;
+    const uint8_t* code;
+    uint64_t size;
+    struct fixups fixups;
+    /* Its symbol's index, which orders functions that are otherwise equal */
+    uint64_t symtab_index;
+};
+
+struct elf_object_data {
+    struct str name;
+    uint64_t size;
+};
+
+struct elf_object {
+    struct elf_object_function* functions;
+    uint64_t functions_length;
+    struct elf_object_data* data;
+    uint64_t data_length;
+};
+
+/* Reads a relocatable object, interning every name into symbols. The source
+   must outlive the object. */
+void elf_object_read(struct elf_object* object,
+                     struct str* source,
+                     struct symbol_table* symbols);
+void elf_object_free(struct elf_object* object);
+
 struct elf_file* elf_create_empty();
 void elf_file_set_addresses(struct elf_file* elf_file,
                             struct executable_address_tuple** addresses,
                             uint64_t addresses_length);
 void elf_file_set_code_start(struct elf_file* elf_file, uint64_t address);
+/* Records the layout and each function's encoding in trace */
+void elf_file_set_trace(struct elf_file* elf_file, struct trace* trace);
 void elf_file_set_entry(struct elf_file* elf_file, struct token* name);
 void elf_add_function(struct elf_file* elf_file,
-                      struct function_ast_node* function_ast_node,
-                      struct vector* instructions);
+                      struct function_ast_node* function_ast_node);
+/* Adds machine code linked from an object, with the fixups its calls need.
+   The name and code must outlive the ELF file. */
+void elf_add_function_code(struct elf_file* elf_file,
+                           struct str* name,
+                           uint32_t symbol,
+                           const uint8_t* code,
+                           uint64_t size,
+                           struct fixups* fixups);
+struct function_table_entry* elf_file_get_function(struct elf_file* elf_file,
+                                                   uint32_t symbol);
+void elf_add_object(struct elf_file* elf_file,
+                    struct str* name,
+                    uint64_t size);
+/* Adds every function and data of an object read with elf_object_read */
+void elf_add_relocatable(struct elf_file* elf_file,
+                         struct elf_object* object);
 void elf_add_uninitialized_data(
     struct elf_file* elf_file,
     struct uninitialized_data_ast_node* uninitialized_data_ast_node
 );
-void elf_file_finalize(struct elf_file* elf_file);
+/* Encodes the functions on the thread pool when it is not NULL */
+void elf_file_finalize(struct elf_file* elf_file,
+                       struct thread_pool* thread_pool);
+/* Lays out a relocatable object instead, every call is left for the linker.
+   The symbols name the functions that are called but not defined. */
+void elf_file_finalize_object(struct elf_file* elf_file,
+                              struct symbol_table* symbols,
+                              struct thread_pool* thread_pool);
+/* The finalized file, valid until the ELF file is destroyed */
+struct vector* elf_file_image(struct elf_file* elf_file);
+/* The .text section within the image, loaded at the code start */
+struct vector* elf_file_text(struct elf_file* elf_file);
+uint64_t elf_file_code_start(struct elf_file* elf_file);
+uint64_t elf_file_entry(struct elf_file* elf_file);
 void elf_write(struct elf_file* elf_file, const char* output_path);
+void elf_file_destroy(struct elf_file* elf_file);
 
 #endif /* ifndef MALLARD_ELF_H */
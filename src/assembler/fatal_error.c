@@ -5,8 +5,36 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+static _Thread_local struct fatal_error_context* fatal_error_context = NULL;
+
+static void fatal_error_jump(const char* message, bool syntax) {
+    struct fatal_error_context* context = fatal_error_context;
+    if (context == NULL) {
+        return;
+    }
+    snprintf(context->message, sizeof(context->message), "%s", message);
+    context->syntax = syntax;
+    longjmp(context->jump, 1);
+}
+
 void fatal_error(const char* message) {
+    fatal_error_jump(message, false);
     dprintf(2, ANSI_BOLD_RED "fatal error:" ANSI_RESET " "
                ANSI_RED "%s" ANSI_RESET "\n", message);
     exit(1);
 }
+
+void syntax_error(const char* message) {
+    fatal_error_jump(message, true);
+    dprintf(2, ANSI_BOLD_RED "syntax error:" ANSI_RESET " "
+               ANSI_RED "%s" ANSI_RESET "\n", message);
+    exit(1);
+}
+
+struct fatal_error_context* fatal_error_set_context(
+    struct fatal_error_context* context
+) {
+    struct fatal_error_context* previous = fatal_error_context;
+    fatal_error_context = context;
+    return previous;
+}
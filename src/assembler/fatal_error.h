@@ -1,6 +1,22 @@
 #ifndef MALLARD_FATAL_ERROR_H
 #define MALLARD_FATAL_ERROR_H
 
+#include <setjmp.h>
+#include <stdbool.h>
+
+/* While a context is set on a thread, errors on that thread record their
+   message and jump back to it instead of exiting */
+struct fatal_error_context {
+    jmp_buf jump;
+    bool syntax;
+    char message[4096];
+};
+
 void fatal_error(const char* message) __attribute__ ((noreturn));
+void syntax_error(const char* message) __attribute__ ((noreturn));
+/* Returns the context it replaces, to set again afterwards */
+struct fatal_error_context* fatal_error_set_context(
+    struct fatal_error_context* context
+);
 
 #endif /* ifndef MALLARD_FATAL_ERROR_H */
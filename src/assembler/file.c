@@ -1,20 +1,45 @@
 #include "file.h"
 
+#include "alloc.h"
 #include "fatal_error.h"
 
+#include <errno.h>
 #include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#ifdef MALLARD_IO_URING
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/syscall.h>
+#endif
+
+/* A pipe holds 64 KiB by default */
+#define FILE_STREAM_READ_SIZE (64 * 1024)
+
 struct str file_open_read_mmap(const char* path) {
-    struct str str = {
-        .data = NULL,
-        .size = 0,
-    };
+    struct str str;
+    if (!file_try_open_read_mmap(path, &str)) {
+        fatal_error("file open filed");
+    }
+    return str;
+}
+
+bool file_try_open_read_mmap(const char* path, struct str* str) {
+    str->data = NULL;
+    str->size = 0;
 
     int fd = open(path, O_RDONLY);
     if (fd == -1) {
+        if (errno == ENOENT) {
+            return false;
+        }
         fatal_error("file open filed");
     }
 
@@ -23,8 +48,8 @@ struct str file_open_read_mmap(const char* path) {
         fatal_error("file fstat failed");
     }
 
-    str.data = mmap(NULL, stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    if (str.data == MAP_FAILED) {
+    str->data = mmap(NULL, stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (str->data == MAP_FAILED) {
         fatal_error("file mmap failed");
     }
 
@@ -32,15 +57,57 @@ struct str file_open_read_mmap(const char* path) {
         fatal_error("file close failed");
     }
 
-    str.size = stat.st_size;
+    str->size = stat.st_size;
 
-    return str;
+    return true;
 }
 
 void file_close_mmap(struct str* str) {
     if (munmap(str->data, str->size) == -1) {
         fatal_error("file munmap failed");
     }
+    str->data = NULL;
+    str->size = 0;
+}
+
+void file_stream_open(struct file_stream* stream, int fd) {
+    stream->fd = fd;
+    stream->size = 0;
+    stream->capacity = FILE_STREAM_CAPACITY;
+    /* Only the pages that are filled take up memory */
+    stream->data = mmap(NULL, stream->capacity, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (stream->data == MAP_FAILED) {
+        fatal_error("file stream mmap failed");
+    }
+}
+
+bool file_stream_read(struct file_stream* stream) {
+    while (true) {
+        uint64_t size = stream->capacity - stream->size;
+        if (size == 0) {
+            fatal_error("file stream larger than 4 GiB");
+        }
+        if (size > FILE_STREAM_READ_SIZE) {
+            size = FILE_STREAM_READ_SIZE;
+        }
+        ssize_t bytes_read = read(stream->fd, stream->data + stream->size,
+                                  size);
+        if (bytes_read == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fatal_error("file stream read failed");
+        }
+        stream->size += bytes_read;
+        return bytes_read != 0;
+    }
+}
+
+void file_stream_close(struct file_stream* stream) {
+    if (munmap(stream->data, stream->capacity) == -1) {
+        fatal_error("file munmap failed");
+    }
 }
 
 int file_open_write(const char* path) {
@@ -52,8 +119,509 @@ int file_open_write(const char* path) {
     return fd;
 }
 
+/* Writes every buffer in order, retrying after short writes. Returns false
+   when a write fails. */
+static bool file_try_write_iov(int fd, struct iovec* iov, int iov_length) {
+    while (iov_length > 0) {
+        ssize_t bytes_written = writev(fd, iov, iov_length);
+        if (bytes_written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        while (iov_length > 0 && (size_t) bytes_written >= iov->iov_len) {
+            bytes_written -= iov->iov_len;
+            ++iov;
+            --iov_length;
+        }
+        if (iov_length > 0) {
+            iov->iov_base = (uint8_t*) iov->iov_base + bytes_written;
+            iov->iov_len -= bytes_written;
+        }
+    }
+    return true;
+}
+
+void file_write_iov(int fd, struct iovec* iov, int iov_length) {
+    if (!file_try_write_iov(fd, iov, iov_length)) {
+        fatal_error("write failed");
+    }
+}
+
+/* A temporary file that failed is never renamed, so it is removed. Its fd
+   is closed unless it is -1. Returns the message to fail with. */
+static const char* file_write_failed(int fd,
+                                     const char* temporary_path,
+                                     const char* message) {
+    if (fd != -1) {
+        close(fd);
+    }
+    unlink(temporary_path);
+    return message;
+}
+
+/* Writes the rest of a temporary file and renames it over path. The data
+   reaches the disk before the rename, so after a crash path holds either
+   the old file or all of the new one. Returns NULL, or the error after
+   removing the temporary file. */
+static const char* file_write_finish(int fd,
+                                     struct iovec* iov,
+                                     int iov_length,
+                                     const char* temporary_path,
+                                     const char* path) {
+    if (!file_try_write_iov(fd, iov, iov_length)) {
+        return file_write_failed(fd, temporary_path, "write failed");
+    }
+    if (fsync(fd) == -1) {
+        return file_write_failed(fd, temporary_path, "file fsync failed");
+    }
+    if (close(fd) == -1) {
+        return file_write_failed(-1, temporary_path, "file close failed");
+    }
+    if (rename(temporary_path, path) == -1) {
+        return file_write_failed(-1, temporary_path, "file rename failed");
+    }
+    return NULL;
+}
+
+void file_rename(const char* old_path, const char* new_path) {
+    if (rename(old_path, new_path) == -1) {
+        fatal_error("file rename failed");
+    }
+}
+
 void file_close(int fd) {
     if (close(fd) == -1) {
         fatal_error("file close failed");
     }
 }
+
+#ifdef MALLARD_IO_URING
+
+/* A batch takes at most four entries per file. Every operation used here
+   is in Linux 5.11, along with IORING_FEAT_EXT_ARG. */
+#define FILE_RING_ENTRIES 256
+#define FILE_RING_BATCH 64
+
+struct file_ring {
+    int fd;
+    void* rings;
+    uint64_t rings_size;
+    struct io_uring_sqe* sqes;
+    uint64_t sqes_size;
+
+    uint32_t* sq_head;
+    uint32_t* sq_tail;
+    uint32_t* sq_mask;
+    uint32_t* sq_array;
+    uint32_t sq_local_tail;
+    uint32_t sq_submitted;
+
+    uint32_t* cq_head;
+    uint32_t* cq_tail;
+    uint32_t* cq_mask;
+    struct io_uring_cqe* cqes;
+};
+
+static bool file_ring_init(struct file_ring* ring) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    /* Denied by seccomp, a sysctl or an old kernel, the caller falls back */
+    int fd = syscall(__NR_io_uring_setup, FILE_RING_ENTRIES, &params);
+    if (fd < 0) {
+        return false;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)
+        || !(params.features & IORING_FEAT_EXT_ARG)) {
+        close(fd);
+        return false;
+    }
+
+    uint64_t sq_size = params.sq_off.array
+                       + params.sq_entries * sizeof(uint32_t);
+    uint64_t cq_size = params.cq_off.cqes
+                       + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->rings_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->rings = mmap(NULL, ring->rings_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->rings == MAP_FAILED) {
+        fatal_error("io_uring mmap failed");
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        fatal_error("io_uring mmap failed");
+    }
+
+    uint8_t* rings = ring->rings;
+    ring->fd = fd;
+    ring->sq_head = (uint32_t*) (rings + params.sq_off.head);
+    ring->sq_tail = (uint32_t*) (rings + params.sq_off.tail);
+    ring->sq_mask = (uint32_t*) (rings + params.sq_off.ring_mask);
+    ring->sq_array = (uint32_t*) (rings + params.sq_off.array);
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->sq_submitted = ring->sq_local_tail;
+    ring->cq_head = (uint32_t*) (rings + params.cq_off.head);
+    ring->cq_tail = (uint32_t*) (rings + params.cq_off.tail);
+    ring->cq_mask = (uint32_t*) (rings + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) (rings + params.cq_off.cqes);
+    return true;
+}
+
+static void file_ring_destroy(struct file_ring* ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->rings, ring->rings_size);
+    close(ring->fd);
+}
+
+/* The caller never queues more than FILE_RING_ENTRIES before waiting */
+static struct io_uring_sqe* file_ring_sqe(struct file_ring* ring,
+                                          uint8_t opcode,
+                                          uint64_t user_data) {
+    uint32_t index = ring->sq_local_tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    ++(ring->sq_local_tail);
+    return sqe;
+}
+
+static void file_ring_enter(struct file_ring* ring, uint32_t wait) {
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+    while (true) {
+        uint32_t submit = ring->sq_local_tail - ring->sq_submitted;
+        int submitted = syscall(__NR_io_uring_enter, ring->fd, submit, wait,
+                                IORING_ENTER_GETEVENTS, NULL, 0);
+        if (submitted < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fatal_error("io_uring enter failed");
+        }
+        ring->sq_submitted += submitted;
+        if (ring->sq_submitted == ring->sq_local_tail) {
+            return;
+        }
+    }
+}
+
+/* Returns the result of the next completion */
+static int32_t file_ring_cqe(struct file_ring* ring, uint64_t* user_data) {
+    uint32_t head = *ring->cq_head;
+    while (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        file_ring_enter(ring, 1);
+    }
+    struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+    int32_t res = cqe->res;
+    *user_data = cqe->user_data;
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return res;
+}
+
+static uint64_t page_align(uint64_t size) {
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+
+/* Stats and opens a batch together, then reads it into one anonymous
+   mapping where every file starts on its own page. A file's pages are
+   unmapped on their own by file_close_mmap. */
+static void file_ring_read(struct file_ring* ring,
+                           const char** paths,
+                           struct str* strs,
+                           uint64_t length) {
+    struct statx statxs[FILE_RING_BATCH];
+    int fds[FILE_RING_BATCH];
+    for (uint64_t i = 0; i < length; ++i) {
+        struct io_uring_sqe* sqe = file_ring_sqe(ring, IORING_OP_STATX,
+                                                 i * 2);
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t) (uintptr_t) paths[i];
+        sqe->len = STATX_SIZE;
+        sqe->off = (uint64_t) (uintptr_t) &statxs[i];
+        sqe = file_ring_sqe(ring, IORING_OP_OPENAT, i * 2 + 1);
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t) (uintptr_t) paths[i];
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    }
+    file_ring_enter(ring, 0);
+    for (uint64_t i = 0; i < length * 2; ++i) {
+        uint64_t user_data;
+        int32_t res = file_ring_cqe(ring, &user_data);
+        if (res < 0) {
+            fatal_error("file open filed");
+        }
+        if (user_data & 1) {
+            fds[user_data / 2] = res;
+        }
+    }
+
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < length; ++i) {
+        /* Matches mmap, which cannot map an empty file */
+        if (statxs[i].stx_size == 0) {
+            fatal_error("file mmap failed");
+        }
+        total += page_align(statxs[i].stx_size);
+    }
+    uint8_t* data = mmap(NULL, total, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        fatal_error("file mmap failed");
+    }
+    for (uint64_t i = 0; i < length; ++i) {
+        strs[i].data = data;
+        strs[i].size = statxs[i].stx_size;
+        data += page_align(statxs[i].stx_size);
+    }
+
+    /* Each read is followed by the close of its file */
+    uint64_t done[FILE_RING_BATCH] = { 0 };
+    for (uint64_t i = 0; i < length; ++i) {
+        struct io_uring_sqe* sqe = file_ring_sqe(ring, IORING_OP_READ, i * 2);
+        sqe->fd = fds[i];
+        sqe->addr = (uint64_t) (uintptr_t) strs[i].data;
+        sqe->len = strs[i].size;
+        sqe->off = 0;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe = file_ring_sqe(ring, IORING_OP_CLOSE, i * 2 + 1);
+        sqe->fd = fds[i];
+    }
+    file_ring_enter(ring, 0);
+    for (uint64_t i = 0; i < length * 2; ++i) {
+        uint64_t user_data;
+        int32_t res = file_ring_cqe(ring, &user_data);
+        uint64_t index = user_data / 2;
+        if ((user_data & 1) == 0) {
+            if (res < 0) {
+                fatal_error("file read failed");
+            }
+            done[index] = res;
+        }
+        else if (res == -ECANCELED) {
+            /* A short read breaks the link, finish the file here */
+            while (done[index] < strs[index].size) {
+                ssize_t bytes_read = pread(fds[index],
+                                           strs[index].data + done[index],
+                                           strs[index].size - done[index],
+                                           done[index]);
+                if (bytes_read <= 0) {
+                    if (bytes_read == -1 && errno == EINTR) {
+                        continue;
+                    }
+                    fatal_error("file read failed");
+                }
+                done[index] += bytes_read;
+            }
+            file_close(fds[index]);
+        }
+        else if (res < 0) {
+            fatal_error("file close failed");
+        }
+    }
+}
+
+/* Opens a batch of temporary files together, then writes, syncs, closes
+   and renames each over its target as a linked chain. Every chain runs to
+   the end, so a failed file's temporary is removed before returning its
+   error, NULL when every file was written. */
+static const char* file_ring_write(struct file_ring* ring,
+                                   struct file_write* writes,
+                                   const char** temporary_paths,
+                                   uint64_t length) {
+    int fds[FILE_RING_BATCH];
+    for (uint64_t i = 0; i < length; ++i) {
+        struct io_uring_sqe* sqe = file_ring_sqe(ring, IORING_OP_OPENAT, i);
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t) (uintptr_t) temporary_paths[i];
+        sqe->open_flags = O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC;
+        sqe->len = 0755;
+    }
+    file_ring_enter(ring, 0);
+    const char* error = NULL;
+    for (uint64_t i = 0; i < length; ++i) {
+        uint64_t user_data;
+        int32_t res = file_ring_cqe(ring, &user_data);
+        if (res < 0) {
+            error = "file open filed";
+        }
+        fds[user_data] = res;
+    }
+    if (error != NULL) {
+        /* Nothing is written unless every file opened */
+        for (uint64_t i = 0; i < length; ++i) {
+            if (fds[i] >= 0) {
+                file_write_failed(fds[i], temporary_paths[i], error);
+            }
+        }
+        return error;
+    }
+
+    /* Bytes the writev wrote, -1 once the file failed */
+    int64_t written[FILE_RING_BATCH];
+    for (uint64_t i = 0; i < length; ++i) {
+        struct io_uring_sqe* sqe = file_ring_sqe(ring, IORING_OP_WRITEV,
+                                                 i * 4);
+        sqe->fd = fds[i];
+        sqe->addr = (uint64_t) (uintptr_t) writes[i].iov;
+        sqe->len = writes[i].iov_length;
+        sqe->off = 0;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe = file_ring_sqe(ring, IORING_OP_FSYNC, i * 4 + 1);
+        sqe->fd = fds[i];
+        sqe->flags = IOSQE_IO_LINK;
+        sqe = file_ring_sqe(ring, IORING_OP_CLOSE, i * 4 + 2);
+        sqe->fd = fds[i];
+        sqe->flags = IOSQE_IO_LINK;
+        sqe = file_ring_sqe(ring, IORING_OP_RENAMEAT, i * 4 + 3);
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t) (uintptr_t) temporary_paths[i];
+        sqe->len = AT_FDCWD;
+        sqe->addr2 = (uint64_t) (uintptr_t) writes[i].path;
+    }
+    file_ring_enter(ring, 0);
+    for (uint64_t i = 0; i < length * 4; ++i) {
+        uint64_t user_data;
+        int32_t res = file_ring_cqe(ring, &user_data);
+        uint64_t index = user_data / 4;
+        const char* failed = NULL;
+        switch (user_data % 4) {
+        case 0:
+            written[index] = res;
+            if (res < 0) {
+                failed = file_write_failed(fds[index],
+                                           temporary_paths[index],
+                                           "write failed");
+            }
+            break;
+        case 1:
+            if (res == -ECANCELED && written[index] >= 0) {
+                /* A short write breaks the chain, finish the file here */
+                struct iovec* iov = writes[index].iov;
+                int iov_length = writes[index].iov_length;
+                int64_t skip = written[index];
+                while (iov_length > 0 && (size_t) skip >= iov->iov_len) {
+                    skip -= iov->iov_len;
+                    ++iov;
+                    --iov_length;
+                }
+                if (iov_length > 0) {
+                    iov->iov_base = (uint8_t*) iov->iov_base + skip;
+                    iov->iov_len -= skip;
+                }
+                if (lseek(fds[index], written[index], SEEK_SET) == -1) {
+                    failed = file_write_failed(fds[index],
+                                               temporary_paths[index],
+                                               "file seek failed");
+                    break;
+                }
+                failed = file_write_finish(fds[index], iov, iov_length,
+                                           temporary_paths[index],
+                                           writes[index].path);
+            }
+            else if (res < 0 && res != -ECANCELED) {
+                written[index] = -1;
+                failed = file_write_failed(fds[index],
+                                           temporary_paths[index],
+                                           "file fsync failed");
+            }
+            break;
+        case 2:
+            if (res < 0 && res != -ECANCELED) {
+                failed = file_write_failed(-1, temporary_paths[index],
+                                           "file close failed");
+            }
+            break;
+        default:
+            if (res < 0 && res != -ECANCELED) {
+                failed = file_write_failed(-1, temporary_paths[index],
+                                           "file rename failed");
+            }
+            break;
+        }
+        if (error == NULL) {
+            error = failed;
+        }
+    }
+    return error;
+}
+
+#endif /* ifdef MALLARD_IO_URING */
+
+void file_open_read_batch(const char** paths,
+                          struct str* strs,
+                          uint64_t length) {
+#ifdef MALLARD_IO_URING
+    struct file_ring ring;
+    if (length > 1 && file_ring_init(&ring)) {
+        for (uint64_t i = 0; i < length; i += FILE_RING_BATCH) {
+            uint64_t batch = length - i;
+            if (batch > FILE_RING_BATCH) {
+                batch = FILE_RING_BATCH;
+            }
+            file_ring_read(&ring, paths + i, strs + i, batch);
+        }
+        file_ring_destroy(&ring);
+        return;
+    }
+#endif
+    for (uint64_t i = 0; i < length; ++i) {
+        strs[i] = file_open_read_mmap(paths[i]);
+    }
+}
+
+/* Next to the target so the rename stays on one file system */
+static const char* file_temporary_path(const char* path) {
+    uint64_t size = strlen(path) + 32;
+    char* temporary_path = xmalloc(size);
+    snprintf(temporary_path, size, "%s.%ld.tmp", path, (long) getpid());
+    return temporary_path;
+}
+
+void file_write_batch(struct file_write* writes, uint64_t length) {
+    const char** temporary_paths = xcalloc(length + 1, sizeof(const char*));
+    for (uint64_t i = 0; i < length; ++i) {
+        temporary_paths[i] = file_temporary_path(writes[i].path);
+    }
+
+    bool written = false;
+    const char* error = NULL;
+#ifdef MALLARD_IO_URING
+    struct file_ring ring;
+    if (length > 1 && file_ring_init(&ring)) {
+        for (uint64_t i = 0; i < length && error == NULL;
+             i += FILE_RING_BATCH) {
+            uint64_t batch = length - i;
+            if (batch > FILE_RING_BATCH) {
+                batch = FILE_RING_BATCH;
+            }
+            error = file_ring_write(&ring, writes + i, temporary_paths + i,
+                                    batch);
+        }
+        file_ring_destroy(&ring);
+        written = true;
+    }
+#endif
+    for (uint64_t i = 0; i < length && !written && error == NULL; ++i) {
+        int fd = open(temporary_paths[i],
+                      O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0755);
+        if (fd == -1) {
+            error = "file open filed";
+            break;
+        }
+        error = file_write_finish(fd, writes[i].iov, writes[i].iov_length,
+                                  temporary_paths[i], writes[i].path);
+    }
+
+    for (uint64_t i = 0; i < length; ++i) {
+        free((void*) temporary_paths[i]);
+    }
+    free(temporary_paths);
+    if (error != NULL) {
+        fatal_error(error);
+    }
+}
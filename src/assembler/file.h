@@ -3,10 +3,54 @@
 
 #include "str.h"
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
 struct str file_open_read_mmap(const char* path);
+/* Like file_open_read_mmap, but returns false when the file does not
+   exist */
+bool file_try_open_read_mmap(const char* path, struct str* str);
 void file_close_mmap(struct str* str);
 
 int file_open_write(const char* path);
+void file_write_iov(int fd, struct iovec* iov, int iov_length);
+/* Input that arrives over time, such as a pipe. The data is reserved up
+   front and never moves, so pointers into it stay valid as it grows. */
+struct file_stream {
+    int fd;
+    uint8_t* data;
+    uint64_t size;
+    uint64_t capacity;
+};
+
+#define FILE_STREAM_CAPACITY ((uint64_t) 4 * 1024 * 1024 * 1024)
+
+void file_stream_open(struct file_stream* stream, int fd);
+/* Appends whatever input is available, waiting for some. Returns false at
+   the end of the input. */
+bool file_stream_read(struct file_stream* stream);
+void file_stream_close(struct file_stream* stream);
+
+void file_rename(const char* old_path, const char* new_path);
 void file_close(int fd);
 
+/* Maps every path, close each with file_close_mmap. With io_uring the
+   files are opened and read as one batch. */
+void file_open_read_batch(const char** paths,
+                          struct str* strs,
+                          uint64_t length);
+
+struct file_write {
+    const char* path;
+    struct iovec* iov;
+    int iov_length;
+};
+
+/* Writes every file to a temporary next to it, syncs it, then renames it
+   over the target so readers, even after a crash, never see a partial
+   file. With io_uring the writes, syncs, closes and renames go out as one
+   batch of linked chains. A file that fails has its temporary removed. */
+void file_write_batch(struct file_write* writes, uint64_t length);
+
 #endif /* ifndef MALLARD_FILE_H */
@@ -0,0 +1,108 @@
+#include "ihex.h"
+
+#include "alloc.h"
+#include "fatal_error.h"
+
+#include <stdlib.h>
+
+#define IHEX_DATA 0x00
+#define IHEX_END_OF_FILE 0x01
+#define IHEX_EXTENDED_LINEAR_ADDRESS 0x04
+#define IHEX_START_LINEAR_ADDRESS 0x05
+
+/* Bytes in a full data record */
+#define IHEX_RECORD_DATA 16
+
+/* ':', length, address, type, checksum and '\n' around the data */
+#define IHEX_RECORD_OVERHEAD 12
+
+static const char ihex_digits[] = "0123456789ABCDEF";
+
+static uint8_t* ihex_byte(uint8_t* out, uint8_t byte, uint8_t* checksum) {
+    out[0] = ihex_digits[byte >> 4];
+    out[1] = ihex_digits[byte & 0xF];
+    *checksum += byte;
+    return out + 2;
+}
+
+static uint8_t* ihex_record(uint8_t* out,
+                            uint8_t type,
+                            uint16_t address,
+                            const uint8_t* data,
+                            uint8_t length) {
+    uint8_t checksum = 0;
+    *out++ = ':';
+    out = ihex_byte(out, length, &checksum);
+    out = ihex_byte(out, address >> 8, &checksum);
+    out = ihex_byte(out, address & 0xFF, &checksum);
+    out = ihex_byte(out, type, &checksum);
+    for (uint8_t i = 0; i < length; ++i) {
+        out = ihex_byte(out, data[i], &checksum);
+    }
+    uint8_t unused = 0;
+    out = ihex_byte(out, -checksum, &unused);
+    *out++ = '\n';
+    return out;
+}
+
+struct vector ihex_encode(uint32_t address,
+                          uint8_t* data,
+                          uint64_t size,
+                          uint32_t entry) {
+    if (address + size > (uint64_t) UINT32_MAX + 1) {
+        fatal_error("ihex image does not fit in 32-bit addresses");
+    }
+
+    /* Records never cross a 64 KiB segment, every segment the image touches
+       starts with its upper address. Count them to allocate once. */
+    uint64_t records = 0;
+    uint64_t segments = 0;
+    uint64_t current = address;
+    uint64_t end = address + size;
+    while (current < end) {
+        uint64_t segment_end = (current | 0xFFFF) + 1;
+        if (segment_end > end) {
+            segment_end = end;
+        }
+        ++segments;
+        records += (segment_end - current + IHEX_RECORD_DATA - 1)
+                   / IHEX_RECORD_DATA;
+        current = segment_end;
+    }
+    uint64_t capacity = size * 2
+                        + (records + segments + 2) * IHEX_RECORD_OVERHEAD
+                        + segments * 4 + 8;
+
+    struct vector output = {
+        .capacity = capacity,
+        .data = xmalloc(capacity),
+        .size = 0,
+    };
+
+    uint8_t* out = output.data;
+    current = address;
+    while (current < end) {
+        uint8_t upper[2] = {current >> 24, (current >> 16) & 0xFF};
+        out = ihex_record(out, IHEX_EXTENDED_LINEAR_ADDRESS, 0, upper, 2);
+        uint64_t segment_end = (current | 0xFFFF) + 1;
+        if (segment_end > end) {
+            segment_end = end;
+        }
+        while (current < segment_end) {
+            uint64_t length = segment_end - current;
+            if (length > IHEX_RECORD_DATA) {
+                length = IHEX_RECORD_DATA;
+            }
+            out = ihex_record(out, IHEX_DATA, current & 0xFFFF,
+                              data + (current - address), length);
+            current += length;
+        }
+    }
+    uint8_t start[4] = {entry >> 24, (entry >> 16) & 0xFF,
+                        (entry >> 8) & 0xFF, entry & 0xFF};
+    out = ihex_record(out, IHEX_START_LINEAR_ADDRESS, 0, start, 4);
+    out = ihex_record(out, IHEX_END_OF_FILE, 0, NULL, 0);
+
+    output.size = out - output.data;
+    return output;
+}
@@ -0,0 +1,16 @@
+#ifndef MALLARD_IHEX_H
+#define MALLARD_IHEX_H
+
+#include "vector.h"
+
+#include <stdint.h>
+
+/* Encodes size bytes of data loaded at address as Intel HEX records, ending
+   with the entry address. The returned vector is sized exactly and owns its
+   data. */
+struct vector ihex_encode(uint32_t address,
+                          uint8_t* data,
+                          uint64_t size,
+                          uint32_t entry);
+
+#endif /* ifndef MALLARD_IHEX_H */
@@ -0,0 +1,21 @@
+#include "ir.h"
+
+#include <string.h>
+
+uint64_t ir_instruction_encode(const struct ir_instruction* ir,
+                               uint8_t* data) {
+    if (ir->flags & IR_FLAG_LABEL) {
+        return 0;
+    }
+    else if (ir->flags & IR_FLAG_COMPRESSED) {
+        uint16_t val = isa_encode_compressed(ir->instruction,
+                                             ir->rd, ir->rs1, ir->rs2,
+                                             ir->imm);
+        memcpy(data, &val, sizeof(val));
+        return sizeof(val);
+    }
+    uint32_t val = isa_encode(ir->instruction,
+                              ir->rd, ir->rs1, ir->rs2, ir->imm);
+    memcpy(data, &val, sizeof(val));
+    return sizeof(val);
+}
@@ -0,0 +1,43 @@
+#ifndef MALLARD_IR_H
+#define MALLARD_IR_H
+
+#include "isa.h"
+
+#include <stdint.h>
+
+enum ir_flag {
+    /* Encoded in 2 bytes instead of 4 */
+    IR_FLAG_COMPRESSED = 0x1,
+    /* The immediate is an offset to the function named by symbol, it is
+       resolved once every function has an address */
+    IR_FLAG_CALL = 0x2,
+    /* Marks an offset within the function, it takes no space */
+    IR_FLAG_LABEL = 0x4,
+};
+
+/* A lowered instruction. Analysis emits a function's instructions as one
+   contiguous array of these so encoding never looks at the AST. The
+   instruction selects the opcode and funct fields from isa_descriptions. */
+struct ir_instruction {
+    uint8_t instruction;
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+    int32_t imm;
+    uint32_t symbol;
+    /* Index of the AST node this was lowered from */
+    uint32_t source;
+    uint16_t flags;
+};
+
+static inline uint64_t ir_instruction_size(const struct ir_instruction* ir) {
+    if (ir->flags & IR_FLAG_LABEL) {
+        return 0;
+    }
+    return (ir->flags & IR_FLAG_COMPRESSED) ? 2 : 4;
+}
+
+/* Writes the machine code to data and returns its size */
+uint64_t ir_instruction_encode(const struct ir_instruction* ir, uint8_t* data);
+
+#endif /* ifndef MALLARD_IR_H */
@@ -0,0 +1,109 @@
+#include "isa.h"
+
+#include "fatal_error.h"
+
+#define ISA_DESCRIPTION(name, mnemonic, format, opcode, funct3, funct7) \
+    [ISA_##name] = { \
+        #mnemonic, ISA_FORMAT_##format, opcode, funct3, funct7, \
+    },
+
+const struct isa_description isa_descriptions[ISA_INSTRUCTIONS_LENGTH] = {
+    ISA_INSTRUCTIONS(ISA_DESCRIPTION)
+};
+
+#undef ISA_DESCRIPTION
+
+/* One encoder per instruction, with every field but the operands known at
+   compile time */
+#define ISA_ENCODER(name, mnemonic, format, opcode, funct3, funct7) \
+    static uint32_t encode_##name(uint8_t rd, \
+                                  uint8_t rs1, \
+                                  uint8_t rs2, \
+                                  int32_t imm) { \
+        return isa_encode_format(ISA_FORMAT_##format, opcode, funct3, funct7, \
+                                 rd, rs1, rs2, imm); \
+    }
+
+ISA_INSTRUCTIONS(ISA_ENCODER)
+
+#undef ISA_ENCODER
+
+#define ISA_ENCODER_ENTRY(name, ...) [ISA_##name] = encode_##name,
+
+static uint32_t (*const encoders[ISA_INSTRUCTIONS_LENGTH])(uint8_t rd,
+                                                           uint8_t rs1,
+                                                           uint8_t rs2,
+                                                           int32_t imm) = {
+    ISA_INSTRUCTIONS(ISA_ENCODER_ENTRY)
+};
+
+#undef ISA_ENCODER_ENTRY
+
+uint32_t isa_encode(enum isa_instruction instruction,
+                    uint8_t rd,
+                    uint8_t rs1,
+                    uint8_t rs2,
+                    int32_t imm) {
+    if (instruction >= ISA_INSTRUCTIONS_LENGTH) {
+        fatal_error("unknown isa instruction");
+    }
+    return encoders[instruction](rd, rs1, rs2, imm);
+}
+
+static bool is_compressed_register(uint8_t reg) {
+    return reg >= 8 && reg <= 15;
+}
+
+bool isa_is_compressible(enum isa_instruction instruction,
+                         uint8_t rd,
+                         uint8_t rs1,
+                         uint8_t rs2,
+                         int32_t imm) {
+    switch (instruction) {
+    case ISA_SW:
+        /* c.sw */
+        if (!is_compressed_register(rs1) || !is_compressed_register(rs2)) {
+            return false;
+        }
+        return (imm & 0x3) == 0 && imm >= 0 && imm < 0x80;
+    case ISA_LUI:
+        /* c.lui */
+        if (rd == 0 || rd == 2) {
+            return false;
+        }
+        if (!is_compressed_register(rd)) {
+            return false;
+        }
+        return imm >= 0 && imm < 0x40;
+    default:
+        return false;
+    }
+}
+
+uint16_t isa_encode_compressed(enum isa_instruction instruction,
+                               uint8_t rd,
+                               uint8_t rs1,
+                               uint8_t rs2,
+                               int32_t imm) {
+    uint16_t val = 0;
+    switch (instruction) {
+    case ISA_SW:
+        val |= 0x0;
+        val |= (rs2 - 8) << 2;
+        val |= ((imm >> 2) & 0x1) << 6;
+        val |= ((imm >> 5) & 0x1) << 5;
+        val |= (rs1 - 8) << 7;
+        val |= ((imm >> 3) & 0x7) << 10;
+        val |= 0x6 << 13;
+        return val;
+    case ISA_LUI:
+        val |= 0x1;
+        val |= (imm & 0x1F) << 2;
+        val |= rd << 7;
+        val |= ((imm >> 5) & 0x1) << 12;
+        val |= 0x3 << 13;
+        return val;
+    default:
+        fatal_error("instruction has no compressed encoding");
+    }
+}
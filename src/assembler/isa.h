@@ -0,0 +1,199 @@
+#ifndef MALLARD_ISA_H
+#define MALLARD_ISA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Every instruction the assembler knows about, adding a row here adds the
+   mnemonic to the parser, analyzer, encoder and decoder.
+
+   The columns are: name, mnemonic, format, opcode, funct3, funct7. For the
+   shift immediate formats funct7 is the top bits of the immediate. The
+   mnemonic is not a string so it can also name the generated functions. */
+#define ISA_INSTRUCTIONS(X) \
+    /* rv32i */ \
+    X(LUI,   lui,   U,        0x37, 0x0, 0x00) \
+    X(AUIPC, auipc, U,        0x17, 0x0, 0x00) \
+    X(JAL,   jal,   J,        0x6F, 0x0, 0x00) \
+    X(JALR,  jalr,  I_OFFSET, 0x67, 0x0, 0x00) \
+    X(BEQ,   beq,   B,        0x63, 0x0, 0x00) \
+    X(BNE,   bne,   B,        0x63, 0x1, 0x00) \
+    X(BLT,   blt,   B,        0x63, 0x4, 0x00) \
+    X(BGE,   bge,   B,        0x63, 0x5, 0x00) \
+    X(BLTU,  bltu,  B,        0x63, 0x6, 0x00) \
+    X(BGEU,  bgeu,  B,        0x63, 0x7, 0x00) \
+    X(LB,    lb,    I_OFFSET, 0x03, 0x0, 0x00) \
+    X(LH,    lh,    I_OFFSET, 0x03, 0x1, 0x00) \
+    X(LW,    lw,    I_OFFSET, 0x03, 0x2, 0x00) \
+    X(LBU,   lbu,   I_OFFSET, 0x03, 0x4, 0x00) \
+    X(LHU,   lhu,   I_OFFSET, 0x03, 0x5, 0x00) \
+    X(SB,    sb,    S,        0x23, 0x0, 0x00) \
+    X(SH,    sh,    S,        0x23, 0x1, 0x00) \
+    X(SW,    sw,    S,        0x23, 0x2, 0x00) \
+    X(ADDI,  addi,  I,        0x13, 0x0, 0x00) \
+    X(SLTI,  slti,  I,        0x13, 0x2, 0x00) \
+    X(SLTIU, sltiu, I,        0x13, 0x3, 0x00) \
+    X(XORI,  xori,  I,        0x13, 0x4, 0x00) \
+    X(ORI,   ori,   I,        0x13, 0x6, 0x00) \
+    X(ANDI,  andi,  I,        0x13, 0x7, 0x00) \
+    X(ADD,   add,   R,        0x33, 0x0, 0x00) \
+    X(SUB,   sub,   R,        0x33, 0x0, 0x20) \
+    X(SLL,   sll,   R,        0x33, 0x1, 0x00) \
+    X(SLT,   slt,   R,        0x33, 0x2, 0x00) \
+    X(SLTU,  sltu,  R,        0x33, 0x3, 0x00) \
+    X(XOR,   xor,   R,        0x33, 0x4, 0x00) \
+    X(SRL,   srl,   R,        0x33, 0x5, 0x00) \
+    X(SRA,   sra,   R,        0x33, 0x5, 0x20) \
+    X(OR,    or,    R,        0x33, 0x6, 0x00) \
+    X(AND,   and,   R,        0x33, 0x7, 0x00) \
+    /* rv64i */ \
+    X(LWU,   lwu,   I_OFFSET, 0x03, 0x6, 0x00) \
+    X(LD,    ld,    I_OFFSET, 0x03, 0x3, 0x00) \
+    X(SD,    sd,    S,        0x23, 0x3, 0x00) \
+    X(ADDIW, addiw, I,        0x1B, 0x0, 0x00) \
+    X(SLLI,  slli,  I_SHAMT6, 0x13, 0x1, 0x00) \
+    X(SRLI,  srli,  I_SHAMT6, 0x13, 0x5, 0x00) \
+    X(SRAI,  srai,  I_SHAMT6, 0x13, 0x5, 0x20) \
+    X(SLLIW, slliw, I_SHAMT5, 0x1B, 0x1, 0x00) \
+    X(SRLIW, srliw, I_SHAMT5, 0x1B, 0x5, 0x00) \
+    X(SRAIW, sraiw, I_SHAMT5, 0x1B, 0x5, 0x20)
+
+/* The formats are named after their assembly operands */
+enum isa_format {
+    ISA_FORMAT_R,        /* rd, rs1, rs2 */
+    ISA_FORMAT_I,        /* rd, rs1, imm */
+    ISA_FORMAT_I_OFFSET, /* rd, imm(rs1) */
+    ISA_FORMAT_I_SHAMT6, /* rd, rs1, shamt */
+    ISA_FORMAT_I_SHAMT5, /* rd, rs1, shamt */
+    ISA_FORMAT_S,        /* rs2, imm(rs1) */
+    ISA_FORMAT_B,        /* rs1, rs2, offset */
+    ISA_FORMAT_U,        /* rd, imm */
+    ISA_FORMAT_J,        /* rd, offset or function */
+};
+
+#define ISA_ENUM(name, ...) ISA_##name,
+
+enum isa_instruction {
+    ISA_INSTRUCTIONS(ISA_ENUM)
+    ISA_INSTRUCTIONS_LENGTH,
+};
+
+#undef ISA_ENUM
+
+struct isa_description {
+    const char* mnemonic;
+    enum isa_format format;
+    uint8_t opcode;
+    uint8_t funct3;
+    uint8_t funct7;
+};
+
+extern const struct isa_description isa_descriptions[ISA_INSTRUCTIONS_LENGTH];
+
+uint32_t isa_encode(enum isa_instruction instruction,
+                    uint8_t rd,
+                    uint8_t rs1,
+                    uint8_t rs2,
+                    int32_t imm);
+bool isa_is_compressible(enum isa_instruction instruction,
+                         uint8_t rd,
+                         uint8_t rs1,
+                         uint8_t rs2,
+                         int32_t imm);
+uint16_t isa_encode_compressed(enum isa_instruction instruction,
+                               uint8_t rd,
+                               uint8_t rs1,
+                               uint8_t rs2,
+                               int32_t imm);
+
+/* Field extraction and encoding, shared by the generated routines */
+
+static inline bool isa_matches(uint32_t data,
+                               enum isa_format format,
+                               uint8_t opcode,
+                               uint8_t funct3,
+                               uint8_t funct7) {
+    if ((data & 0x7F) != opcode) {
+        return false;
+    }
+    if (format == ISA_FORMAT_U || format == ISA_FORMAT_J) {
+        return true;
+    }
+    if (((data >> 12) & 0x7) != funct3) {
+        return false;
+    }
+    switch (format) {
+    case ISA_FORMAT_R:
+    case ISA_FORMAT_I_SHAMT5:
+        return (data >> 25) == funct7;
+    case ISA_FORMAT_I_SHAMT6:
+        return (data >> 26) == (uint32_t) (funct7 >> 1);
+    default:
+        return true;
+    }
+}
+
+static inline uint32_t isa_encode_format(enum isa_format format,
+                                         uint8_t opcode,
+                                         uint8_t funct3,
+                                         uint8_t funct7,
+                                         uint8_t rd,
+                                         uint8_t rs1,
+                                         uint8_t rs2,
+                                         int32_t imm) {
+    uint32_t val = opcode;
+    switch (format) {
+    case ISA_FORMAT_R:
+        val |= rd << 7;
+        val |= funct3 << 12;
+        val |= rs1 << 15;
+        val |= rs2 << 20;
+        val |= (uint32_t) funct7 << 25;
+        break;
+    case ISA_FORMAT_I:
+    case ISA_FORMAT_I_OFFSET:
+        val |= rd << 7;
+        val |= funct3 << 12;
+        val |= rs1 << 15;
+        val |= (uint32_t) (imm & 0xFFF) << 20;
+        break;
+    case ISA_FORMAT_I_SHAMT6:
+    case ISA_FORMAT_I_SHAMT5:
+        val |= rd << 7;
+        val |= funct3 << 12;
+        val |= rs1 << 15;
+        val |= (imm & 0x3F) << 20;
+        val |= (uint32_t) funct7 << 25;
+        break;
+    case ISA_FORMAT_S:
+        val |= (imm & 0x1F) << 7;
+        val |= funct3 << 12;
+        val |= rs1 << 15;
+        val |= rs2 << 20;
+        val |= (uint32_t) (imm & 0xFE0) << 20;
+        break;
+    case ISA_FORMAT_B:
+        val |= ((imm >> 11) & 0x1) << 7;  /* imm[11]   */
+        val |= ((imm >> 1) & 0xF) << 8;   /* imm[4,1]  */
+        val |= funct3 << 12;
+        val |= rs1 << 15;
+        val |= rs2 << 20;
+        val |= ((imm >> 5) & 0x3F) << 25; /* imm[10,5] */
+        val |= (uint32_t) ((imm >> 12) & 0x1) << 31; /* imm[12] */
+        break;
+    case ISA_FORMAT_U:
+        val |= rd << 7;
+        val |= (uint32_t) imm << 12;
+        break;
+    case ISA_FORMAT_J:
+        val |= rd << 7;
+        val |= (uint32_t) (imm & 0x100000) << 11; /* imm[20]    */
+        val |= (imm & 0xFF000);                   /* imm[19,12] */
+        val |= (imm & 0x7FE) << 20;               /* imm[10,1]  */
+        val |= (imm & 0x800) << 9;                /* imm[11]    */
+        break;
+    }
+    return val;
+}
+
+#endif /* ifndef MALLARD_ISA_H */
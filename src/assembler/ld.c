@@ -0,0 +1,65 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ansi.h"
+#include "fatal_error.h"
+#include "file.h"
+#include "linker.h"
+#include "version.h"
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fatal_error("required argument");
+    }
+
+    const char* input = NULL;
+    const char* version = NULL;
+    uint64_t jobs = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--version") == 0) {
+            version = argv[i];
+            continue;
+        }
+        if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-j") == 0) {
+            if (i + 1 == argc) {
+                fatal_error("'--jobs' requires a number of threads");
+            }
+            char* end = NULL;
+            long long value = strtoll(argv[++i], &end, 10);
+            if (*end != '\0' || value < 1 || value > 4096) {
+                fatal_error("'--jobs' must be between 1 and 4096");
+            }
+            jobs = value;
+            continue;
+        }
+
+        if (!input) {
+            input = argv[i];
+        }
+        else {
+            fatal_error("only one input file supported");
+        }
+    }
+
+    if (version != NULL) {
+        if (input != NULL) {
+            fatal_error("'--version' should be the only argument");
+            return 1;
+        }
+        printf(ANSI_BOLD_GREEN "Mallard" ANSI_RESET " linker "
+                ANSI_BOLD MALLARD_VERSION ANSI_RESET "\n");
+        return 0;
+    }
+    else if (input == NULL) {
+        fatal_error("required input file");
+    }
+
+    /* The unit names objects in files: instead of sources */
+    struct str str = file_open_read_mmap(input);
+    linker_link(&str, jobs);
+    file_close_mmap(&str);
+
+    return 0;
+}
@@ -1,207 +1,512 @@
 #include "lexer.h"
 
+#include "alloc.h"
 #include "fatal_error.h"
 #include "token.h"
 
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
-static bool is_whitespace(uint8_t byte) {
-    switch (byte) {
-    case '\t':
-    case '\n':
-    case ' ':
-        return true;
-    default:
-        return false;
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define BYTE_WHITESPACE  0x01
+#define BYTE_ALPHA       0x02
+#define BYTE_DIGIT       0x04
+#define BYTE_HEX         0x08
+#define BYTE_IDENTIFIER  0x10
+#define BYTE_QUOTE       0x20
+#define BYTE_PUNCTUATION 0x40
+/* Every byte that may appear inside a string literal */
+#define BYTE_STRING      0x80
+
+#define X (BYTE_STRING)
+#define W (BYTE_WHITESPACE | BYTE_STRING)
+#define A (BYTE_ALPHA | BYTE_IDENTIFIER | BYTE_STRING)
+#define H (BYTE_ALPHA | BYTE_HEX | BYTE_IDENTIFIER | BYTE_STRING)
+#define D (BYTE_DIGIT | BYTE_HEX | BYTE_IDENTIFIER | BYTE_STRING)
+#define U (BYTE_IDENTIFIER | BYTE_STRING)
+#define Q (BYTE_QUOTE)
+#define P (BYTE_PUNCTUATION | BYTE_STRING)
+
+static const uint8_t byte_class[256] = {
+    X, X, X, X, X, X, X, X, X, W, W, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    W, X, Q, X, X, X, X, X, P, P, X, X, P, P, P, X,
+    D, D, D, D, D, D, D, D, D, D, P, X, X, P, X, X,
+    X, H, H, H, H, H, H, A, A, A, A, A, A, A, A, A,
+    A, A, A, A, A, A, A, A, A, A, A, P, X, P, X, U,
+    X, H, H, H, H, H, H, A, A, A, A, A, A, A, A, A,
+    A, A, A, A, A, A, A, A, A, A, A, P, X, P, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+};
+
+#undef X
+#undef W
+#undef A
+#undef H
+#undef D
+#undef U
+#undef Q
+#undef P
+
+/* The runs of bytes a token can span, each backend finds the end of a run */
+enum scan {
+    SCAN_IDENTIFIER,
+    SCAN_DIGIT,
+    SCAN_HEX,
+    SCAN_WHITESPACE,
+    SCAN_STRING,
+};
+
+static const uint8_t scan_byte_class[] = {
+    [SCAN_IDENTIFIER] = BYTE_IDENTIFIER,
+    [SCAN_DIGIT] = BYTE_DIGIT,
+    [SCAN_HEX] = BYTE_HEX,
+    [SCAN_WHITESPACE] = BYTE_WHITESPACE,
+    [SCAN_STRING] = BYTE_STRING,
+};
+
+static uint64_t scalar_scan(const uint8_t* data, uint64_t index,
+                            uint64_t size, enum scan scan) {
+    uint8_t class = scan_byte_class[scan];
+    while (index < size && (byte_class[data[index]] & class)) {
+        ++index;
     }
+    return index;
 }
 
-static bool is_alpha(uint8_t byte) {
-    if (byte >= 'a' && byte <= 'z') {
-        return true;
+#if defined(__x86_64__)
+
+static inline __m128i sse2_in_range(__m128i v, char low, char high) {
+    /* Bytes >= 0x80 are negative and never in an ASCII range */
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(low - 1)),
+                         _mm_cmplt_epi8(v, _mm_set1_epi8(high + 1)));
+}
+
+static inline __m128i sse2_scan_mask(__m128i v, enum scan scan) {
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    switch (scan) {
+    case SCAN_IDENTIFIER:
+        return _mm_or_si128(
+            _mm_or_si128(sse2_in_range(lower, 'a', 'z'),
+                         sse2_in_range(v, '0', '9')),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))
+        );
+    case SCAN_DIGIT:
+        return sse2_in_range(v, '0', '9');
+    case SCAN_HEX:
+        return _mm_or_si128(sse2_in_range(lower, 'a', 'f'),
+                            sse2_in_range(v, '0', '9'));
+    case SCAN_WHITESPACE:
+        return _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8(' '))
+        );
+    case SCAN_STRING:
+        return _mm_xor_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                             _mm_set1_epi8(-1));
     }
-    else if (byte >= 'A' && byte <= 'Z') {
-        return true;
+    return _mm_setzero_si128();
+}
+
+static uint64_t sse2_scan(const uint8_t* data, uint64_t index,
+                          uint64_t size, enum scan scan) {
+    /* Most runs are short, check the first byte before loading a block */
+    if (index >= size || !(byte_class[data[index]] & scan_byte_class[scan])) {
+        return index;
+    }
+    while (index + 16 <= size) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (data + index));
+        uint32_t stop = ~_mm_movemask_epi8(sse2_scan_mask(v, scan)) & 0xFFFF;
+        if (stop != 0) {
+            return index + __builtin_ctz(stop);
+        }
+        index += 16;
     }
-    return false;
+    return scalar_scan(data, index, size, scan);
 }
 
-static bool is_digit(uint8_t byte) {
-    if (byte >= '0' && byte <= '9') {
-        return true;
+__attribute__((target("avx2")))
+static inline __m256i avx2_in_range(__m256i v, char low, char high) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(low - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), v));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_scan_mask(__m256i v, enum scan scan) {
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    switch (scan) {
+    case SCAN_IDENTIFIER:
+        return _mm256_or_si256(
+            _mm256_or_si256(avx2_in_range(lower, 'a', 'z'),
+                            avx2_in_range(v, '0', '9')),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'))
+        );
+    case SCAN_DIGIT:
+        return avx2_in_range(v, '0', '9');
+    case SCAN_HEX:
+        return _mm256_or_si256(avx2_in_range(lower, 'a', 'f'),
+                               avx2_in_range(v, '0', '9'));
+    case SCAN_WHITESPACE:
+        return _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '))
+        );
+    case SCAN_STRING:
+        return _mm256_xor_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                                _mm256_set1_epi8(-1));
     }
-    return false;
+    return _mm256_setzero_si256();
 }
 
-static bool is_hex(uint8_t byte) {
-    if (byte >= 'a' && byte <= 'f') {
-        return true;
+__attribute__((target("avx2")))
+static uint64_t avx2_scan(const uint8_t* data, uint64_t index,
+                          uint64_t size, enum scan scan) {
+    if (index >= size || !(byte_class[data[index]] & scan_byte_class[scan])) {
+        return index;
+    }
+    while (index + 32 <= size) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (data + index));
+        uint32_t stop = ~((uint32_t) _mm256_movemask_epi8(
+            avx2_scan_mask(v, scan)
+        ));
+        if (stop != 0) {
+            return index + __builtin_ctz(stop);
+        }
+        index += 32;
     }
-    else if (byte >= 'A' && byte <= 'F') {
+    return sse2_scan(data, index, size, scan);
+}
+
+#endif /* if defined(__x86_64__) */
+
+bool lexer_backend_supported(enum lexer_backend backend) {
+    switch (backend) {
+    case LEXER_BACKEND_SCALAR:
         return true;
+#if defined(__x86_64__)
+    case LEXER_BACKEND_SSE2:
+        return true;
+    case LEXER_BACKEND_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
     }
-    return is_digit(byte);
 }
 
-struct tokens lex(struct str* input) {
-    struct tokens tokens;
-    token_init(&tokens);
-
-    enum state {
-        START,
-        IDENTIFIER,
-        NUMBER,
-        NUMBER_HEX,
-        STRING_LITERAL,
-    } state = START;
-    uint8_t* token_start = NULL;
-
-    for (uint64_t i = 0; i < input->size; ++i) {
-        uint8_t* current = input->data + i;
-        uint8_t byte = *current;
-
-        if (state == IDENTIFIER) {
-            if (is_alpha(byte) || is_digit(byte) || byte == '_') {
-                continue;
-            }
-            state = START;
-            uint64_t token_length = (uint64_t) (current - token_start);
-            token_push(&tokens, TOKEN_IDENTIFIER,
-                        token_start, token_length);
+const char* lexer_backend_c_str(enum lexer_backend backend) {
+    switch (backend) {
+    case LEXER_BACKEND_SCALAR:
+        return "scalar";
+    case LEXER_BACKEND_SSE2:
+        return "sse2";
+    case LEXER_BACKEND_AVX2:
+        return "avx2";
+    }
+    return "unknown";
+}
+
+static enum token_kind punctuation_token_kind(uint8_t byte) {
+    switch (byte) {
+    case '=':
+        return TOKEN_EQUAL_SIGN;
+    case ':':
+        return TOKEN_COLON;
+    case ',':
+        return TOKEN_COMMA;
+    case '-':
+        return TOKEN_DASH;
+    case '.':
+        return TOKEN_DOT;
+    case '(':
+        return TOKEN_LEFT_PAREN;
+    case ')':
+        return TOKEN_RIGHT_PAREN;
+    case '{':
+        return TOKEN_LEFT_CURLY_BRACKET;
+    case '}':
+        return TOKEN_RIGHT_CURLY_BRACKET;
+    case '[':
+        return TOKEN_LEFT_SQUARE_BRACKET;
+    case ']':
+        return TOKEN_RIGHT_SQUARE_BRACKET;
+    default:
+        fatal_error("lexer: not a punctuation byte");
+    }
+}
+
+/* Appends input's tokens, the tokens must be for input's data */
+static void lex_scan(struct tokens* tokens,
+                     struct str* input,
+                     uint64_t (*scan)(const uint8_t* data,
+                                      uint64_t index,
+                                      uint64_t size,
+                                      enum scan scan)) {
+    if (input->size > TOKEN_SOURCE_SIZE_MAX) {
+        fatal_error("lexer: input larger than 4 GiB");
+    }
+
+    uint8_t* data = input->data;
+    uint64_t size = input->size;
+    uint64_t i = 0;
+    while (i < size) {
+        uint8_t byte = data[i];
+        uint8_t class = byte_class[byte];
+
+        if (class & BYTE_WHITESPACE) {
+            i = scan(data, i + 1, size, SCAN_WHITESPACE);
+        }
+        else if (class & BYTE_ALPHA) {
+            uint64_t end = scan(data, i + 1, size, SCAN_IDENTIFIER);
+            token_push_identifier(tokens, data + i, end - i);
+            i = end;
         }
-        else if (state == NUMBER || state == NUMBER_HEX) {
-            if (is_digit(byte)) {
-                continue;
+        else if (class & BYTE_DIGIT) {
+            if (byte == '0' && (i + 1) < size && data[i + 1] == 'x') {
+                uint64_t end = scan(data, i + 2, size, SCAN_HEX);
+                /* A hex number is only finished by a following byte */
+                if (end != size) {
+                    token_push(tokens, TOKEN_NUMBER, data + i, end - i);
+                }
+                i = end;
             }
-            if (state == NUMBER_HEX && is_hex(byte)) {
-                continue;
+            else {
+                uint64_t end = scan(data, i + 1, size, SCAN_DIGIT);
+                token_push(tokens, TOKEN_NUMBER, data + i, end - i);
+                i = end;
             }
-            state = START;
-            uint64_t token_length = (uint64_t) (current - token_start);
-            token_push(&tokens, TOKEN_NUMBER,
-                        token_start, token_length);
         }
-        else if (state == STRING_LITERAL) {
-            if (byte != '"') {
-                continue;
+        else if (class & BYTE_QUOTE) {
+            uint64_t end = scan(data, i + 1, size, SCAN_STRING);
+            if (end == size) {
+                fatal_error("string literal not closed");
             }
-            state = START;
-            uint64_t token_length = (uint64_t) (current - token_start);
-            token_push(&tokens, TOKEN_STRING_LITERAL,
-                        token_start, token_length);
-            continue;
+            token_push(tokens, TOKEN_STRING_LITERAL,
+                       data + i + 1, end - (i + 1));
+            i = end + 1;
         }
-
-        if (is_alpha(byte)) {
-            if (state == START) {
-                state = IDENTIFIER;
-                token_start = current;
-                continue;
-            }
+        else if (class & BYTE_PUNCTUATION) {
+            token_push(tokens, punctuation_token_kind(byte), data + i, 1);
+            ++i;
         }
-
-        if (is_digit(byte)) {
-            if (state == START) {
-                state = NUMBER;
-                token_start = current;
-
-                if (i != (input->size - 1)) {
-                    uint8_t* next = current + 1;
-                    if (byte == '0' && *next == 'x') {
-                        state = NUMBER_HEX;
-                        ++i;
-                    }
-                }
-                continue;
-            }
+        else {
+            char buffer[4096];
+            snprintf(buffer, sizeof(buffer),
+                     "lexer: unknown token '%c'", byte);
+            fatal_error(buffer);
         }
+    }
+}
 
-        if (byte == '"' && state == START) {
-            state = STRING_LITERAL;
-            token_start = current + 1;
-            continue;
-        }
+static void lex_scan_with_backend(struct tokens* tokens,
+                                  struct str* input,
+                                  enum lexer_backend backend) {
+    if (!lexer_backend_supported(backend)) {
+        fatal_error("lexer backend not supported");
+    }
+    switch (backend) {
+#if defined(__x86_64__)
+    case LEXER_BACKEND_SSE2:
+        lex_scan(tokens, input, sse2_scan);
+        break;
+    case LEXER_BACKEND_AVX2:
+        lex_scan(tokens, input, avx2_scan);
+        break;
+#endif
+    default:
+        lex_scan(tokens, input, scalar_scan);
+        break;
+    }
+}
 
-        if (byte == '=') {
-            token_push(&tokens, TOKEN_EQUAL_SIGN, current, 1);
-            continue;
-        }
+struct tokens lex_with_backend(struct str* input,
+                               struct symbol_table* symbols,
+                               enum lexer_backend backend) {
+    struct tokens tokens;
+    token_init(&tokens, input->data, symbols);
+    lex_scan_with_backend(&tokens, input, backend);
+    return tokens;
+}
 
-        if (byte == ':') {
-            token_push(&tokens, TOKEN_COLON, current, 1);
-            continue;
-        }
+static enum lexer_backend lex_default_backend(void) {
+    if (lexer_backend_supported(LEXER_BACKEND_AVX2)) {
+        return LEXER_BACKEND_AVX2;
+    }
+    if (lexer_backend_supported(LEXER_BACKEND_SSE2)) {
+        return LEXER_BACKEND_SSE2;
+    }
+    return LEXER_BACKEND_SCALAR;
+}
 
-        if (byte == ',') {
-            token_push(&tokens, TOKEN_COMMA, current, 1);
-            continue;
-        }
+struct tokens lex(struct str* input, struct symbol_table* symbols) {
+    return lex_with_backend(input, symbols, lex_default_backend());
+}
 
-        if (byte == '-') {
-            token_push(&tokens, TOKEN_DASH, current, 1);
-            continue;
-        }
+void lex_reuse(struct tokens* tokens, struct str* input) {
+    tokens->source = input->data;
+    tokens->length = 0;
+    lex_scan_with_backend(tokens, input, lex_default_backend());
+}
 
-        if (byte == '.') {
-            token_push(&tokens, TOKEN_DOT, current, 1);
-            continue;
-        }
+/* Splitting smaller inputs costs more than lexing them on one thread */
+#define LEX_PARALLEL_CHUNK_MIN (256 * 1024)
 
-        if (byte == '(') {
-            token_push(&tokens, TOKEN_LEFT_PAREN, current, 1);
-            continue;
-        }
+struct lex_chunk {
+    struct str input;
+    uint64_t quotes;
+    /* Symbol tables are not shared between threads */
+    struct symbol_table* symbols;
+    struct tokens tokens;
+};
 
-        if (byte == ')') {
-            token_push(&tokens, TOKEN_RIGHT_PAREN, current, 1);
-            continue;
+static void lex_chunk_count_quotes(void* arg) {
+    struct lex_chunk* chunk = arg;
+    uint8_t* current = chunk->input.data;
+    uint8_t* end = chunk->input.data + chunk->input.size;
+    uint64_t quotes = 0;
+    while (current < end) {
+        current = memchr(current, '"', end - current);
+        if (current == NULL) {
+            break;
         }
+        ++quotes;
+        ++current;
+    }
+    chunk->quotes = quotes;
+}
 
-        if (byte == '{') {
-            token_push(&tokens, TOKEN_LEFT_CURLY_BRACKET, current, 1);
-            continue;
-        }
+static void lex_chunk_tokens(void* arg) {
+    struct lex_chunk* chunk = arg;
+    chunk->symbols = symbol_table_create();
+    chunk->tokens = lex(&chunk->input, chunk->symbols);
+}
 
-        if (byte == '}') {
-            token_push(&tokens, TOKEN_RIGHT_CURLY_BRACKET, current, 1);
-            continue;
-        }
+struct tokens lex_parallel(struct str* input,
+                           struct symbol_table* symbols,
+                           struct thread_pool* thread_pool) {
+    if (input->size > TOKEN_SOURCE_SIZE_MAX) {
+        fatal_error("lexer: input larger than 4 GiB");
+    }
 
-        if (byte == '[') {
-            token_push(&tokens, TOKEN_LEFT_SQUARE_BRACKET, current, 1);
-            continue;
-        }
+    /* More chunks than threads keeps the threads busy when chunks differ */
+    uint64_t chunks_length = thread_pool_threads(thread_pool) * 4;
+    if (chunks_length > input->size / LEX_PARALLEL_CHUNK_MIN) {
+        chunks_length = input->size / LEX_PARALLEL_CHUNK_MIN;
+    }
+    if (chunks_length <= 1 || thread_pool_threads(thread_pool) == 1) {
+        return lex(input, symbols);
+    }
 
-        if (byte == ']') {
-            token_push(&tokens, TOKEN_RIGHT_SQUARE_BRACKET, current, 1);
-            continue;
-        }
+    struct lex_chunk* chunks = xcalloc(chunks_length, sizeof(struct lex_chunk));
+
+    /* A string literal has no escapes, so an odd number of quotes before a
+       byte means the byte is inside a string literal */
+    uint8_t* data = input->data;
+    uint64_t size = input->size;
+    for (uint64_t i = 0; i < chunks_length; ++i) {
+        uint64_t start = (i * size) / chunks_length;
+        uint64_t end = ((i + 1) * size) / chunks_length;
+        chunks[i].input.data = data + start;
+        chunks[i].input.size = end - start;
+        thread_pool_submit(thread_pool, lex_chunk_count_quotes, &chunks[i]);
+    }
+    thread_pool_wait(thread_pool);
 
-        if (is_whitespace(byte)) {
-            continue;
+    /* Move every split forward to just after whitespace outside of a string
+       literal. A chunk then never ends inside a token, and ends with a byte
+       that finishes its last token the same way the whole input would. */
+    uint64_t quotes = 0;
+    uint64_t start = 0;
+    uint64_t parts_length = 0;
+    for (uint64_t i = 0; i < chunks_length && start < size; ++i) {
+        quotes += chunks[i].quotes;
+        uint64_t end = (chunks[i].input.data - data) + chunks[i].input.size;
+        bool in_string = (quotes % 2) != 0;
+        if (end < start) {
+            end = start;
+            in_string = false;
         }
+        while (end < size) {
+            uint8_t byte = data[end];
+            ++end;
+            if (byte == '"') {
+                in_string = !in_string;
+            }
+            else if (!in_string && (byte_class[byte] & BYTE_WHITESPACE)) {
+                break;
+            }
+        }
+        chunks[parts_length].input.data = data + start;
+        chunks[parts_length].input.size = end - start;
+        ++parts_length;
+        start = end;
+    }
+
+    for (uint64_t i = 0; i < parts_length; ++i) {
+        thread_pool_submit(thread_pool, lex_chunk_tokens, &chunks[i]);
+    }
+    thread_pool_wait(thread_pool);
 
-        char buffer[4096];
-        snprintf(buffer, sizeof(buffer), "lexer: unknown token '%c'", byte);
-        fatal_error(buffer);
+    struct tokens tokens;
+    token_init(&tokens, data, symbols);
+    for (uint64_t i = 0; i < parts_length; ++i) {
+        token_append(&tokens, &chunks[i].tokens);
+        token_free(&chunks[i].tokens);
+        symbol_table_destroy(chunks[i].symbols);
     }
+    free(chunks);
+
+    return tokens;
+}
 
-    uint8_t* end = input->data + input->size;
-    if (state == IDENTIFIER) {
-        uint64_t token_length = (uint64_t) (end - token_start);
-        token_push(&tokens, TOKEN_IDENTIFIER,
-                   token_start, token_length);
+uint64_t lex_incremental(struct tokens* tokens,
+                         struct str* input,
+                         uint64_t lexed,
+                         bool end) {
+    /* Only lex up to just after the last whitespace outside of a string
+       literal, the bytes after it may be part of a token still arriving */
+    uint8_t* data = input->data;
+    uint64_t size = input->size;
+    uint64_t split = lexed;
+    if (end) {
+        split = size;
     }
-    else if (state == NUMBER) {
-        uint64_t token_length = (uint64_t) (end - token_start);
-        token_push(&tokens, TOKEN_NUMBER,
-                   token_start, token_length);
+    else {
+        bool in_string = false;
+        for (uint64_t i = lexed; i < size; ++i) {
+            uint8_t byte = data[i];
+            if (byte == '"') {
+                in_string = !in_string;
+            }
+            else if (!in_string && (byte_class[byte] & BYTE_WHITESPACE)) {
+                split = i + 1;
+            }
+        }
     }
-    else if (state == STRING_LITERAL) {
-        fatal_error("string literal not closed");
+    if (split == lexed) {
+        return lexed;
     }
 
-    return tokens;
+    struct str part = {
+        .data = data + lexed,
+        .size = split - lexed,
+    };
+    struct tokens part_tokens = lex(&part, tokens->symbols);
+    token_append(tokens, &part_tokens);
+    token_free(&part_tokens);
+    return split;
 }
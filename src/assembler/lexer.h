@@ -1,8 +1,37 @@
 #ifndef MALLARD_LEXER_H
 #define MALLARD_LEXER_H
 
+#include "symbol_table.h"
+#include "thread_pool.h"
 #include "tokens.h"
 
-struct tokens lex(struct str* str);
+#include <stdbool.h>
+
+enum lexer_backend {
+    LEXER_BACKEND_SCALAR,
+    LEXER_BACKEND_SSE2,
+    LEXER_BACKEND_AVX2,
+};
+
+bool lexer_backend_supported(enum lexer_backend backend);
+const char* lexer_backend_c_str(enum lexer_backend backend);
+
+struct tokens lex(struct str* str, struct symbol_table* symbols);
+struct tokens lex_with_backend(struct str* str,
+                               struct symbol_table* symbols,
+                               enum lexer_backend backend);
+/* Lexes input into tokens from token_init, dropping the tokens already
+   there but keeping their memory */
+void lex_reuse(struct tokens* tokens, struct str* input);
+struct tokens lex_parallel(struct str* str,
+                           struct symbol_table* symbols,
+                           struct thread_pool* thread_pool);
+/* Lexes the part of input after lexed that can no longer change as more
+   input arrives, or all of it at the end of the input. The tokens must be
+   for input's data, which must not move. Returns the new lexed offset. */
+uint64_t lex_incremental(struct tokens* tokens,
+                         struct str* input,
+                         uint64_t lexed,
+                         bool end);
 
 #endif /* ifndef MALLARD_LEXER_H */
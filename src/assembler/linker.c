@@ -0,0 +1,285 @@
+#include "linker.h"
+
+#include "alloc.h"
+#include "archive.h"
+#include "ast_node.h"
+#include "compile.h"
+#include "elf.h"
+#include "fatal_error.h"
+#include "file.h"
+#include "lexer.h"
+#include "parser.h"
+#include "str_table.h"
+#include "thread_pool.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A file listed in files:, either an object that is always linked or an
+   archive whose members are only read once a symbol needs them */
+struct linker_object {
+    struct str path;
+    struct str source;
+    bool is_archive;
+    struct elf_object object;
+    struct archive archive;
+    bool* members_read;
+    struct elf_object* members;
+};
+
+/* The objects one executable links, found from the symbols it needs. Each
+   symbol is looked up at most once. */
+struct linker_resolve {
+    bool* visited;
+    uint64_t visited_length;
+    uint32_t* pending;
+    uint64_t pending_length;
+    uint64_t pending_capacity;
+    struct elf_object** linked;
+    uint64_t linked_length;
+    uint64_t linked_capacity;
+};
+
+static bool linker_resolve_visit(struct linker_resolve* resolve,
+                                 uint32_t symbol) {
+    if (symbol >= resolve->visited_length) {
+        uint64_t length = resolve->visited_length * 2;
+        if (length <= symbol) {
+            length = symbol + 1;
+        }
+        resolve->visited = xrealloc(resolve->visited, length * sizeof(bool));
+        memset(resolve->visited + resolve->visited_length, 0,
+               (length - resolve->visited_length) * sizeof(bool));
+        resolve->visited_length = length;
+    }
+    bool visited = resolve->visited[symbol];
+    resolve->visited[symbol] = true;
+    return visited;
+}
+
+static void linker_resolve_push(struct linker_resolve* resolve,
+                                uint32_t symbol) {
+    if (resolve->pending_length == resolve->pending_capacity) {
+        resolve->pending_capacity = resolve->pending_capacity == 0
+                                    ? 64 : resolve->pending_capacity * 2;
+        resolve->pending = xrealloc(resolve->pending,
+                                    resolve->pending_capacity
+                                    * sizeof(uint32_t));
+    }
+    resolve->pending[resolve->pending_length++] = symbol;
+}
+
+/* Links the whole object, its calls are what the next members resolve */
+static void linker_resolve_add(struct linker_resolve* resolve,
+                               struct elf_object* object) {
+    if (resolve->linked_length == resolve->linked_capacity) {
+        resolve->linked_capacity = resolve->linked_capacity == 0
+                                   ? 16 : resolve->linked_capacity * 2;
+        resolve->linked = xrealloc(resolve->linked,
+                                   resolve->linked_capacity
+                                   * sizeof(struct elf_object*));
+    }
+    resolve->linked[resolve->linked_length++] = object;
+    for (uint64_t i = 0; i < object->functions_length; ++i) {
+        linker_resolve_visit(resolve, object->functions[i].symbol);
+    }
+    for (uint64_t i = 0; i < object->functions_length; ++i) {
+        struct fixups* fixups = &object->functions[i].fixups;
+        for (uint64_t j = 0; j < fixups->length; ++j) {
+            linker_resolve_push(resolve, fixups->data[j].symbol);
+        }
+    }
+}
+
+/* Objects are linked in files: order, then archive members in the order
+   they are first needed, starting from entry and the pinned functions */
+static void linker_resolve(struct linker_resolve* resolve,
+                           struct executable_ast_node* exec,
+                           struct linker_object** objects,
+                           struct symbol_table* symbols) {
+    resolve->linked_length = 0;
+    resolve->pending_length = 0;
+    if (resolve->visited != NULL) {
+        memset(resolve->visited, 0, resolve->visited_length * sizeof(bool));
+    }
+    for (uint64_t i = 0; i < exec->files_length; ++i) {
+        if (!objects[i]->is_archive) {
+            linker_resolve_add(resolve, &objects[i]->object);
+        }
+    }
+    for (uint64_t i = exec->addresses_length; i > 0; --i) {
+        linker_resolve_push(resolve, exec->addresses[i - 1]->function.symbol);
+    }
+    linker_resolve_push(resolve, exec->entry_token.symbol);
+
+    while (resolve->pending_length != 0) {
+        uint32_t symbol = resolve->pending[--resolve->pending_length];
+        if (linker_resolve_visit(resolve, symbol)) {
+            continue;
+        }
+        /* One hash lookup per archive, the first to define it wins */
+        struct str name = symbol_table_str(symbols, symbol);
+        for (uint64_t i = 0; i < exec->files_length; ++i) {
+            struct linker_object* object = objects[i];
+            if (!object->is_archive) {
+                continue;
+            }
+            uint64_t member = archive_lookup(&object->archive, &name);
+            if (member == object->archive.members_length) {
+                continue;
+            }
+            if (!object->members_read[member]) {
+                struct str source = archive_member(&object->archive, member);
+                elf_object_read(&object->members[member], &source, symbols);
+                object->members_read[member] = true;
+            }
+            linker_resolve_add(resolve, &object->members[member]);
+            break;
+        }
+    }
+}
+
+void linker_link(struct str* str, uint64_t jobs) {
+    /* Object names are interned with the unit's, so entry and address()
+       name the same symbols */
+    struct symbol_table* symbols = symbol_table_create();
+    struct arena* arena = arena_create();
+    struct tokens tokens = lex(str, symbols);
+    struct ast_node* node = parse(&tokens, arena);
+    if (!is_unit_ast_node(node)) {
+        fatal_error("expected unit ast node");
+    }
+    struct unit_ast_node* unit = (struct unit_ast_node*) node;
+    uint64_t files_length = compile_check_executables(unit);
+
+    /* Every object is read once, no matter how many executables list it */
+    struct linker_object* objects = xcalloc(files_length + 1,
+                                            sizeof(struct linker_object));
+    struct linker_object** executable_objects
+        = xcalloc(files_length + 1, sizeof(struct linker_object*));
+    struct str_table* object_table = str_table_create();
+    uint64_t objects_length = 0;
+    uint64_t executable_objects_length = 0;
+    for (uint64_t i = 0; i < unit->length; ++i) {
+        struct executable_ast_node* exec
+            = (struct executable_ast_node*) unit->ast_nodes[i];
+        for (uint64_t j = 0; j < exec->files_length; ++j) {
+            struct str* path = &exec->files[j].str;
+            struct str_table_entry* entry = str_table_get(object_table, path);
+            struct linker_object* object = NULL;
+            if (entry != NULL) {
+                object = entry->val;
+            }
+            else {
+                object = &objects[objects_length++];
+                object->path = *path;
+                str_table_insert(object_table, path, object);
+            }
+            executable_objects[executable_objects_length++] = object;
+        }
+    }
+    str_table_destroy(object_table);
+
+    const char** paths = xcalloc(objects_length + 1, sizeof(const char*));
+    struct str* sources = xcalloc(objects_length + 1, sizeof(struct str));
+    for (uint64_t i = 0; i < objects_length; ++i) {
+        paths[i] = str_to_c_str(&objects[i].path);
+    }
+    file_open_read_batch(paths, sources, objects_length);
+    for (uint64_t i = 0; i < objects_length; ++i) {
+        struct linker_object* object = &objects[i];
+        object->source = sources[i];
+        free((void*) paths[i]);
+        if (!archive_matches(&object->source)) {
+            elf_object_read(&object->object, &object->source, symbols);
+            continue;
+        }
+        object->is_archive = true;
+        archive_open(&object->archive, &object->source);
+        uint64_t members_length = object->archive.members_length;
+        object->members_read = xcalloc(members_length + 1, sizeof(bool));
+        object->members = xcalloc(members_length + 1,
+                                  sizeof(struct elf_object));
+    }
+    free(sources);
+    free(paths);
+
+    /* The machine code is copied as is, only the calls are patched */
+    if (jobs == 0) {
+        jobs = thread_pool_default_threads();
+    }
+    struct thread_pool* thread_pool = thread_pool_create(jobs);
+    struct elf_file** elf_files = xcalloc(unit->length,
+                                          sizeof(struct elf_file*));
+    struct linker_resolve resolve = { 0 };
+    executable_objects_length = 0;
+    for (uint64_t i = 0; i < unit->length; ++i) {
+        struct executable_ast_node* exec
+            = (struct executable_ast_node*) unit->ast_nodes[i];
+        linker_resolve(&resolve,
+                       exec, executable_objects + executable_objects_length,
+                       symbols);
+        executable_objects_length += exec->files_length;
+
+        struct elf_file* elf_file = elf_create_empty();
+        elf_file_set_code_start(elf_file, exec->code_address);
+        for (uint64_t j = 0; j < resolve.linked_length; ++j) {
+            elf_add_relocatable(elf_file, resolve.linked[j]);
+        }
+        elf_file_set_addresses(elf_file, exec->addresses,
+                               exec->addresses_length);
+        elf_file_set_entry(elf_file, &exec->entry_token);
+        elf_file_finalize(elf_file, thread_pool);
+        elf_files[i] = elf_file;
+    }
+    thread_pool_destroy(thread_pool);
+    free(resolve.visited);
+    free(resolve.pending);
+    free(resolve.linked);
+
+    struct file_write* writes = xcalloc(unit->length,
+                                        sizeof(struct file_write));
+    struct iovec* iovs = xcalloc(unit->length, sizeof(struct iovec));
+    struct vector* encoded = xcalloc(unit->length, sizeof(struct vector));
+    for (uint64_t i = 0; i < unit->length; ++i) {
+        struct executable_ast_node* exec
+            = (struct executable_ast_node*) unit->ast_nodes[i];
+        iovs[i] = compile_output(exec, elf_files[i], &encoded[i]);
+        writes[i].path = str_to_c_str(&exec->output_path.str);
+        writes[i].iov = &iovs[i];
+        writes[i].iov_length = 1;
+    }
+    file_write_batch(writes, unit->length);
+    for (uint64_t i = 0; i < unit->length; ++i) {
+        free((void*) writes[i].path);
+        free(encoded[i].data);
+        elf_file_destroy(elf_files[i]);
+    }
+    free(encoded);
+    free(iovs);
+    free(writes);
+    free(elf_files);
+
+    for (uint64_t i = 0; i < objects_length; ++i) {
+        struct linker_object* object = &objects[i];
+        if (object->is_archive) {
+            for (uint64_t j = 0; j < object->archive.members_length; ++j) {
+                if (object->members_read[j]) {
+                    elf_object_free(&object->members[j]);
+                }
+            }
+            free(object->members_read);
+            free(object->members);
+        }
+        else {
+            elf_object_free(&object->object);
+        }
+        file_close_mmap(&object->source);
+    }
+    free(executable_objects);
+    free(objects);
+    arena_destroy(arena);
+    token_free(&tokens);
+    symbol_table_destroy(symbols);
+}
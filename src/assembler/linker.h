@@ -0,0 +1,12 @@
+#ifndef MALLARD_LINKER_H
+#define MALLARD_LINKER_H
+
+#include "str.h"
+
+#include <stdint.h>
+
+/* Links the executables described by str, whose files are relocatable
+   objects, with jobs threads or one per core when jobs is 0 */
+void linker_link(struct str* str, uint64_t jobs);
+
+#endif /* ifndef MALLARD_LINKER_H */
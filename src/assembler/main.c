@@ -1,11 +1,16 @@
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "ansi.h"
 #include "compile.h"
 #include "fatal_error.h"
 #include "file.h"
 #include "lexer.h"
+#include "serve.h"
 #include "version.h"
 
 int main(int argc, char** argv) {
@@ -15,11 +20,109 @@ int main(int argc, char** argv) {
 
     const char* input = NULL;
     const char* version = NULL;
+    const char* output = NULL;
+    const char* serve_socket = NULL;
+    const char* connect_socket = NULL;
+    const char* root = NULL;
+    const char* depfile_path = NULL;
+    const char* time_report_json = NULL;
+    const char* trace_path = NULL;
+    bool time_report_text = false;
+    bool depfile = false;
+    bool object = false;
+    uint64_t jobs = 0;
+    /* The flag takes precedence over the environment */
+    const char* cache_dir = getenv("MALLARD_CACHE_DIR");
     for (int i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "--version") == 0) {
             version = argv[i];
             continue;
         }
+        if (strcmp(argv[i], "-c") == 0) {
+            object = true;
+            continue;
+        }
+        if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 == argc) {
+                fatal_error("'-o' requires an output file");
+            }
+            output = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "-MD") == 0) {
+            depfile = true;
+            continue;
+        }
+        if (strcmp(argv[i], "-MF") == 0) {
+            if (i + 1 == argc) {
+                fatal_error("'-MF' requires a depfile path");
+            }
+            depfile = true;
+            depfile_path = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--time-report") == 0) {
+            time_report_text = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--time-report-json") == 0) {
+            if (i + 1 == argc) {
+                fatal_error("'--time-report-json' requires an output file");
+            }
+            time_report_json = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--trace") == 0) {
+            if (i + 1 == argc) {
+                fatal_error("'--trace' requires an output file");
+            }
+            trace_path = argv[++i];
+            continue;
+        }
+        if (strncmp(argv[i], "--trace=", 8) == 0) {
+            trace_path = argv[i] + 8;
+            continue;
+        }
+        if (strcmp(argv[i], "--root") == 0) {
+            if (i + 1 == argc) {
+                fatal_error("'--root' requires a directory");
+            }
+            root = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--serve") == 0) {
+            if (i + 1 == argc) {
+                fatal_error("'--serve' requires a socket path");
+            }
+            serve_socket = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--connect") == 0) {
+            if (i + 1 == argc) {
+                fatal_error("'--connect' requires a socket path");
+            }
+            connect_socket = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--cache-dir") == 0) {
+            if (i + 1 == argc) {
+                fatal_error("'--cache-dir' requires a directory");
+            }
+            cache_dir = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-j") == 0) {
+            if (i + 1 == argc) {
+                fatal_error("'--jobs' requires a number of threads");
+            }
+            char* end = NULL;
+            long long value = strtoll(argv[++i], &end, 10);
+            if (*end != '\0' || value < 1 || value > 4096) {
+                fatal_error("'--jobs' must be between 1 and 4096");
+            }
+            jobs = value;
+            continue;
+        }
 
         if (!input) {
             input = argv[i];
@@ -42,9 +145,80 @@ int main(int argc, char** argv) {
         fatal_error("required input file");
     }
 
-    struct str str = file_open_read_mmap(input);
-    compile(&str);
-    file_close_mmap(&str);
+    bool time_report = time_report_text || time_report_json != NULL;
+    if (time_report
+        && (object || serve_socket != NULL || connect_socket != NULL)) {
+        fatal_error("'--time-report' only reports a build of a unit");
+    }
+    if (trace_path != NULL
+        && (object || serve_socket != NULL || connect_socket != NULL)) {
+        fatal_error("'--trace' only traces a build of a unit");
+    }
+
+    if (connect_socket != NULL) {
+        /* The input is the command for the server */
+        char reply[4096];
+        bool ok = serve_request(connect_socket, input, reply, sizeof(reply));
+        printf("%s\n", reply);
+        return ok ? 0 : 1;
+    }
+
+    if (object) {
+        /* The input is a source file, not a unit */
+        if (output == NULL) {
+            fatal_error("'-c' requires '-o' with the object file");
+        }
+        struct str str = file_open_read_mmap(input);
+        compile_object(&str, output, jobs);
+        file_close_mmap(&str);
+        return 0;
+    }
+    else if (output != NULL) {
+        fatal_error("'-o' is only used with '-c'");
+    }
 
+    struct compile_options options = {
+        .jobs = jobs,
+        .cache_dir = cache_dir,
+        .root = root,
+        .depfile = depfile,
+        .depfile_path = depfile_path,
+    };
+    if (cache_dir != NULL && cache_dir[0] == '\0') {
+        options.cache_dir = NULL;
+    }
+    if (time_report) {
+        options.time_report = time_report_create();
+    }
+    if (trace_path != NULL) {
+        options.trace = trace_create();
+    }
+    if (serve_socket != NULL) {
+        serve(input, serve_socket, &options);
+        return 0;
+    }
+    if (strcmp(input, "-") == 0) {
+        compile_fd(STDIN_FILENO, &options);
+    }
+    else {
+        struct str str = file_open_read_mmap(input);
+        compile_with_options(&str, &options);
+        file_close_mmap(&str);
+    }
+
+    if (time_report) {
+        /* Printed to stderr, so the report never mixes with outputs */
+        if (time_report_text) {
+            time_report_print(options.time_report, stderr);
+        }
+        if (time_report_json != NULL) {
+            time_report_write_json(options.time_report, time_report_json);
+        }
+        time_report_destroy(options.time_report);
+    }
+    if (trace_path != NULL) {
+        trace_write_json(options.trace, trace_path);
+        trace_destroy(options.trace);
+    }
     return 0;
 }
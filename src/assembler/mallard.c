@@ -0,0 +1,102 @@
+#include "mallard.h"
+
+#include "alloc.h"
+#include "arena.h"
+#include "compile.h"
+#include "fatal_error.h"
+#include "lexer.h"
+#include "parser.h"
+#include "symbol_table.h"
+
+#include <stdlib.h>
+
+struct mallard_context {
+    /* Holds the predefined symbols between snippets, each snippet's names
+       are removed by the next reset */
+    struct symbol_table* symbols;
+    struct arena* arena;
+    struct tokens tokens;
+    struct fixups fixups;
+    struct vector code;
+    struct fatal_error_context error;
+};
+
+struct mallard_context* mallard_context_create(void) {
+    struct mallard_context* context
+        = xcalloc(1, sizeof(struct mallard_context));
+    context->symbols = symbol_table_create();
+    context->arena = arena_create();
+    token_init(&context->tokens, NULL, context->symbols);
+    return context;
+}
+
+void mallard_context_destroy(struct mallard_context* context) {
+    free(context->code.data);
+    free(context->fixups.data);
+    token_free(&context->tokens);
+    arena_destroy(context->arena);
+    symbol_table_destroy(context->symbols);
+    free(context);
+}
+
+void mallard_context_reset(struct mallard_context* context) {
+    symbol_table_truncate(context->symbols, SYMBOL_PREDEFINED_LENGTH);
+    arena_reset(context->arena);
+    context->tokens.length = 0;
+    context->fixups.length = 0;
+    context->code.size = 0;
+}
+
+static void mallard_code_reserve(struct vector* code, uint64_t size) {
+    if (size <= code->capacity) {
+        return;
+    }
+    uint64_t capacity = code->capacity == 0 ? 256 : code->capacity;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    uint8_t* data = xrealloc(code->data, capacity);
+    code->data = data;
+    code->capacity = capacity;
+}
+
+struct mallard_result mallard_assemble(struct mallard_context* context,
+                                       const char* source,
+                                       uint64_t size) {
+    struct mallard_result result = {
+        .status = MALLARD_OK,
+    };
+    mallard_context_reset(context);
+
+    /* Everything allocated before an error belongs to the context, so
+       jumping out of the middle leaks nothing */
+    struct fatal_error_context* previous
+        = fatal_error_set_context(&context->error);
+    if (setjmp(context->error.jump) != 0) {
+        fatal_error_set_context(previous);
+        result.status = context->error.syntax ? MALLARD_SYNTAX_ERROR
+                                              : MALLARD_ERROR;
+        result.message = context->error.message;
+        return result;
+    }
+
+    struct str input = {
+        .data = (uint8_t*) source,
+        .size = size,
+    };
+    lex_reuse(&context->tokens, &input);
+    struct instructions_ast_node* insts
+        = parse_instructions(&context->tokens, context->arena);
+    mallard_code_reserve(&context->code, insts->code_size);
+    instructions_encode(insts, context->code.data, &context->fixups);
+    /* Nothing else is linked, so there is nothing to call */
+    if (context->fixups.length != 0) {
+        fatal_error("function call to unknown function");
+    }
+    context->code.size = insts->code_size;
+    fatal_error_set_context(previous);
+
+    result.code = context->code.data;
+    result.size = context->code.size;
+    return result;
+}
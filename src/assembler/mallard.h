@@ -0,0 +1,39 @@
+#ifndef MALLARD_H
+#define MALLARD_H
+
+#include <stdint.h>
+
+/* The assembler as a library. A context assembles snippets of instructions
+   one at a time and reuses its memory from one snippet to the next, errors
+   are returned instead of ending the process. Each context is used by one
+   thread at a time, separate contexts may be used at once. */
+struct mallard_context;
+
+enum mallard_status {
+    MALLARD_OK,
+    MALLARD_SYNTAX_ERROR,
+    MALLARD_ERROR,
+};
+
+struct mallard_result {
+    enum mallard_status status;
+    /* The machine code, valid until the next call with the context */
+    const uint8_t* code;
+    uint64_t size;
+    /* Why the snippet failed, or NULL. Valid until the next call with the
+       context. */
+    const char* message;
+};
+
+struct mallard_context* mallard_context_create(void);
+void mallard_context_destroy(struct mallard_context* context);
+/* Releases what the last snippet used, keeping the memory. Assembling a
+   snippet starts with a reset. */
+void mallard_context_reset(struct mallard_context* context);
+/* Assembles size bytes of source, instructions like the body of a function.
+   As in a file, a number at the very end needs a byte after it. */
+struct mallard_result mallard_assemble(struct mallard_context* context,
+                                       const char* source,
+                                       uint64_t size);
+
+#endif /* ifndef MALLARD_H */
@@ -1,35 +1,23 @@
 #include "parser.h"
 
-#include "ansi.h"
 #include "ast_node.h"
 #include "fatal_error.h"
+#include "symbol_table.h"
 #include "token.h"
 
-#include <stdlib.h>
 #include <stdio.h>
 
 struct parser {
     struct tokens* tokens;
     uint64_t index;
+    struct arena* arena;
 };
 
-static void syntax_error(const char* message) __attribute__ ((noreturn));
-
-static void syntax_error(const char* message) {
-    dprintf(2, ANSI_BOLD_RED "syntax error:" ANSI_RESET " "
-               ANSI_RED "%s" ANSI_RESET "\n", message);
-    exit(1);
-}
-
-static struct token* accept(struct parser* parser, enum token_kind token_kind) {
+static bool accept(struct parser* parser, enum token_kind token_kind) {
     if (parser->tokens->length == parser->index) {
-        return NULL;
+        return false;
     }
-    struct token* token = token_get(parser->tokens, parser->index);
-    if (token->kind == token_kind) {
-        return token;
-    }
-    return NULL;
+    return token_get_kind(parser->tokens, parser->index) == token_kind;
 }
 
 static void next(struct parser* parser) {
@@ -39,209 +27,253 @@ static void next(struct parser* parser) {
     }
 }
 
-static struct token* expect(struct parser* parser, enum token_kind token_kind) {
+static struct token expect(struct parser* parser, enum token_kind token_kind) {
     if (parser->tokens->length == parser->index) {
         char buffer[4096];
         snprintf(buffer, sizeof(buffer), "expected %s, got end of input",
                  token_kind_c_str(token_kind));
         syntax_error(buffer);
-        return NULL;
     }
-    struct token* token = accept(parser, token_kind);
-    if (token == NULL) {
-        token = token_get(parser->tokens, parser->index);
+    struct token token = token_get(parser->tokens, parser->index);
+    if (token.kind != token_kind) {
         char buffer[4096];
         snprintf(buffer, sizeof(buffer), "expected %s, got %s '%.*s'",
-                 token_kind_c_str(token_kind), token_kind_c_str(token->kind),
-                 (int) token->str.size, token->str.data);
+                 token_kind_c_str(token_kind), token_kind_c_str(token.kind),
+                 (int) token.str.size, token.str.data);
         syntax_error(buffer);
     }
     next(parser);
     return token;
 }
 
-static struct itype_ast_node* itype_instruction(
+/* rd, rs1, rs2 */
+static struct instruction_ast_node* r_operands(
+    struct parser* parser,
+    struct token* mnemonic
+) {
+    struct token rd = expect(parser, TOKEN_IDENTIFIER);
+    expect(parser, TOKEN_COMMA);
+    struct token rs1 = expect(parser, TOKEN_IDENTIFIER);
+    expect(parser, TOKEN_COMMA);
+    struct token rs2 = expect(parser, TOKEN_IDENTIFIER);
+
+    return create_instruction_ast_node(parser->arena, mnemonic,
+                                       &rd, &rs1, &rs2, NULL);
+}
+
+/* rd, rs1, imm */
+static struct instruction_ast_node* i_operands(
     struct parser* parser,
     struct token* mnemonic
 ) {
-    struct token* rd = expect(parser, TOKEN_IDENTIFIER);
+    struct token rd = expect(parser, TOKEN_IDENTIFIER);
     expect(parser, TOKEN_COMMA);
-    struct token* rs1 = expect(parser, TOKEN_IDENTIFIER);
+    struct token rs1 = expect(parser, TOKEN_IDENTIFIER);
     expect(parser, TOKEN_COMMA);
-    struct token* imm = expect(parser, TOKEN_NUMBER);
+    struct token imm = expect(parser, TOKEN_NUMBER);
 
-    return create_itype_ast_node(mnemonic, rd, rs1, imm);
+    return create_instruction_ast_node(parser->arena, mnemonic,
+                                       &rd, &rs1, NULL, &imm);
 }
 
-static struct itype_ast_node* itype_instruction_paren(
+/* rd, imm(rs1) */
+static struct instruction_ast_node* i_offset_operands(
     struct parser* parser,
     struct token* mnemonic
 ) {
-    struct token* rd = expect(parser, TOKEN_IDENTIFIER);
+    struct token rd = expect(parser, TOKEN_IDENTIFIER);
     expect(parser, TOKEN_COMMA);
-    struct token* imm = expect(parser, TOKEN_NUMBER);
+    struct token imm = expect(parser, TOKEN_NUMBER);
     expect(parser, TOKEN_LEFT_PAREN);
-    struct token* rs1 = expect(parser, TOKEN_IDENTIFIER);
+    struct token rs1 = expect(parser, TOKEN_IDENTIFIER);
     expect(parser, TOKEN_RIGHT_PAREN);
 
-    return create_itype_ast_node(mnemonic, rd, rs1, imm);
+    return create_instruction_ast_node(parser->arena, mnemonic,
+                                       &rd, &rs1, NULL, &imm);
 }
 
-static struct stype_ast_node* stype_instruction(
+/* rs2, imm(rs1) */
+static struct instruction_ast_node* s_operands(
     struct parser* parser,
     struct token* mnemonic
 ) {
-    struct token* rs2 = expect(parser, TOKEN_IDENTIFIER);
+    struct token rs2 = expect(parser, TOKEN_IDENTIFIER);
     expect(parser, TOKEN_COMMA);
-    struct token* imm = expect(parser, TOKEN_NUMBER);
+    struct token imm = expect(parser, TOKEN_NUMBER);
     expect(parser, TOKEN_LEFT_PAREN);
-    struct token* rs1 = expect(parser, TOKEN_IDENTIFIER);
+    struct token rs1 = expect(parser, TOKEN_IDENTIFIER);
     expect(parser, TOKEN_RIGHT_PAREN);
 
-    return create_stype_ast_node(mnemonic, rs1, rs2, imm);
+    return create_instruction_ast_node(parser->arena, mnemonic,
+                                       NULL, &rs1, &rs2, &imm);
 }
 
-static struct utype_ast_node* utype_instruction(
+/* rs1, rs2, offset */
+static struct instruction_ast_node* b_operands(
     struct parser* parser,
     struct token* mnemonic
 ) {
-    struct token* rd = expect(parser, TOKEN_IDENTIFIER);
+    struct token rs1 = expect(parser, TOKEN_IDENTIFIER);
     expect(parser, TOKEN_COMMA);
-    struct token* imm = expect(parser, TOKEN_NUMBER);
+    struct token rs2 = expect(parser, TOKEN_IDENTIFIER);
+    expect(parser, TOKEN_COMMA);
+    struct token offset = expect(parser, TOKEN_NUMBER);
 
-    return create_utype_ast_node(mnemonic, rd, imm);
+    return create_instruction_ast_node(parser->arena, mnemonic,
+                                       NULL, &rs1, &rs2, &offset);
 }
 
-static struct ujtype_ast_node* ujtype_instruction(
+/* rd, imm */
+static struct instruction_ast_node* u_operands(
     struct parser* parser,
     struct token* mnemonic
 ) {
-    struct token* rd = expect(parser, TOKEN_IDENTIFIER);
+    struct token rd = expect(parser, TOKEN_IDENTIFIER);
     expect(parser, TOKEN_COMMA);
+    struct token imm = expect(parser, TOKEN_NUMBER);
 
-    struct token* offset = NULL;
+    return create_instruction_ast_node(parser->arena, mnemonic,
+                                       &rd, NULL, NULL, &imm);
+}
+
+/* rd, offset or function */
+static struct instruction_ast_node* j_operands(
+    struct parser* parser,
+    struct token* mnemonic
+) {
+    struct token rd = expect(parser, TOKEN_IDENTIFIER);
+    expect(parser, TOKEN_COMMA);
+
+    struct token offset;
     if (accept(parser, TOKEN_IDENTIFIER)) {
         offset = expect(parser, TOKEN_IDENTIFIER);
-        return create_ujtype_ast_node(mnemonic, rd, offset);
     }
+    else {
+        offset = expect(parser, TOKEN_NUMBER);
+    }
+    return create_instruction_ast_node(parser->arena, mnemonic,
+                                       &rd, NULL, NULL, &offset);
+}
 
-    offset = expect(parser, TOKEN_NUMBER);
-    return create_ujtype_ast_node(mnemonic, rd, offset);
+static struct instruction_ast_node* isa_instruction(
+    struct parser* parser,
+    struct token* mnemonic
+) {
+    enum isa_instruction instruction = symbol_isa_instruction(mnemonic->symbol);
+    switch (isa_descriptions[instruction].format) {
+    case ISA_FORMAT_R:
+        return r_operands(parser, mnemonic);
+    case ISA_FORMAT_I:
+    case ISA_FORMAT_I_SHAMT6:
+    case ISA_FORMAT_I_SHAMT5:
+        return i_operands(parser, mnemonic);
+    case ISA_FORMAT_I_OFFSET:
+        return i_offset_operands(parser, mnemonic);
+    case ISA_FORMAT_S:
+        return s_operands(parser, mnemonic);
+    case ISA_FORMAT_B:
+        return b_operands(parser, mnemonic);
+    case ISA_FORMAT_U:
+        return u_operands(parser, mnemonic);
+    case ISA_FORMAT_J:
+        return j_operands(parser, mnemonic);
+    }
+    fatal_error("unknown isa format");
 }
 
 static struct load_immediate_ast_node* load_immediate(struct parser* parser) {
-    struct token* rd = expect(parser, TOKEN_IDENTIFIER);
+    struct token rd = expect(parser, TOKEN_IDENTIFIER);
     expect(parser, TOKEN_COMMA);
-    struct token* imm = NULL;
+    struct token imm;
     if (accept(parser, TOKEN_IDENTIFIER)) {
         imm = expect(parser, TOKEN_IDENTIFIER);
-        return create_load_immediate_ast_node(rd, imm);
+        return create_load_immediate_ast_node(parser->arena, &rd, &imm);
     }
     imm = expect(parser, TOKEN_NUMBER);
-    return create_load_immediate_ast_node(rd, imm);
+    return create_load_immediate_ast_node(parser->arena, &rd, &imm);
 }
 
 static void* instruction(struct parser* parser) {
-    struct token* mnemonic = expect(parser, TOKEN_IDENTIFIER);
-    if (token_equals_c_str(mnemonic, "addi")) {
-        return itype_instruction(parser, mnemonic);
-    }
-    else if (token_equals_c_str(mnemonic, "addiw")) {
-        return itype_instruction(parser, mnemonic);
-    }
-    else if (token_equals_c_str(mnemonic, "auipc")) {
-        return utype_instruction(parser, mnemonic);
-    }
-    else if (token_equals_c_str(mnemonic, "jal")) {
-        return ujtype_instruction(parser, mnemonic);
-    }
-    else if (token_equals_c_str(mnemonic, "jalr")) {
-        return itype_instruction_paren(parser, mnemonic);
-    }
-    else if (token_equals_c_str(mnemonic, "lui")) {
-        return utype_instruction(parser, mnemonic);
-    }
-    else if (token_equals_c_str(mnemonic, "sb")) {
-        return stype_instruction(parser, mnemonic);
-    }
-    else if (token_equals_c_str(mnemonic, "sh")) {
-        return stype_instruction(parser, mnemonic);
-    }
-    else if (token_equals_c_str(mnemonic, "sw")) {
-        return stype_instruction(parser, mnemonic);
+    struct token mnemonic = expect(parser, TOKEN_IDENTIFIER);
+    if (symbol_is_isa_instruction(mnemonic.symbol)) {
+        return isa_instruction(parser, &mnemonic);
     }
-    else if (token_equals_c_str(mnemonic, "sd")) {
-        return stype_instruction(parser, mnemonic);
-    }
-    else if (token_equals_c_str(mnemonic, "li")) {
+    switch (mnemonic.symbol) {
+    case SYMBOL_LI:
         return load_immediate(parser);
+    case SYMBOL_LABEL: {
+        struct token name = expect(parser, TOKEN_IDENTIFIER);
+        return create_label_ast_node(parser->arena, &name);
     }
-    else if (token_equals_c_str(mnemonic, "label")) {
-        struct token* name = expect(parser, TOKEN_IDENTIFIER);
-        return create_label_ast_node(name);
-    }
-    else {
+    default: {
         char buffer[4096];
         snprintf(buffer, sizeof(buffer), "unknown instruction mnemonic '%.*s'",
-                 (int) mnemonic->str.size, mnemonic->str.data);
+                 (int) mnemonic.str.size, mnemonic.str.data);
         syntax_error(buffer);
     }
+    }
 }
 
 static struct instructions_ast_node* instructions(struct parser* parser) {
     struct instructions_ast_node* insts
-        = create_empty_instructions_ast_node();
+        = create_empty_instructions_ast_node(parser->arena);
 
     while (accept(parser, TOKEN_IDENTIFIER)) {
         void* node = instruction(parser);
         if (node != NULL) {
-            instructions_ast_node_push(insts, node);
+            instructions_ast_node_push(parser->arena, insts, node);
         }
     }
     return insts;
 }
 
 static struct executable_ast_node* executable(struct parser* parser) {
-    struct executable_ast_node* exec = create_empty_executable_ast_node();
+    struct executable_ast_node* exec
+        = create_empty_executable_ast_node(parser->arena);
 
-    struct token* output_path = expect(parser, TOKEN_STRING_LITERAL);
+    struct token output_path = expect(parser, TOKEN_STRING_LITERAL);
     exec->output_path = output_path;
 
     expect(parser, TOKEN_LEFT_CURLY_BRACKET);
 
     while(accept(parser, TOKEN_IDENTIFIER)) {
-        struct token* field = expect(parser, TOKEN_IDENTIFIER);
+        struct token field = expect(parser, TOKEN_IDENTIFIER);
         
-        if (token_equals_c_str(field, "address")) {
+        if (field.symbol == SYMBOL_ADDRESS) {
             expect(parser, TOKEN_LEFT_PAREN);
-            struct token* function = expect(parser, TOKEN_IDENTIFIER);
+            struct token function = expect(parser, TOKEN_IDENTIFIER);
             expect(parser, TOKEN_RIGHT_PAREN);
             expect(parser, TOKEN_COLON);
-            struct token* address = expect(parser, TOKEN_NUMBER);
+            struct token address = expect(parser, TOKEN_NUMBER);
 
-            executable_ast_node_add_address(exec, function, address);
+            executable_ast_node_add_address(parser->arena, exec,
+                                            &function, &address);
         }
-        else if (token_equals_c_str(field, "entry")) {
+        else if (field.symbol == SYMBOL_ENTRY) {
             expect(parser, TOKEN_COLON);
             exec->entry_token = expect(parser, TOKEN_IDENTIFIER);
         }
-        else if (token_equals_c_str(field, "code")) {
+        else if (field.symbol == SYMBOL_CODE) {
             expect(parser, TOKEN_COLON);
             exec->code_token = expect(parser, TOKEN_NUMBER);
         }
-        else if (token_equals_c_str(field, "files")) {
+        else if (field.symbol == SYMBOL_OUTPUT_FORMAT) {
+            expect(parser, TOKEN_COLON);
+            exec->output_format_token = expect(parser, TOKEN_IDENTIFIER);
+        }
+        else if (field.symbol == SYMBOL_FILES) {
             expect(parser, TOKEN_COLON);
             expect(parser, TOKEN_LEFT_SQUARE_BRACKET);
 
-            struct token* file = expect(parser, TOKEN_STRING_LITERAL);
-            executable_ast_node_add_file(exec, file);
+            struct token file = expect(parser, TOKEN_STRING_LITERAL);
+            executable_ast_node_add_file(exec, &file);
             while (accept(parser, TOKEN_COMMA)) {
                 expect(parser, TOKEN_COMMA);
                 if (!accept(parser, TOKEN_STRING_LITERAL)) {
                     break;
                 }
                 file = expect(parser, TOKEN_STRING_LITERAL);
-                executable_ast_node_add_file(exec, file);
+                executable_ast_node_add_file(exec, &file);
             }
 
             expect(parser, TOKEN_RIGHT_SQUARE_BRACKET);
@@ -261,7 +293,7 @@ static struct executable_ast_node* executable(struct parser* parser) {
 }
 
 static struct function_ast_node* function(struct parser* parser) {
-    struct token* name = expect(parser, TOKEN_IDENTIFIER);
+    struct token name = expect(parser, TOKEN_IDENTIFIER);
 
     expect(parser, TOKEN_LEFT_CURLY_BRACKET);
 
@@ -269,87 +301,127 @@ static struct function_ast_node* function(struct parser* parser) {
 
     expect(parser, TOKEN_RIGHT_CURLY_BRACKET);
 
-    struct function_ast_node* func = create_empty_function_ast_node();
+    struct function_ast_node* func
+        = create_empty_function_ast_node(parser->arena);
     func->name = name;
     func->insts = insts;
     return func;
 }
 
 static struct ast_node* data(struct parser* parser) {
-    struct token* name = expect(parser, TOKEN_IDENTIFIER);
+    struct token name = expect(parser, TOKEN_IDENTIFIER);
     expect(parser, TOKEN_COLON);
-    struct token* size_value = expect(parser, TOKEN_NUMBER);
-    struct token* size_suffix = expect(parser, TOKEN_IDENTIFIER);
+    struct token size_value = expect(parser, TOKEN_NUMBER);
+    struct token size_suffix = expect(parser, TOKEN_IDENTIFIER);
     return (struct ast_node*)
-           create_uninitialized_data_ast_node(name, size_value, size_suffix);
+           create_uninitialized_data_ast_node(parser->arena, &name,
+                                              &size_value, &size_suffix);
 }
 
-static struct unit_ast_node* unit(struct parser* parser) {
-    struct unit_ast_node* unit = create_empty_unit_ast_node();
-
+static void unit_items(struct parser* parser, struct unit_ast_node* unit) {
     while (accept(parser, TOKEN_IDENTIFIER)) {
-        struct token* keyword = expect(parser, TOKEN_IDENTIFIER);
-        if (token_equals_c_str(keyword, "executable")) {
+        struct token keyword = expect(parser, TOKEN_IDENTIFIER);
+        if (keyword.symbol == SYMBOL_EXECUTABLE) {
             struct executable_ast_node* e = executable(parser);
-            unit_ast_node_push(unit, (struct ast_node*) e);
+            unit_ast_node_push(parser->arena, unit, (struct ast_node*) e);
         }
-        else if (token_equals_c_str(keyword, "func")) {
+        else if (keyword.symbol == SYMBOL_FUNC) {
             struct function_ast_node* f = function(parser);
-            unit_ast_node_push(unit, (struct ast_node*) f);
+            unit_ast_node_push(parser->arena, unit, (struct ast_node*) f);
         }
-        else if (token_equals_c_str(keyword, "data")) {
-            unit_ast_node_push(unit, data(parser));
+        else if (keyword.symbol == SYMBOL_DATA) {
+            unit_ast_node_push(parser->arena, unit, data(parser));
         }
         else {
             char buffer[4096];
             snprintf(buffer, sizeof(buffer), "unknown keyword '%.*s'",
-                    (int) keyword->str.size, keyword->str.data);
+                    (int) keyword.str.size, keyword.str.data);
             syntax_error(buffer);
         }
     }
+}
+
+static struct unit_ast_node* unit(struct parser* parser) {
+    struct unit_ast_node* unit = create_empty_unit_ast_node(parser->arena);
+    unit_items(parser, unit);
     return unit;
 }
 
-struct instructions_ast_node* parse_instructions(struct tokens* tokens) {
+static void expect_end(struct parser* parser) {
+    if (parser->index != parser->tokens->length) {
+        struct token token = token_get(parser->tokens, parser->index);
+        char buffer[4096];
+        snprintf(buffer, sizeof(buffer), "expected end of input, got %s '%.*s'",
+                 token_kind_c_str(token.kind),
+                 (int) token.str.size, token.str.data);
+        syntax_error(buffer);
+    }
+}
+
+struct instructions_ast_node* parse_instructions(struct tokens* tokens,
+                                                struct arena* arena) {
     struct parser parser = {
         .tokens = tokens,
         .index = 0,
+        .arena = arena,
     };
 
     struct instructions_ast_node* insts = instructions(&parser);
 
-    if (parser.index != tokens->length) {
-        struct token* token = token_get(tokens, parser.index);
-        char buffer[4096];
-        snprintf(buffer, sizeof(buffer), "expected end of input, got %s '%.*s'",
-                 token_kind_c_str(token->kind),
-                 (int) token->str.size, token->str.data);
-        syntax_error(buffer);
-    }
+    expect_end(&parser);
 
-    ast_node_analyze((struct ast_node*) insts);
+    ast_node_analyze(arena, (struct ast_node*) insts);
 
     return insts;
 }
 
-struct ast_node* parse(struct tokens* tokens) {
+struct unit_ast_node* parse_unit(struct tokens* tokens, struct arena* arena) {
     struct parser parser = {
         .tokens = tokens,
         .index = 0,
+        .arena = arena,
     };
 
     struct unit_ast_node* node = unit(&parser);
 
-    if (parser.index != tokens->length) {
-        struct token* token = token_get(tokens, parser.index);
-        char buffer[4096];
-        snprintf(buffer, sizeof(buffer), "expected end of input, got %s '%.*s'",
-                 token_kind_c_str(token->kind),
-                 (int) token->str.size, token->str.data);
-        syntax_error(buffer);
-    }
+    expect_end(&parser);
 
-    ast_node_analyze((struct ast_node*) node);
+    return node;
+}
 
+struct ast_node* parse(struct tokens* tokens, struct arena* arena) {
+    struct unit_ast_node* node = parse_unit(tokens, arena);
+    ast_node_analyze(arena, (struct ast_node*) node);
     return (struct ast_node*) node;
 }
+
+uint64_t parse_unit_items(struct tokens* tokens,
+                          uint64_t index,
+                          bool end,
+                          struct arena* arena,
+                          struct unit_ast_node* unit) {
+    /* Curly brackets do not nest, so the last one closes a top level item
+       and every item before it has all of its tokens */
+    uint64_t length = tokens->length;
+    if (!end) {
+        while (length > index
+               && token_get_kind(tokens, length - 1)
+                  != TOKEN_RIGHT_CURLY_BRACKET) {
+            --length;
+        }
+    }
+    if (length == index) {
+        return index;
+    }
+
+    struct tokens view = *tokens;
+    view.length = length;
+    struct parser parser = {
+        .tokens = &view,
+        .index = index,
+        .arena = arena,
+    };
+    unit_items(&parser, unit);
+    expect_end(&parser);
+    return length;
+}
@@ -1,10 +1,23 @@
 #ifndef MALLARD_PARSER_H
 #define MALLARD_PARSER_H
 
+#include "arena.h"
 #include "ast_node.h"
 #include "tokens.h"
 
-struct instructions_ast_node* parse_instructions(struct tokens* tokens);
-struct ast_node* parse(struct tokens* tokens);
+/* The returned nodes live as long as the arena */
+struct instructions_ast_node* parse_instructions(struct tokens* tokens,
+                                                struct arena* arena);
+struct ast_node* parse(struct tokens* tokens, struct arena* arena);
+/* Parses without analysis, so each node can be analyzed separately */
+struct unit_ast_node* parse_unit(struct tokens* tokens, struct arena* arena);
+/* Parses the items of a unit that is still being lexed, starting at index,
+   into unit. Only items known to be complete are parsed, unless it is the
+   end of the input. Returns the index after the last item parsed. */
+uint64_t parse_unit_items(struct tokens* tokens,
+                          uint64_t index,
+                          bool end,
+                          struct arena* arena,
+                          struct unit_ast_node* unit);
 
 #endif /* ifndef MALLARD_PARSER_H */
@@ -0,0 +1,549 @@
+#include "serve.h"
+
+#include "alloc.h"
+#include "ansi.h"
+#include "cache.h"
+#include "fatal_error.h"
+#include "file.h"
+#include "lexer.h"
+#include "parser.h"
+#include "str_table.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SERVE_LINE_SIZE 256
+/* How long a client has to send its whole command, in milliseconds */
+#define SERVE_CLIENT_TIMEOUT 1000
+
+/* One file listed by the unit, with its last assembled object */
+struct serve_file {
+    const char* path;
+    /* Within path, events name the file in its watched directory */
+    const char* name;
+    int watch;
+    bool changed;
+    struct cache_key key;
+    /* NULL until the file is first assembled. The object's names and code
+       point into the image. */
+    struct elf_file* elf_file;
+    struct str image;
+    struct elf_object object;
+};
+
+/* The parsed unit and its files, replaced when the unit itself changes */
+struct serve_unit {
+    struct str source;
+    struct arena* arena;
+    struct tokens tokens;
+    struct unit_ast_node* unit;
+    /* Finds a file listed by several executables */
+    struct str_table* file_table;
+    struct serve_file* files;
+    uint64_t files_length;
+    /* Each executable's files in order, one after another */
+    struct serve_file** executable_files;
+};
+
+struct serve_state {
+    const struct compile_options* options;
+    const char* unit_path;
+    const char* unit_name;
+    int unit_watch;
+    bool unit_changed;
+    /* Every object interns into the same table, so symbols stay equal
+       across rebuilds */
+    struct symbol_table* symbols;
+    /* Watches are kept for the server's life, a directory is only watched
+       once however many units list it */
+    int inotify;
+    struct serve_unit current;
+    bool built;
+
+    /* A build that fails leaves the last objects and outputs in place. What
+       the build allocated is kept here until the handler frees it. */
+    struct fatal_error_context error;
+    struct serve_unit loading;
+    struct serve_file* updating;
+    struct str updating_source;
+    struct compile_relocatable relocatable;
+    struct elf_file** elf_files;
+    struct file_write* writes;
+    struct iovec* iovs;
+    struct vector* encoded;
+    uint64_t outputs_length;
+};
+
+static const char* serve_name(const char* path) {
+    const char* slash = strrchr(path, '/');
+    return slash == NULL ? path : slash + 1;
+}
+
+/* Watches the directory rather than the file, editors often save by
+   renaming a new file over the old one */
+static int serve_watch(struct serve_state* state, const char* path) {
+    const char* name = serve_name(path);
+    char* dir = NULL;
+    if (name == path) {
+        dir = xstrdup(".");
+    }
+    else if (name == path + 1) {
+        dir = xstrdup("/");
+    }
+    else {
+        dir = xstrndup(path, name - path - 1);
+    }
+    int watch = inotify_add_watch(state->inotify, dir,
+                                  IN_CLOSE_WRITE | IN_MOVED_TO);
+    free(dir);
+    if (watch == -1) {
+        fatal_error("serve watch failed");
+    }
+    return watch;
+}
+
+/* Parses the unit into loading, which starts zeroed. An error partway
+   leaves loading for serve_unit_free. */
+static void serve_unit_load(struct serve_state* state,
+                            struct serve_unit* loading) {
+    loading->source = file_open_read_mmap(state->unit_path);
+    loading->arena = arena_create();
+    token_init(&loading->tokens, NULL, state->symbols);
+    lex_reuse(&loading->tokens, &loading->source);
+    struct ast_node* node = parse(&loading->tokens, loading->arena);
+    if (!is_unit_ast_node(node)) {
+        fatal_error("expected unit ast node");
+    }
+    struct unit_ast_node* unit = (struct unit_ast_node*) node;
+    loading->unit = unit;
+    uint64_t files_length = compile_check_executables(unit);
+
+    loading->files = xcalloc(files_length + 1, sizeof(struct serve_file));
+    loading->executable_files = xcalloc(files_length + 1,
+                                        sizeof(struct serve_file*));
+    loading->file_table = str_table_create();
+    uint64_t executable_files_length = 0;
+    for (uint64_t i = 0; i < unit->length; ++i) {
+        struct executable_ast_node* exec
+            = (struct executable_ast_node*) unit->ast_nodes[i];
+        for (uint64_t j = 0; j < exec->files_length; ++j) {
+            struct str* path = &exec->files[j].str;
+            struct str_table_entry* entry
+                = str_table_get(loading->file_table, path);
+            struct serve_file* file = NULL;
+            if (entry != NULL) {
+                file = entry->val;
+            }
+            else {
+                file = &loading->files[loading->files_length++];
+                file->path = compile_path(state->options, path);
+                file->name = serve_name(file->path);
+                file->watch = serve_watch(state, file->path);
+                file->changed = true;
+                str_table_insert(loading->file_table, path, file);
+            }
+            loading->executable_files[executable_files_length++] = file;
+        }
+    }
+}
+
+static void serve_unit_free(struct serve_unit* unit) {
+    for (uint64_t i = 0; i < unit->files_length; ++i) {
+        struct serve_file* file = &unit->files[i];
+        if (file->elf_file != NULL) {
+            elf_object_free(&file->object);
+            elf_file_destroy(file->elf_file);
+        }
+        free((void*) file->path);
+    }
+    free(unit->executable_files);
+    free(unit->files);
+    if (unit->file_table != NULL) {
+        str_table_destroy(unit->file_table);
+    }
+    if (unit->arena != NULL) {
+        arena_destroy(unit->arena);
+    }
+    token_free(&unit->tokens);
+    if (unit->source.data != NULL) {
+        file_close_mmap(&unit->source);
+    }
+    memset(unit, 0, sizeof(struct serve_unit));
+}
+
+/* Assembles the file again if its contents changed, returns whether they
+   did */
+static bool serve_update_file(struct serve_state* state,
+                              struct serve_file* file) {
+    struct str* source = &state->updating_source;
+    *source = file_open_read_mmap(file->path);
+    struct cache_key key = cache_key(source);
+    if (file->elf_file != NULL && key.high == file->key.high
+        && key.low == file->key.low) {
+        file_close_mmap(source);
+        return false;
+    }
+    struct elf_file* elf_file = compile_relocatable(source, state->symbols,
+                                                    NULL,
+                                                    &state->relocatable);
+    file_close_mmap(source);
+    if (file->elf_file != NULL) {
+        elf_object_free(&file->object);
+        elf_file_destroy(file->elf_file);
+    }
+    file->elf_file = elf_file;
+    file->key = key;
+    struct vector* image = elf_file_image(elf_file);
+    file->image.data = image->data;
+    file->image.size = image->size;
+    elf_object_read(&file->object, &file->image, state->symbols);
+    return true;
+}
+
+static void serve_outputs_free(struct serve_state* state) {
+    for (uint64_t i = 0; i < state->outputs_length; ++i) {
+        free((void*) state->writes[i].path);
+        free(state->encoded[i].data);
+        if (state->elf_files[i] != NULL) {
+            elf_file_destroy(state->elf_files[i]);
+        }
+    }
+    free(state->encoded);
+    free(state->iovs);
+    free(state->writes);
+    free(state->elf_files);
+    state->encoded = NULL;
+    state->iovs = NULL;
+    state->writes = NULL;
+    state->elf_files = NULL;
+    state->outputs_length = 0;
+}
+
+/* Lays out and writes every executable again from the objects in memory,
+   only the changed files are assembled. Returns false with the message in
+   the state's error when the unit or a file has an error. */
+static bool serve_build(struct serve_state* state) {
+    /* Builds run on this thread so errors come back here, whatever failed
+       is tried again on the next build */
+    struct fatal_error_context* previous
+        = fatal_error_set_context(&state->error);
+    if (setjmp(state->error.jump) != 0) {
+        fatal_error_set_context(previous);
+        serve_unit_free(&state->loading);
+        if (state->updating != NULL) {
+            state->updating->changed = true;
+            state->updating = NULL;
+        }
+        if (state->updating_source.data != NULL) {
+            file_close_mmap(&state->updating_source);
+        }
+        compile_relocatable_free(&state->relocatable);
+        serve_outputs_free(state);
+        state->built = false;
+        return false;
+    }
+
+    /* The old unit and its objects stay until the new one parses */
+    if (state->unit_changed) {
+        serve_unit_load(state, &state->loading);
+        serve_unit_free(&state->current);
+        state->current = state->loading;
+        memset(&state->loading, 0, sizeof(struct serve_unit));
+        state->unit_changed = false;
+        state->built = false;
+    }
+
+    bool changed = false;
+    for (uint64_t i = 0; i < state->current.files_length; ++i) {
+        struct serve_file* file = &state->current.files[i];
+        if (file->changed) {
+            file->changed = false;
+            state->updating = file;
+            changed |= serve_update_file(state, file);
+            state->updating = NULL;
+        }
+    }
+    if (state->built && !changed) {
+        fatal_error_set_context(previous);
+        return true;
+    }
+
+    struct unit_ast_node* unit = state->current.unit;
+    state->elf_files = xcalloc(unit->length, sizeof(struct elf_file*));
+    state->writes = xcalloc(unit->length, sizeof(struct file_write));
+    state->iovs = xcalloc(unit->length, sizeof(struct iovec));
+    state->encoded = xcalloc(unit->length, sizeof(struct vector));
+    state->outputs_length = unit->length;
+    struct serve_file** executable_files = state->current.executable_files;
+    for (uint64_t i = 0; i < unit->length; ++i) {
+        struct executable_ast_node* exec
+            = (struct executable_ast_node*) unit->ast_nodes[i];
+        struct elf_file* elf_file = elf_create_empty();
+        state->elf_files[i] = elf_file;
+        elf_file_set_code_start(elf_file, exec->code_address);
+        for (uint64_t j = 0; j < exec->files_length; ++j) {
+            elf_add_relocatable(elf_file, &executable_files[j]->object);
+        }
+        executable_files += exec->files_length;
+        elf_file_set_addresses(elf_file, exec->addresses,
+                               exec->addresses_length);
+        elf_file_set_entry(elf_file, &exec->entry_token);
+        elf_file_finalize(elf_file, NULL);
+        state->iovs[i] = compile_output(exec, elf_file, &state->encoded[i]);
+        state->writes[i].path = str_to_c_str(&exec->output_path.str);
+        state->writes[i].iov = &state->iovs[i];
+        state->writes[i].iov_length = 1;
+    }
+    file_write_batch(state->writes, unit->length);
+    serve_outputs_free(state);
+    state->built = true;
+    fatal_error_set_context(previous);
+    return true;
+}
+
+/* Builds after an edit, with no client to tell the error to */
+static void serve_build_report(struct serve_state* state) {
+    if (!serve_build(state)) {
+        dprintf(2, ANSI_BOLD_RED "%s:" ANSI_RESET " " ANSI_RED "%s"
+                   ANSI_RESET "\n",
+                state->error.syntax ? "syntax error" : "error",
+                state->error.message);
+    }
+}
+
+/* Marks the files named by pending events, returns whether there were
+   any */
+static bool serve_read_events(struct serve_state* state) {
+    bool any = false;
+    _Alignas(struct inotify_event) char buffer[4096];
+    for (;;) {
+        ssize_t size = read(state->inotify, buffer, sizeof(buffer));
+        if (size == -1 && errno == EINTR) {
+            continue;
+        }
+        if (size == -1 && errno == EAGAIN) {
+            return any;
+        }
+        if (size <= 0) {
+            fatal_error("serve inotify read failed");
+        }
+        for (char* data = buffer; data < buffer + size;) {
+            struct inotify_event* event = (struct inotify_event*) data;
+            data += sizeof(struct inotify_event) + event->len;
+            if (event->len == 0) {
+                continue;
+            }
+            if (event->wd == state->unit_watch
+                && strcmp(event->name, state->unit_name) == 0) {
+                state->unit_changed = true;
+                any = true;
+            }
+            for (uint64_t i = 0; i < state->current.files_length; ++i) {
+                struct serve_file* file = &state->current.files[i];
+                if (event->wd == file->watch
+                    && strcmp(event->name, file->name) == 0) {
+                    file->changed = true;
+                    any = true;
+                }
+            }
+        }
+    }
+}
+
+static uint64_t serve_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* Reads up to the first newline, giving up after timeout milliseconds
+   unless it is negative, returns whether the whole line arrived */
+static bool serve_read_line(int fd, char* line, uint64_t size, int timeout) {
+    uint64_t deadline = serve_now() + (uint64_t) timeout * 1000000;
+    uint64_t length = 0;
+    bool complete = false;
+    while (!complete && length + 1 < size) {
+        if (timeout >= 0) {
+            uint64_t now = serve_now();
+            struct pollfd pollfd = { .fd = fd, .events = POLLIN };
+            int ready = poll(&pollfd, 1,
+                             now < deadline ? (deadline - now) / 1000000 : 0);
+            if (ready == -1 && errno == EINTR) {
+                continue;
+            }
+            if (ready <= 0) {
+                break;
+            }
+        }
+        ssize_t result = read(fd, line + length, size - 1 - length);
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            break;
+        }
+        char* newline = memchr(line + length, '\n', result);
+        if (newline != NULL) {
+            length = newline - line;
+            complete = true;
+        }
+        else {
+            length += result;
+        }
+    }
+    line[length] = '\0';
+    return complete;
+}
+
+static void serve_reply(int fd, const char* reply) {
+    /* A client that already left only loses its reply */
+    send(fd, reply, strlen(reply), MSG_NOSIGNAL);
+}
+
+/* Answers one client, returns false when it stops the server */
+static bool serve_client(struct serve_state* state, int listener) {
+    int fd = accept(listener, NULL, NULL);
+    if (fd == -1) {
+        return true;
+    }
+    char line[SERVE_LINE_SIZE];
+    if (!serve_read_line(fd, line, sizeof(line), SERVE_CLIENT_TIMEOUT)) {
+        /* A client that stalls or sends too much is dropped, so it cannot
+           hold up the watch */
+        file_close(fd);
+        return true;
+    }
+    bool running = true;
+    if (strcmp(line, "build") == 0) {
+        /* Any write the client made before asking already queued its
+           event */
+        uint64_t start = serve_now();
+        serve_read_events(state);
+        char reply[sizeof(state->error.message) + 16];
+        if (serve_build(state)) {
+            snprintf(reply, sizeof(reply), "ok %lu us\n",
+                     (unsigned long) ((serve_now() - start) / 1000));
+        }
+        else {
+            snprintf(reply, sizeof(reply), "error %s\n",
+                     state->error.message);
+        }
+        serve_reply(fd, reply);
+    }
+    else if (strcmp(line, "stop") == 0) {
+        serve_reply(fd, "ok\n");
+        running = false;
+    }
+    else {
+        serve_reply(fd, "error unknown command\n");
+    }
+    file_close(fd);
+    return running;
+}
+
+static void serve_address(struct sockaddr_un* address,
+                          const char* socket_path) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path)) {
+        fatal_error("socket path is too long");
+    }
+    strcpy(address->sun_path, socket_path);
+}
+
+void serve(const char* unit_path,
+           const char* socket_path,
+           const struct compile_options* options) {
+    struct sockaddr_un address;
+    serve_address(&address, socket_path);
+    /* A server that did not stop cleanly leaves its socket behind */
+    unlink(socket_path);
+    /* Non-blocking, so a client that leaves before accept cannot hang it */
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                          0);
+    if (listener == -1) {
+        fatal_error("serve socket failed");
+    }
+    if (bind(listener, (struct sockaddr*) &address, sizeof(address)) == -1
+        || listen(listener, 16) == -1) {
+        fatal_error("serve listen failed");
+    }
+
+    struct serve_state state = {
+        .options = options,
+        .unit_path = unit_path,
+        .symbols = symbol_table_create(),
+    };
+    state.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (state.inotify == -1) {
+        fatal_error("serve inotify failed");
+    }
+    state.unit_name = serve_name(unit_path);
+    state.unit_watch = serve_watch(&state, unit_path);
+    /* The first build loads the unit, a unit with an error is loaded once
+       it is fixed */
+    state.unit_changed = true;
+    serve_build_report(&state);
+
+    bool running = true;
+    while (running) {
+        struct pollfd fds[2] = {
+            { .fd = state.inotify, .events = POLLIN },
+            { .fd = listener, .events = POLLIN },
+        };
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fatal_error("serve poll failed");
+        }
+        if ((fds[0].revents & POLLIN) && serve_read_events(&state)) {
+            serve_build_report(&state);
+        }
+        if (fds[1].revents & POLLIN) {
+            running = serve_client(&state, listener);
+        }
+    }
+
+    serve_unit_free(&state.current);
+    file_close(state.inotify);
+    symbol_table_destroy(state.symbols);
+    file_close(listener);
+    unlink(socket_path);
+}
+
+bool serve_request(const char* socket_path,
+                   const char* command,
+                   char* reply,
+                   uint64_t reply_size) {
+    struct sockaddr_un address;
+    serve_address(&address, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        fatal_error("serve socket failed");
+    }
+    /* The server may still be starting, give it a second to listen */
+    for (uint64_t attempt = 0;; ++attempt) {
+        if (connect(fd, (struct sockaddr*) &address, sizeof(address)) == 0) {
+            break;
+        }
+        if ((errno != ENOENT && errno != ECONNREFUSED) || attempt == 100) {
+            fatal_error("serve connect failed");
+        }
+        usleep(10000);
+    }
+    char line[SERVE_LINE_SIZE];
+    snprintf(line, sizeof(line), "%s\n", command);
+    serve_reply(fd, line);
+    serve_read_line(fd, reply, reply_size, -1);
+    file_close(fd);
+    return strcmp(reply, "ok") == 0 || strncmp(reply, "ok ", 3) == 0;
+}
@@ -0,0 +1,26 @@
+#ifndef MALLARD_SERVE_H
+#define MALLARD_SERVE_H
+
+#include "compile.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Builds the unit at unit_path, then keeps every file's object in memory
+   and rebuilds the executables whenever a file changes. Clients connect to
+   a Unix socket at socket_path and send one line, "build" waits until the
+   outputs are up to date and "stop" ends the server. An error in the unit
+   or a file is reported and the server keeps running with the last good
+   build, builds use one thread so errors are caught. */
+void serve(const char* unit_path,
+           const char* socket_path,
+           const struct compile_options* options);
+
+/* Sends command to the server and stores its one line reply, without the
+   newline. Returns false when the reply is not "ok". */
+bool serve_request(const char* socket_path,
+                   const char* command,
+                   char* reply,
+                   uint64_t reply_size);
+
+#endif /* ifndef MALLARD_SERVE_H */
@@ -1,108 +1,211 @@
 #include "str_table.h"
 
+#include "alloc.h"
 #include "fatal_error.h"
-#include "vector.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define STR_TABLE_SLOTS_MIN 16
+
+/* A slot refers to an entry, the low bits of the hash are kept alongside so
+   most mismatches never touch the key */
+struct str_table_slot {
+    uint32_t hash;
+    /* Index into entries plus one, 0 is an empty slot */
+    uint32_t entry;
+};
+
+/* Robin hood hashing: an insert takes the slot of any entry that is closer
+   to its home slot, which keeps every probe sequence short */
 struct str_table {
-    struct vector vector;
-    uint64_t entries_size;
+    /* Dense, in insertion order */
+    struct str_table_entry* entries;
+    uint64_t* hashes;
+    uint64_t entries_length;
     uint64_t entries_capacity;
+
+    struct str_table_slot* slots;
+    uint64_t slots_capacity;
 };
 
-struct str_table* str_table_create() {
-    struct str_table* str_table = calloc(1, sizeof(struct str_table));
-    if (str_table == NULL) {
-        fatal_error("out of memory");
+static uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCD;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53;
+    h ^= h >> 33;
+    return h;
+}
+
+/* Consumes 8 bytes at a time instead of one */
+static uint64_t hash(struct str* key) {
+    uint8_t* data = key->data;
+    uint64_t size = key->size;
+    uint64_t h = 0x9E3779B97F4A7C15 ^ size;
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        h = (h ^ word) * 0xBF58476D1CE4E5B9;
+        h ^= h >> 31;
+        data += 8;
+        size -= 8;
     }
-    str_table->entries_capacity = 1024;
-    str_table->vector.capacity
-        = str_table->entries_capacity * sizeof(struct str_table_entry);
-    str_table->vector.data = calloc(1, str_table->vector.capacity);
-    if (str_table->vector.data == NULL) {
-        fatal_error("out of memory");
+    uint64_t word = 0;
+    memcpy(&word, data, size);
+    return mix(h ^ word);
+}
+
+static uint64_t probe_distance(struct str_table* str_table,
+                               uint64_t h,
+                               uint64_t index) {
+    uint64_t mask = str_table->slots_capacity - 1;
+    return (index - (h & mask)) & mask;
+}
+
+static void slots_place(struct str_table* str_table,
+                        struct str_table_slot slot) {
+    uint64_t mask = str_table->slots_capacity - 1;
+    uint64_t index = slot.hash & mask;
+    uint64_t distance = 0;
+    while (str_table->slots[index].entry != 0) {
+        struct str_table_slot* current = &str_table->slots[index];
+        uint64_t current_distance
+            = probe_distance(str_table, current->hash, index);
+        if (current_distance < distance) {
+            struct str_table_slot displaced = *current;
+            *current = slot;
+            slot = displaced;
+            distance = current_distance;
+        }
+        index = (index + 1) & mask;
+        ++distance;
     }
-    str_table->vector.size = str_table->vector.capacity;
-    str_table->entries_size = 0;
+    str_table->slots[index] = slot;
+}
 
+static void slots_resize(struct str_table* str_table, uint64_t capacity) {
+    free(str_table->slots);
+    str_table->slots = xcalloc(capacity, sizeof(struct str_table_slot));
+    str_table->slots_capacity = capacity;
+    for (uint64_t i = 0; i < str_table->entries_length; ++i) {
+        struct str_table_slot slot = {
+            .hash = str_table->hashes[i],
+            .entry = i + 1,
+        };
+        slots_place(str_table, slot);
+    }
+}
+
+struct str_table* str_table_create() {
+    struct str_table* str_table = xcalloc(1, sizeof(struct str_table));
+    slots_resize(str_table, STR_TABLE_SLOTS_MIN);
     return str_table;
 }
 
-static uint64_t hash(struct str* key) {
-    uint64_t h = 5381;
-    for (uint64_t i = 0; i < key->size; ++i) {
-        uint8_t byte = key->data[i];
-        h = ((h << 5) + h) + byte; 
+void str_table_destroy(struct str_table* str_table) {
+    free(str_table->slots);
+    free(str_table->hashes);
+    free(str_table->entries);
+    free(str_table);
+}
+
+static struct str_table_slot* slots_find(struct str_table* str_table,
+                                         struct str* key,
+                                         uint64_t h) {
+    uint64_t mask = str_table->slots_capacity - 1;
+    uint64_t index = h & mask;
+    uint64_t distance = 0;
+    while (true) {
+        struct str_table_slot* slot = &str_table->slots[index];
+        if (slot->entry == 0) {
+            return NULL;
+        }
+        /* An entry this far from home would have been placed here */
+        if (probe_distance(str_table, slot->hash, index) < distance) {
+            return NULL;
+        }
+        if (slot->hash == (uint32_t) h) {
+            struct str* other = str_table->entries[slot->entry - 1].key;
+            if (other->size == key->size
+                && memcmp(other->data, key->data, key->size) == 0) {
+                return slot;
+            }
+        }
+        index = (index + 1) & mask;
+        ++distance;
     }
-    return h;
 }
 
 void str_table_insert(struct str_table* str_table,
                       struct str* key,
                       void* val) {
-    uint64_t index = hash(key) % str_table->entries_capacity;
-    struct str_table_entry* data
-        = (struct str_table_entry*) str_table->vector.data;
-    struct str_table_entry* entry = &data[index];
-    if (entry->key != NULL) {
-        fatal_error("unhandled collision");
+    uint64_t h = hash(key);
+    if (slots_find(str_table, key, h) != NULL) {
+        fatal_error("duplicate key");
+    }
+    if (str_table->entries_length == UINT32_MAX) {
+        fatal_error("too many keys");
+    }
+
+    if (str_table->entries_length == str_table->entries_capacity) {
+        uint64_t capacity = str_table->entries_capacity == 0
+                            ? STR_TABLE_SLOTS_MIN
+                            : str_table->entries_capacity * 2;
+        str_table->entries = xrealloc(
+            str_table->entries,
+            capacity * sizeof(struct str_table_entry)
+        );
+        str_table->hashes = xrealloc(str_table->hashes,
+                                     capacity * sizeof(uint64_t));
+        str_table->entries_capacity = capacity;
     }
-    entry->key = key;
-    entry->val = val;
+    uint64_t index = str_table->entries_length;
+    str_table->entries[index].key = key;
+    str_table->entries[index].val = val;
+    str_table->hashes[index] = h;
+    ++(str_table->entries_length);
 
-    ++(str_table->entries_size);
+    /* Keep the load factor at or below seven eighths */
+    if (str_table->entries_length * 8 > str_table->slots_capacity * 7) {
+        slots_resize(str_table, str_table->slots_capacity * 2);
+        return;
+    }
+    struct str_table_slot slot = {
+        .hash = h,
+        .entry = index + 1,
+    };
+    slots_place(str_table, slot);
 }
 
 uint64_t str_table_size(struct str_table* str_table) {
-    return str_table->entries_size;
+    return str_table->entries_length;
 }
 
 struct str_table_entry* str_table_get(struct str_table* str_table,
                                       struct str* key) {
-    uint64_t index = hash(key) % str_table->entries_capacity;
-    struct str_table_entry* data
-        = (struct str_table_entry*) str_table->vector.data;
-    struct str_table_entry* entry = &data[index];
-    if (entry->key == NULL) {
+    struct str_table_slot* slot = slots_find(str_table, key, hash(key));
+    if (slot == NULL) {
         return NULL;
     }
-    /* TODO: More unhandled collisions */
-    if (entry->key->size != key->size) {
-        return NULL;
-    }
-    if (memcmp(entry->key->data, key->data, key->size) == 0) {
-        return entry;
-    }
-    return NULL;
+    return &str_table->entries[slot->entry - 1];
 }
 
 struct str_table_entry* str_table_iterator(struct str_table* str_table) {
-    struct str_table_entry* entry
-        = (struct str_table_entry*) str_table->vector.data;
-    for (uint64_t i = 0; i < str_table->entries_capacity; ++i) {
-        if (entry[i].key != NULL) {
-            return &entry[i];
-        }
+    if (str_table->entries_length == 0) {
+        return NULL;
     }
-    return NULL;
+    return &str_table->entries[0];
 }
 
 void str_table_iterator_next(struct str_table* str_table,
                              struct str_table_entry** iterator) {
-    struct str_table_entry* entry = *iterator;
-    while (1) {
-        ++entry;
-        if (((uint8_t*) entry)
-            >= (str_table->vector.data + str_table->vector.capacity)) {
-            break;
-        }
-        if (entry->key != NULL) {
-            *iterator = entry;
-            return;
-        }
+    struct str_table_entry* next = *iterator + 1;
+    if (next == str_table->entries + str_table->entries_length) {
+        *iterator = NULL;
+        return;
     }
-    *iterator = NULL;
+    *iterator = next;
 }
@@ -10,7 +10,10 @@ struct str_table_entry {
     void* val;
 };
 
+/* Entries are kept in insertion order. Pointers to entries are valid until
+   the next insert. */
 struct str_table* str_table_create();
+void str_table_destroy(struct str_table* str_table);
 void str_table_insert(struct str_table* str_table,
                       struct str* key,
                       void* val);
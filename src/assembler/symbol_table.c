@@ -0,0 +1,271 @@
+#include "symbol_table.h"
+
+#include "alloc.h"
+#include "fatal_error.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SYMBOL_TABLE_CHUNK_SIZE (64 * 1024)
+#define SYMBOL_TABLE_SEGMENT_BITS 8
+#define SYMBOL_TABLE_SEGMENTS 25
+
+struct symbol_table_entry {
+    uint64_t hash;
+    struct str str;
+};
+
+/* Identifier bytes are copied into chunks so symbols outlive their input */
+struct symbol_table_chunk {
+    struct symbol_table_chunk* next;
+    uint64_t size;
+    uint64_t capacity;
+    uint8_t data[];
+};
+
+struct symbol_table {
+    /* Indexed by symbol. Segment k holds 2^(8 + k) entries, segments never
+       move so readers are unaffected by symbols being added. */
+    struct symbol_table_entry* segments[SYMBOL_TABLE_SEGMENTS];
+    uint64_t entries_length;
+
+    /* Open addressing with linear probing, each slot holds a symbol and
+       SYMBOL_NONE marks an empty slot */
+    uint32_t* slots;
+    uint64_t slots_capacity;
+
+    struct symbol_table_chunk* chunks;
+
+    /* Held by symbol_table_intern_table */
+    pthread_mutex_t mutex;
+};
+
+#define SYMBOL_NAME(name, str, ...) str,
+#define SYMBOL_ISA_NAME(name, mnemonic, ...) #mnemonic,
+
+static const char* predefined_symbols[SYMBOL_PREDEFINED_LENGTH] = {
+    "",
+    SYMBOL_KEYWORDS(SYMBOL_NAME)
+    SYMBOL_PSEUDO_MNEMONICS(SYMBOL_NAME)
+    SYMBOL_REGISTERS(SYMBOL_NAME)
+    ISA_INSTRUCTIONS(SYMBOL_ISA_NAME)
+};
+
+#undef SYMBOL_ISA_NAME
+#undef SYMBOL_NAME
+
+static struct symbol_table_entry* symbol_table_entry(
+    struct symbol_table* symbol_table,
+    uint64_t symbol
+) {
+    uint64_t index = symbol + (1 << SYMBOL_TABLE_SEGMENT_BITS);
+    uint64_t segment = 63 - __builtin_clzll(index) - SYMBOL_TABLE_SEGMENT_BITS;
+    uint64_t start = (uint64_t) 1 << (segment + SYMBOL_TABLE_SEGMENT_BITS);
+    return &symbol_table->segments[segment][index - start];
+}
+
+static uint64_t hash(uint8_t* data, uint64_t size) {
+    /* FNV-1a */
+    uint64_t h = 0xCBF29CE484222325;
+    for (uint64_t i = 0; i < size; ++i) {
+        h ^= data[i];
+        h *= 0x100000001B3;
+    }
+    return h;
+}
+
+static uint8_t* symbol_table_copy(struct symbol_table* symbol_table,
+                                  uint8_t* data,
+                                  uint64_t size) {
+    struct symbol_table_chunk* chunk = symbol_table->chunks;
+    if (chunk == NULL || (chunk->size + size) > chunk->capacity) {
+        uint64_t capacity = SYMBOL_TABLE_CHUNK_SIZE;
+        if (capacity < size) {
+            capacity = size;
+        }
+        chunk = xmalloc(sizeof(struct symbol_table_chunk) + capacity);
+        chunk->next = symbol_table->chunks;
+        chunk->size = 0;
+        chunk->capacity = capacity;
+        symbol_table->chunks = chunk;
+    }
+    uint8_t* copy = chunk->data + chunk->size;
+    memcpy(copy, data, size);
+    chunk->size += size;
+    return copy;
+}
+
+static void symbol_table_slots_resize(struct symbol_table* symbol_table,
+                                      uint64_t capacity) {
+    uint32_t* slots = xcalloc(capacity, sizeof(uint32_t));
+    uint64_t mask = capacity - 1;
+    for (uint64_t symbol = 1; symbol < symbol_table->entries_length; ++symbol) {
+        uint64_t index = symbol_table_entry(symbol_table, symbol)->hash & mask;
+        while (slots[index] != SYMBOL_NONE) {
+            index = (index + 1) & mask;
+        }
+        slots[index] = symbol;
+    }
+    free(symbol_table->slots);
+    symbol_table->slots = slots;
+    symbol_table->slots_capacity = capacity;
+}
+
+static uint32_t symbol_table_push(struct symbol_table* symbol_table,
+                                  uint64_t h,
+                                  uint8_t* data,
+                                  uint64_t size) {
+    if (symbol_table->entries_length == UINT32_MAX) {
+        fatal_error("too many symbols");
+    }
+    uint32_t symbol = symbol_table->entries_length;
+    /* A symbol at the start of a segment needs the segment allocated, unless
+       it was kept by symbol_table_truncate */
+    uint64_t index = (uint64_t) symbol + (1 << SYMBOL_TABLE_SEGMENT_BITS);
+    if ((index & (index - 1)) == 0) {
+        uint64_t segment = 63 - __builtin_clzll(index)
+                           - SYMBOL_TABLE_SEGMENT_BITS;
+        if (symbol_table->segments[segment] == NULL) {
+            symbol_table->segments[segment]
+                = xmalloc(index * sizeof(struct symbol_table_entry));
+        }
+    }
+    struct symbol_table_entry* entry = symbol_table_entry(symbol_table, symbol);
+    entry->hash = h;
+    entry->str.data = symbol_table_copy(symbol_table, data, size);
+    entry->str.size = size;
+    /* Publishes the entry to symbol_table_str on other threads */
+    __atomic_store_n(&symbol_table->entries_length, symbol + 1,
+                     __ATOMIC_RELEASE);
+    return symbol;
+}
+
+struct symbol_table* symbol_table_create(void) {
+    struct symbol_table* symbol_table
+        = xcalloc(1, sizeof(struct symbol_table));
+    pthread_mutex_init(&symbol_table->mutex, NULL);
+    symbol_table_slots_resize(symbol_table, 512);
+
+    /* SYMBOL_NONE only takes up its index, it is never looked up */
+    symbol_table_push(symbol_table, 0, (uint8_t*) "", 0);
+    for (uint32_t i = 1; i < SYMBOL_PREDEFINED_LENGTH; ++i) {
+        const char* c_str = predefined_symbols[i];
+        uint32_t symbol = symbol_table_intern(symbol_table, (uint8_t*) c_str,
+                                              strlen(c_str));
+        if (symbol != i) {
+            fatal_error("predefined symbols must be unique");
+        }
+    }
+
+    return symbol_table;
+}
+
+void symbol_table_destroy(struct symbol_table* symbol_table) {
+    struct symbol_table_chunk* chunk = symbol_table->chunks;
+    while (chunk != NULL) {
+        struct symbol_table_chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    for (uint64_t i = 0; i < SYMBOL_TABLE_SEGMENTS; ++i) {
+        free(symbol_table->segments[i]);
+    }
+    pthread_mutex_destroy(&symbol_table->mutex);
+    free(symbol_table->slots);
+    free(symbol_table);
+}
+
+uint32_t symbol_table_intern(struct symbol_table* symbol_table,
+                             uint8_t* data,
+                             uint64_t size) {
+    uint64_t h = hash(data, size);
+    uint64_t mask = symbol_table->slots_capacity - 1;
+    uint64_t index = h & mask;
+    while (symbol_table->slots[index] != SYMBOL_NONE) {
+        uint32_t symbol = symbol_table->slots[index];
+        struct symbol_table_entry* entry
+            = symbol_table_entry(symbol_table, symbol);
+        if (entry->hash == h && entry->str.size == size
+            && memcmp(entry->str.data, data, size) == 0) {
+            return symbol;
+        }
+        index = (index + 1) & mask;
+    }
+
+    uint32_t symbol = symbol_table_push(symbol_table, h, data, size);
+    symbol_table->slots[index] = symbol;
+
+    /* Keep the load factor at or below one half */
+    if (symbol_table->entries_length * 2 > symbol_table->slots_capacity) {
+        symbol_table_slots_resize(symbol_table,
+                                  symbol_table->slots_capacity * 2);
+    }
+    return symbol;
+}
+
+uint32_t* symbol_table_intern_table(struct symbol_table* symbol_table,
+                                    struct symbol_table* other) {
+    uint64_t other_length = symbol_table_length(other);
+    uint32_t* remap = xmalloc(other_length * sizeof(uint32_t));
+    /* Predefined symbols are the same in every table */
+    for (uint32_t i = 0; i < SYMBOL_PREDEFINED_LENGTH; ++i) {
+        remap[i] = i;
+    }
+    pthread_mutex_lock(&symbol_table->mutex);
+    for (uint32_t i = SYMBOL_PREDEFINED_LENGTH; i < other_length; ++i) {
+        struct str str = symbol_table_str(other, i);
+        remap[i] = symbol_table_intern(symbol_table, str.data, str.size);
+    }
+    pthread_mutex_unlock(&symbol_table->mutex);
+    return remap;
+}
+
+void symbol_table_truncate(struct symbol_table* symbol_table,
+                           uint64_t length) {
+    if (length < SYMBOL_PREDEFINED_LENGTH) {
+        fatal_error("predefined symbols cannot be removed");
+    }
+    /* Removing the newest symbol first leaves the slots as they were before
+       it was added, so no other symbol's probe sequence is broken */
+    uint64_t mask = symbol_table->slots_capacity - 1;
+    for (uint64_t symbol = symbol_table->entries_length; symbol > length;) {
+        --symbol;
+        uint64_t index = symbol_table_entry(symbol_table, symbol)->hash & mask;
+        while (symbol_table->slots[index] != symbol) {
+            index = (index + 1) & mask;
+        }
+        symbol_table->slots[index] = SYMBOL_NONE;
+    }
+    if (length >= symbol_table->entries_length) {
+        return;
+    }
+
+    /* Chunks after the one holding the last kept symbol only hold removed
+       names */
+    struct str* last = &symbol_table_entry(symbol_table, length - 1)->str;
+    uint8_t* end = last->data + last->size;
+    struct symbol_table_chunk* chunk = symbol_table->chunks;
+    while (end < chunk->data || end > chunk->data + chunk->capacity) {
+        struct symbol_table_chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    chunk->size = end - chunk->data;
+    symbol_table->chunks = chunk;
+    symbol_table->entries_length = length;
+}
+
+struct str symbol_table_str(struct symbol_table* symbol_table,
+                            uint32_t symbol) {
+    if (symbol >= __atomic_load_n(&symbol_table->entries_length,
+                                  __ATOMIC_ACQUIRE)) {
+        fatal_error("unknown symbol");
+    }
+    return symbol_table_entry(symbol_table, symbol)->str;
+}
+
+uint64_t symbol_table_length(struct symbol_table* symbol_table) {
+    return __atomic_load_n(&symbol_table->entries_length, __ATOMIC_ACQUIRE);
+}
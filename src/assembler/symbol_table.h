@@ -0,0 +1,140 @@
+#ifndef MALLARD_SYMBOL_TABLE_H
+#define MALLARD_SYMBOL_TABLE_H
+
+#include "isa.h"
+#include "str.h"
+
+#define SYMBOL_KEYWORDS(X) \
+    X(EXECUTABLE, "executable") \
+    X(FUNC, "func") \
+    X(DATA, "data") \
+    X(ADDRESS, "address") \
+    X(ENTRY, "entry") \
+    X(CODE, "code") \
+    X(FILES, "files") \
+    X(OUTPUT_FORMAT, "output_format") \
+    X(ELF, "elf") \
+    X(BINARY, "binary") \
+    X(IHEX, "ihex") \
+    X(BITS, "b") \
+    X(BYTES, "B")
+
+/* Mnemonics for the instructions in ISA_INSTRUCTIONS follow the predefined
+   symbols, these are the mnemonics the assembler handles itself */
+#define SYMBOL_PSEUDO_MNEMONICS(X) \
+    X(LI, "li") \
+    X(LABEL, "label")
+
+#define SYMBOL_REGISTERS(X) \
+    X(ZERO, "zero", 0) \
+    X(RA, "ra", 1) \
+    X(SP, "sp", 2) \
+    X(GP, "gp", 3) \
+    X(TP, "tp", 4) \
+    X(FP, "fp", 8) \
+    X(X0, "x0", 0) \
+    X(X1, "x1", 1) \
+    X(X2, "x2", 2) \
+    X(X3, "x3", 3) \
+    X(X4, "x4", 4) \
+    X(X5, "x5", 5) \
+    X(X6, "x6", 6) \
+    X(X7, "x7", 7) \
+    X(X8, "x8", 8) \
+    X(X9, "x9", 9) \
+    X(X10, "x10", 10) \
+    X(X11, "x11", 11) \
+    X(X12, "x12", 12) \
+    X(X13, "x13", 13) \
+    X(X14, "x14", 14) \
+    X(X15, "x15", 15) \
+    X(X16, "x16", 16) \
+    X(X17, "x17", 17) \
+    X(X18, "x18", 18) \
+    X(X19, "x19", 19) \
+    X(X20, "x20", 20) \
+    X(X21, "x21", 21) \
+    X(X22, "x22", 22) \
+    X(X23, "x23", 23) \
+    X(X24, "x24", 24) \
+    X(X25, "x25", 25) \
+    X(X26, "x26", 26) \
+    X(X27, "x27", 27) \
+    X(X28, "x28", 28) \
+    X(X29, "x29", 29) \
+    X(X30, "x30", 30) \
+    X(X31, "x31", 31) \
+    X(A0, "a0", 10) \
+    X(A1, "a1", 11) \
+    X(A2, "a2", 12) \
+    X(A3, "a3", 13) \
+    X(A4, "a4", 14) \
+    X(A5, "a5", 15) \
+    X(A6, "a6", 16) \
+    X(A7, "a7", 17) \
+    X(S0, "s0", 8) \
+    X(S1, "s1", 9) \
+    X(S2, "s2", 18) \
+    X(S3, "s3", 19) \
+    X(S4, "s4", 20) \
+    X(S5, "s5", 21) \
+    X(S6, "s6", 22) \
+    X(S7, "s7", 23) \
+    X(S8, "s8", 24) \
+    X(S9, "s9", 25) \
+    X(S10, "s10", 26) \
+    X(S11, "s11", 27) \
+    X(T0, "t0", 5) \
+    X(T1, "t1", 6) \
+    X(T2, "t2", 7) \
+    X(T3, "t3", 28) \
+    X(T4, "t4", 29) \
+    X(T5, "t5", 30) \
+    X(T6, "t6", 31)
+
+#define SYMBOL_ENUM(name, ...) SYMBOL_##name,
+
+/* Every symbol table starts with these symbols, in this order, so they have
+   the same value in every table. Symbol 0 is never an identifier. */
+enum symbol {
+    SYMBOL_NONE,
+    SYMBOL_KEYWORDS(SYMBOL_ENUM)
+    SYMBOL_PSEUDO_MNEMONICS(SYMBOL_ENUM)
+    SYMBOL_REGISTERS(SYMBOL_ENUM)
+    SYMBOL_ISA_FIRST,
+    SYMBOL_PREDEFINED_LENGTH = SYMBOL_ISA_FIRST + ISA_INSTRUCTIONS_LENGTH,
+};
+
+#undef SYMBOL_ENUM
+
+/* Interning already maps each mnemonic to a dense index, so finding an
+   instruction's description is a subtraction */
+static inline bool symbol_is_isa_instruction(uint32_t symbol) {
+    return symbol >= SYMBOL_ISA_FIRST && symbol < SYMBOL_PREDEFINED_LENGTH;
+}
+
+static inline enum isa_instruction symbol_isa_instruction(uint32_t symbol) {
+    return symbol - SYMBOL_ISA_FIRST;
+}
+
+struct symbol_table;
+
+struct symbol_table* symbol_table_create(void);
+void symbol_table_destroy(struct symbol_table* symbol_table);
+uint32_t symbol_table_intern(struct symbol_table* symbol_table,
+                             uint8_t* data,
+                             uint64_t size);
+/* Interns every symbol of other, returning a mapping from other's symbols
+   that the caller frees. Several threads may intern tables and look up
+   strings at once, but not alongside symbol_table_intern. */
+uint32_t* symbol_table_intern_table(struct symbol_table* symbol_table,
+                                    struct symbol_table* other);
+/* Removes every symbol from length on, keeping the memory for the next
+   ones. Nothing may still use the removed symbols. */
+void symbol_table_truncate(struct symbol_table* symbol_table,
+                           uint64_t length);
+struct str symbol_table_str(struct symbol_table* symbol_table,
+                            uint32_t symbol);
+uint64_t symbol_table_length(struct symbol_table* symbol_table);
+
+#endif /* ifndef MALLARD_SYMBOL_TABLE_H */
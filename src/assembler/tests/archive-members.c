@@ -0,0 +1,145 @@
+#include "archive.h"
+#include "compile.h"
+#include "fatal_error.h"
+#include "linker.h"
+#include "test_files.h"
+
+#define SOURCES 4
+
+static const char* names[SOURCES] = {"main", "used", "helper", "unused"};
+
+/* Only used and helper are reachable from entry */
+static const char* sources[SOURCES] = {
+    "func entry {\n"
+    "    jal ra, used\n"
+    "    jalr x0, 0(ra)\n"
+    "}\n",
+
+    "func used {\n"
+    "    jal ra, helper\n"
+    "    jalr x0, 0(ra)\n"
+    "}\n",
+
+    "func helper {\n"
+    "    addiw a0, x0, 0x4d\n"
+    "    jalr x0, 0(ra)\n"
+    "}\n"
+    "\n"
+    "data helper_buffer : 8B\n",
+
+    "func unused {\n"
+    "    addiw a0, x0, 0x1\n"
+    "    jalr x0, 0(ra)\n"
+    "}\n",
+};
+
+static void compile_c_str(char* c_str, bool link) {
+    struct str input = {
+        .data = (uint8_t*) c_str,
+        .size = strlen(c_str),
+    };
+    if (link) {
+        linker_link(&input, 2);
+    }
+    else {
+        compile(&input, 2);
+    }
+}
+
+/* A names size that wraps the sum of the table sizes is still rejected */
+static void check_names_out_of_bounds(void) {
+    uint64_t header[4] = {0, 0, 0, -(uint64_t) sizeof(header)};
+    memcpy(header, "!<mlar>\n", 8);
+    struct str source = {
+        .data = (uint8_t*) header,
+        .size = sizeof(header),
+    };
+    struct archive archive;
+    struct fatal_error_context context;
+    struct fatal_error_context* previous = fatal_error_set_context(&context);
+    if (setjmp(context.jump) == 0) {
+        archive_open(&archive, &source);
+        assert(false);
+    }
+    fatal_error_set_context(previous);
+    assert(strcmp(context.message, "archive: tables out of bounds") == 0);
+}
+
+int main(void) {
+    check_names_out_of_bounds();
+
+    char dir[] = "/tmp/mallard-archive-members-XXXXXX";
+    test_make_dir(dir);
+    char source_paths[SOURCES][256];
+    char object_paths[SOURCES][256];
+    for (uint64_t i = 0; i < SOURCES; ++i) {
+        snprintf(source_paths[i], sizeof(source_paths[i]), "%s/%s.mpf",
+                 dir, names[i]);
+        snprintf(object_paths[i], sizeof(object_paths[i]), "%s/%s.o",
+                 dir, names[i]);
+        test_write_file(source_paths[i], sources[i]);
+        struct str source = {
+            .data = (uint8_t*) sources[i],
+            .size = strlen(sources[i]),
+        };
+        compile_object(&source, object_paths[i], 1);
+    }
+    char archive_path[256];
+    snprintf(archive_path, sizeof(archive_path), "%s/lib.a", dir);
+    const char* members[SOURCES - 1] = {
+        object_paths[3], object_paths[2], object_paths[1],
+    };
+    archive_create(archive_path, members, SOURCES - 1);
+
+    /* Every defined symbol is in the index */
+    struct str mapped = file_open_read_mmap(archive_path);
+    struct archive archive;
+    archive_open(&archive, &mapped);
+    assert(archive.members_length == SOURCES - 1);
+    const char* symbols[] = {"unused", "helper", "helper_buffer", "used"};
+    const uint64_t symbol_members[] = {0, 1, 1, 2};
+    for (uint64_t i = 0; i < 4; ++i) {
+        struct str name = {
+            .data = (uint8_t*) symbols[i],
+            .size = strlen(symbols[i]),
+        };
+        assert(archive_lookup(&archive, &name) == symbol_members[i]);
+    }
+    struct str missing = {
+        .data = (uint8_t*) "entry",
+        .size = 5,
+    };
+    assert(archive_lookup(&archive, &missing) == archive.members_length);
+    struct str member_name = archive_member_name(&archive, 2);
+    assert(member_name.size == 6 && memcmp(member_name.data, "used.o", 6) == 0);
+    file_close_mmap(&mapped);
+
+    /* Linking pulls in exactly the reachable members */
+    char output_path[256];
+    snprintf(output_path, sizeof(output_path), "%s/out.elf", dir);
+    char unit[4096];
+    snprintf(unit, sizeof(unit),
+             "executable \"%s\" {\n"
+             "    files: [\"%s\", \"%s\", \"%s\"],\n"
+             "    code: 0x80000000,\n"
+             "    entry: entry,\n"
+             "}\n",
+             output_path, source_paths[0], source_paths[1], source_paths[2]);
+    compile_c_str(unit, false);
+    struct str expected = test_take_file(output_path);
+    snprintf(unit, sizeof(unit),
+             "executable \"%s\" {\n"
+             "    files: [\"%s\", \"%s\"],\n"
+             "    code: 0x80000000,\n"
+             "    entry: entry,\n"
+             "}\n",
+             output_path, object_paths[0], archive_path);
+    compile_c_str(unit, true);
+    struct str actual = test_take_file(output_path);
+    assert(test_same(&actual, &expected));
+
+    free(actual.data);
+    free(expected.data);
+    test_remove_dir(dir);
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include "alloc.h"
+#include "lexer.h"
+#include "parser.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define INSTRUCTIONS 100000
+
+int main(void) {
+    const char* line = "addi a0, a0, 0x1\n";
+    uint64_t line_size = 17;
+    uint8_t* data = malloc(INSTRUCTIONS * line_size + 1);
+    assert(data != NULL);
+    for (uint64_t i = 0; i < INSTRUCTIONS; ++i) {
+        snprintf((char*) data + i * line_size, line_size + 1, "%s", line);
+    }
+    struct str input = {
+        .data = data,
+        .size = INSTRUCTIONS * line_size,
+    };
+
+    struct symbol_table* symbols = symbol_table_create();
+    struct arena* arena = arena_create();
+    struct tokens tokens = lex(&input, symbols);
+    uint64_t allocations = alloc_allocations;
+    struct instructions_ast_node* insts = parse_instructions(&tokens, arena);
+    allocations = alloc_allocations - allocations;
+    assert(insts->length == INSTRUCTIONS);
+    for (uint64_t i = 0; i < insts->length; ++i) {
+        struct instruction_ast_node* node = insts->ast_nodes[i];
+        assert(node->instruction == ISA_ADDI);
+        assert(node->imm == 1);
+    }
+
+    /* Allocating each node on its own took at least one malloc per
+       instruction. Counted on the heap, the parse now only allocates the
+       arena's chunks, which double from 64 KiB. */
+    assert(allocations == arena_chunks(arena));
+    assert(allocations * 1000 < INSTRUCTIONS);
+
+    arena_destroy(arena);
+    token_free(&tokens);
+    symbol_table_destroy(symbols);
+    free(data);
+    return 0;
+}
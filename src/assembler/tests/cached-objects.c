@@ -0,0 +1,121 @@
+#include "compile.h"
+#include "test_files.h"
+
+/* The last source is edited between builds, and the second has the same
+   contents as the third so they share an entry */
+static const char* sources[4] = {
+    "func entry {\n"
+    "    jal ra, message\n"
+    "    jal ra, exit\n"
+    "}\n",
+
+    "data buffer : 8B\n",
+
+    "data buffer : 8B\n",
+
+    TEST_FUNC_MESSAGE
+    "\n"
+    TEST_FUNC_EXIT,
+};
+
+static const char* edited =
+    "func message {\n"
+    "    lui a1, 0x10000\n"
+    "    addiw a0, x0, 0x4e\n"
+    "    sb a0, 0(a1)\n"
+    "    jal ra, newline\n"
+    "    jalr x0, 0(ra)\n"
+    "}\n"
+    "\n"
+    "func newline {\n"
+    "    addiw a0, x0, 0xa\n"
+    "    sb a0, 0(a1)\n"
+    "    jalr x0, 0(ra)\n"
+    "}\n"
+    "\n"
+    TEST_FUNC_EXIT;
+
+static char dir[] = "/tmp/mallard-cached-objects-XXXXXX";
+static char source_paths[4][256];
+static char cache_dir[256];
+static char unit[4096];
+
+static struct str read_output(const char* name) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    return test_take_file(path);
+}
+
+static void build(const char* cache, struct str* outputs) {
+    struct str input = {
+        .data = (uint8_t*) unit,
+        .size = strlen(unit),
+    };
+    struct compile_options options = {
+        .jobs = 2,
+        .cache_dir = cache,
+    };
+    compile_with_options(&input, &options);
+    outputs[0] = read_output("out.elf");
+    outputs[1] = read_output("out.hex");
+}
+
+static void check_same(struct str* expected, struct str* actual) {
+    for (uint64_t i = 0; i < 2; ++i) {
+        assert(test_same(&actual[i], &expected[i]));
+        free(actual[i].data);
+    }
+}
+
+int main(void) {
+    test_make_dir(dir);
+    for (uint64_t i = 0; i < 4; ++i) {
+        snprintf(source_paths[i], sizeof(source_paths[i]), "%s/%lu.mpf",
+                 dir, (unsigned long) i);
+        test_write_file(source_paths[i], sources[i]);
+    }
+    snprintf(cache_dir, sizeof(cache_dir), "%s/cache", dir);
+    snprintf(unit, sizeof(unit),
+             "executable \"%s/out.elf\" {\n"
+             "    files: [\"%s\", \"%s\", \"%s\"],\n"
+             "    code: 0x80000000,\n"
+             "    entry: entry,\n"
+             "    address(exit): 0x80000100,\n"
+             "}\n"
+             "executable \"%s/out.hex\" {\n"
+             "    files: [\"%s\", \"%s\", \"%s\"],\n"
+             "    code: 0x80200000,\n"
+             "    entry: message,\n"
+             "    output_format: ihex,\n"
+             "}\n",
+             dir, source_paths[0], source_paths[1], source_paths[3],
+             dir, source_paths[3], source_paths[2], source_paths[0]);
+
+    struct str expected[2];
+    struct str actual[2];
+    build(NULL, expected);
+
+    /* The first build fills the cache, the second only reads it */
+    build(cache_dir, actual);
+    check_same(expected, actual);
+    assert(test_count_entries(cache_dir) == 3);
+    build(cache_dir, actual);
+    check_same(expected, actual);
+    assert(test_count_entries(cache_dir) == 3);
+    free(expected[0].data);
+    free(expected[1].data);
+
+    /* Only the edited file is assembled again */
+    test_write_file(source_paths[3], edited);
+    build(NULL, expected);
+    build(cache_dir, actual);
+    check_same(expected, actual);
+    assert(test_count_entries(cache_dir) == 4);
+    build(cache_dir, actual);
+    check_same(expected, actual);
+    free(expected[0].data);
+    free(expected[1].data);
+
+    test_remove_dir(dir);
+    return 0;
+}
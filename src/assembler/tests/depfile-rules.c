@@ -0,0 +1,73 @@
+#include "compile.h"
+#include "test_files.h"
+
+/* The second file needs escaping, Make splits paths at spaces */
+static const char* names[2] = {"entry.mpf", "exit $#1.mpf"};
+
+static void check_file(const char* path, const char* expected) {
+    struct str actual = test_take_file(path);
+    assert(strcmp((char*) actual.data, expected) == 0);
+    free(actual.data);
+}
+
+int main(void) {
+    char dir[] = "/tmp/mallard-depfile-rules-XXXXXX";
+    test_make_dir(dir);
+    char source_dir[64];
+    snprintf(source_dir, sizeof(source_dir), "%s/src", dir);
+    assert(mkdir(source_dir, 0777) == 0);
+    struct test_unit sources;
+    test_write_unit(&sources, source_dir, names);
+
+    /* Files are listed from the root, outputs from the working directory */
+    char unit[4096];
+    snprintf(unit, sizeof(unit),
+             "executable \"%s/a.elf\" {\n"
+             "    files: [\"%s\", \"%s\"],\n"
+             "    code: 0x80000000,\n"
+             "    entry: entry,\n"
+             "}\n"
+             "executable \"%s/b.elf\" {\n"
+             "    files: [\"%s\", \"%s\"],\n"
+             "    code: 0x80000000,\n"
+             "    entry: exit,\n"
+             "}\n",
+             dir, names[1], names[0], dir, names[0], names[1]);
+    struct str input = {
+        .data = (uint8_t*) unit,
+        .size = strlen(unit),
+    };
+    struct compile_options options = {
+        .jobs = 2,
+        .root = source_dir,
+        .depfile = true,
+    };
+    compile_with_options(&input, &options);
+
+    char path[256];
+    char expected[4096];
+    snprintf(path, sizeof(path), "%s/a.elf.d", dir);
+    snprintf(expected, sizeof(expected),
+             "%s/a.elf: %s/exit\\ $$\\#1.mpf %s/entry.mpf\n",
+             dir, source_dir, source_dir);
+    check_file(path, expected);
+    snprintf(path, sizeof(path), "%s/b.elf.d", dir);
+    snprintf(expected, sizeof(expected),
+             "%s/b.elf: %s/entry.mpf %s/exit\\ $$\\#1.mpf\n",
+             dir, source_dir, source_dir);
+    check_file(path, expected);
+
+    /* One depfile holds a rule for every output */
+    char depfile_path[256];
+    snprintf(depfile_path, sizeof(depfile_path), "%s/all.d", dir);
+    options.depfile_path = depfile_path;
+    compile_with_options(&input, &options);
+    snprintf(expected, sizeof(expected),
+             "%s/a.elf: %s/exit\\ $$\\#1.mpf %s/entry.mpf\n"
+             "%s/b.elf: %s/entry.mpf %s/exit\\ $$\\#1.mpf\n",
+             dir, source_dir, source_dir, dir, source_dir, source_dir);
+    check_file(depfile_path, expected);
+
+    test_remove_dir(dir);
+    return 0;
+}
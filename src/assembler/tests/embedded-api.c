@@ -0,0 +1,99 @@
+#include "compile.h"
+#include "mallard.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* valid =
+    "lui a1, 0x10000\n"
+    "addiw a0, x0, 0x4d\n"
+    "sb a0, 0(a1)\n"
+    "jalr x0, 0(ra)\n";
+
+struct invalid {
+    const char* source;
+    enum mallard_status status;
+    const char* message;
+};
+
+/* One error from each stage, none of them may end the process */
+static const struct invalid invalids[] = {
+    {"addiw a0, x0, @\n", MALLARD_ERROR, "lexer: unknown token '@'"},
+    {"addiw a0, x0\n", MALLARD_SYNTAX_ERROR, "expected comma, got end of"},
+    {"jal ra, missing\n", MALLARD_ERROR, "function call to unknown function"},
+};
+
+#define INVALIDS_LENGTH (sizeof(invalids) / sizeof(invalids[0]))
+
+static struct vector expected;
+
+static void check_valid(struct mallard_context* context) {
+    struct mallard_result result
+        = mallard_assemble(context, valid, strlen(valid));
+    assert(result.status == MALLARD_OK);
+    assert(result.message == NULL);
+    assert(result.size == expected.size);
+    assert(memcmp(result.code, expected.data, expected.size) == 0);
+}
+
+static void check_invalid(struct mallard_context* context,
+                          const struct invalid* invalid) {
+    struct mallard_result result
+        = mallard_assemble(context, invalid->source, strlen(invalid->source));
+    assert(result.status == invalid->status);
+    assert(result.message != NULL);
+    assert(strncmp(result.message, invalid->message,
+                   strlen(invalid->message)) == 0);
+}
+
+/* Errors leave the context ready for the next snippet */
+static void* assemble_many(void* arg) {
+    (void) arg;
+    struct mallard_context* context = mallard_context_create();
+    assert(context != NULL);
+    for (uint64_t i = 0; i < 10000; ++i) {
+        check_valid(context);
+        check_invalid(context, &invalids[i % INVALIDS_LENGTH]);
+    }
+    mallard_context_reset(context);
+    check_valid(context);
+
+    /* Each snippet's names are dropped by the next, so a new name every
+       time neither grows the context nor confuses a later snippet */
+    for (uint64_t i = 0; i < 10000; ++i) {
+        char source[256];
+        int size = snprintf(source, sizeof(source), "label l%lu\n%s",
+                            (unsigned long) i, valid);
+        struct mallard_result result
+            = mallard_assemble(context, source, size);
+        assert(result.status == MALLARD_OK);
+        assert(result.size == expected.size);
+        assert(memcmp(result.code, expected.data, expected.size) == 0);
+    }
+    check_invalid(context, &invalids[2]);
+    mallard_context_destroy(context);
+    return NULL;
+}
+
+int main(void) {
+    struct str input = {
+        .data = (uint8_t*) valid,
+        .size = strlen(valid),
+    };
+    expected = compile_instructions(&input);
+
+    /* Contexts are independent, each thread has its own */
+    pthread_t threads[4];
+    for (uint64_t i = 0; i < 4; ++i) {
+        assert(pthread_create(&threads[i], NULL, assemble_many, NULL) == 0);
+    }
+    for (uint64_t i = 0; i < 4; ++i) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    free(expected.data);
+    return 0;
+}
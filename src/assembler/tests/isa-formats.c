@@ -0,0 +1,88 @@
+#include "compile.h"
+#include "instructions.h"
+#include "test_files.h"
+
+/* R-type instructions have no immediate, so inside a function they must
+   not be taken for a call that needs the function table */
+static void check_r_type_in_function(void) {
+    char dir[] = "/tmp/mallard-isa-formats-XXXXXX";
+    test_make_dir(dir);
+    char source_path[256];
+    snprintf(source_path, sizeof(source_path), "%s/source.mpf", dir);
+    test_write_file(source_path,
+                    "func entry {\n"
+                    "    add a0, a1, a2\n"
+                    "    sub a0, a1, a2\n"
+                    "    jal ra, done\n"
+                    "}\n"
+                    "\n"
+                    "func done {\n"
+                    "    jalr x0, 0(ra)\n"
+                    "}\n");
+    char unit[1024];
+    int size = snprintf(unit, sizeof(unit),
+                        "executable \"%s/out.bin\" {\n"
+                        "    files: [\"%s\"],\n"
+                        "    code: 0x80000000,\n"
+                        "    entry: entry,\n"
+                        "    output_format: binary,\n"
+                        "}\n",
+                        dir, source_path);
+    struct str input = {
+        .data = (uint8_t*) unit,
+        .size = size,
+    };
+    compile(&input, 1);
+
+    char output_path[256];
+    snprintf(output_path, sizeof(output_path), "%s/out.bin", dir);
+    struct str output = test_take_file(output_path);
+    uint32_t expected[] = {0x00C58533, 0x40C58533};
+    assert(output.size >= sizeof(expected));
+    assert(memcmp(output.data, expected, sizeof(expected)) == 0);
+    free(output.data);
+    test_remove_dir(dir);
+}
+
+int main(void) {
+    uint8_t raw_input[] =
+      "add a0, a1, a2\n"
+      "beq a0, a1, 0x8\n"
+      "srai a0, a0, 0x3\n"
+      "sd a0, 0x20(sp)\n"
+      "ld a1, 0x10(sp)\n"
+      /* Immediates that fill the top bit of the instruction */
+      "addi a0, a0, 0xFFF\n"
+      "sd a0, 0xFE0(sp)\n"
+      "beq a0, a1, 0x1000\n";
+    struct str input = {
+        .data = raw_input,
+        .size = sizeof(raw_input) - 1,
+    };
+    struct vector output = compile_instructions(&input);
+    uint32_t expected_output[] = {
+        0x00C58533,
+        0x00B50463,
+        0x40355513,
+        0x02A13023,
+        0x01013583,
+        0xFFF50513,
+        0xFEA13023,
+        0x80B50063,
+    };
+    assert(output.size == sizeof(expected_output));
+    assert(memcmp(expected_output, output.data, output.size) == 0);
+
+    /* Each encoding decodes as the instruction that produced it */
+    assert(is_add_instruction(expected_output[0]));
+    assert(!is_sub_instruction(expected_output[0]));
+    assert(is_beq_instruction(expected_output[1]));
+    assert(is_srai_instruction(expected_output[2]));
+    assert(!is_srli_instruction(expected_output[2]));
+    assert(is_sd_instruction(expected_output[3]));
+    assert(is_ld_instruction(expected_output[4]));
+    free(output.data);
+
+    check_r_type_in_function();
+    return 0;
+}
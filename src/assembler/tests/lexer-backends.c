@@ -0,0 +1,136 @@
+#include "lexer.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void check_backends(uint8_t* data, uint64_t size) {
+    struct str input = {
+        .data = data,
+        .size = size,
+    };
+    struct symbol_table* symbols = symbol_table_create();
+    struct tokens expected
+        = lex_with_backend(&input, symbols, LEXER_BACKEND_SCALAR);
+    enum lexer_backend backends[] = {
+        LEXER_BACKEND_SSE2,
+        LEXER_BACKEND_AVX2,
+    };
+    for (uint64_t i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i) {
+        if (!lexer_backend_supported(backends[i])) {
+            continue;
+        }
+        struct tokens actual = lex_with_backend(&input, symbols, backends[i]);
+        assert(actual.length == expected.length);
+        for (uint64_t j = 0; j < expected.length; ++j) {
+            struct token lhs = token_get(&expected, j);
+            struct token rhs = token_get(&actual, j);
+            assert(lhs.kind == rhs.kind);
+            assert(lhs.str.data == rhs.str.data);
+            assert(lhs.str.size == rhs.str.size);
+            assert(lhs.symbol == rhs.symbol);
+        }
+        token_free(&actual);
+    }
+    token_free(&expected);
+    symbol_table_destroy(symbols);
+}
+
+struct expected_token {
+    enum token_kind kind;
+    uint64_t size;
+};
+
+/* Each long token crosses both 16 and 32 byte blocks */
+static const char fixed_input[] =
+    "func a_very_long_function_name_that_spans_two_blocks_0123 {\n"
+    "\tlui a1, 0x123456789abcdef0123456789abcdef0\n"
+    "    sb a0, 0(a1)\n"
+    "}\n"
+    "files: [\"a string literal longer than thirty-two bytes\"],\n";
+
+static const struct expected_token fixed_tokens[] = {
+    {TOKEN_IDENTIFIER, 4},
+    {TOKEN_IDENTIFIER, 52},
+    {TOKEN_LEFT_CURLY_BRACKET, 1},
+    {TOKEN_IDENTIFIER, 3},
+    {TOKEN_IDENTIFIER, 2},
+    {TOKEN_COMMA, 1},
+    {TOKEN_NUMBER, 34},
+    {TOKEN_IDENTIFIER, 2},
+    {TOKEN_IDENTIFIER, 2},
+    {TOKEN_COMMA, 1},
+    {TOKEN_NUMBER, 1},
+    {TOKEN_LEFT_PAREN, 1},
+    {TOKEN_IDENTIFIER, 2},
+    {TOKEN_RIGHT_PAREN, 1},
+    {TOKEN_RIGHT_CURLY_BRACKET, 1},
+    {TOKEN_IDENTIFIER, 5},
+    {TOKEN_COLON, 1},
+    {TOKEN_LEFT_SQUARE_BRACKET, 1},
+    /* Without its quotes */
+    {TOKEN_STRING_LITERAL, 45},
+    {TOKEN_RIGHT_SQUARE_BRACKET, 1},
+    {TOKEN_COMMA, 1},
+};
+
+/* Every backend, the scalar one included, gives the same fixed tokens */
+static void check_fixed_tokens(void) {
+    struct str input = {
+        .data = (uint8_t*) fixed_input,
+        .size = sizeof(fixed_input) - 1,
+    };
+    uint64_t length = sizeof(fixed_tokens) / sizeof(fixed_tokens[0]);
+    enum lexer_backend backends[] = {
+        LEXER_BACKEND_SCALAR,
+        LEXER_BACKEND_SSE2,
+        LEXER_BACKEND_AVX2,
+    };
+    for (uint64_t i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i) {
+        if (!lexer_backend_supported(backends[i])) {
+            continue;
+        }
+        struct symbol_table* symbols = symbol_table_create();
+        struct tokens tokens = lex_with_backend(&input, symbols, backends[i]);
+        assert(tokens.length == length);
+        for (uint64_t j = 0; j < length; ++j) {
+            struct token token = token_get(&tokens, j);
+            assert(token.kind == fixed_tokens[j].kind);
+            assert(token.str.size == fixed_tokens[j].size);
+        }
+        token_free(&tokens);
+        symbol_table_destroy(symbols);
+    }
+}
+
+int main(void) {
+    check_fixed_tokens();
+
+    uint8_t raw_input[] =
+      "func message {\n"
+      "    lui a1, 0x10000\n"
+      "\taddiw a0, x0, 0x4d\n"
+      "    sb a0, 0(a1)\n"
+      "    jal ra, a_very_long_function_name_that_spans_two_blocks_0123\n"
+      "}\n"
+      "data flattened_device_tree_address : 8B\n"
+      "executable \"mallard-kernel.elf\" {\n"
+      "    files: [\"src/kernel/entry.mpf\", \"a path with spaces\"],\n"
+      "    code: 0x80000000,\n"
+      "}\n"
+      "                                                  0x1F";
+
+    /* Every prefix ends a run at a different position within a block */
+    for (uint64_t size = 0; size < sizeof(raw_input) - 1; ++size) {
+        /* Prefixes that split a string literal are a lexer error */
+        uint64_t quotes = 0;
+        for (uint64_t i = 0; i < size; ++i) {
+            quotes += raw_input[i] == '"';
+        }
+        if (quotes % 2 != 0) {
+            continue;
+        }
+        check_backends(raw_input, size);
+    }
+    return 0;
+}
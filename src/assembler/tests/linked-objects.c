@@ -0,0 +1,85 @@
+#include "compile.h"
+#include "linker.h"
+#include "test_files.h"
+
+/* Calls cross from one object to the other in both directions */
+static const char* sources[2] = {
+    "func entry {\n"
+    "    jal ra, message\n"
+    "    jal ra, exit\n"
+    "}\n"
+    "\n"
+    TEST_FUNC_EXIT,
+
+    "func message {\n"
+    "    lui a1, 0x10000\n"
+    "    addiw a0, x0, 0x4d\n"
+    "    sb a0, 0(a1)\n"
+    "    jal ra, newline\n"
+    "    jalr x0, 0(ra)\n"
+    "}\n"
+    "\n"
+    "func newline {\n"
+    "    addiw a0, x0, 0xa\n"
+    "    sb a0, 0(a1)\n"
+    "    jalr x0, 0(ra)\n"
+    "}\n"
+    "\n"
+    "data buffer : 8B\n",
+};
+
+static void build(char* unit, const char* dir, const char* extension) {
+    snprintf(unit, 4096,
+             "executable \"%s/out.elf\" {\n"
+             "    files: [\"%s/a.%s\", \"%s/b.%s\"],\n"
+             "    code: 0x80000000,\n"
+             "    entry: entry,\n"
+             "    address(message): 0x80000100,\n"
+             "}\n",
+             dir, dir, extension, dir, extension);
+}
+
+int main(void) {
+    char dir[] = "/tmp/mallard-linked-objects-XXXXXX";
+    test_make_dir(dir);
+    char source_paths[2][256];
+    char object_paths[2][256];
+    for (uint64_t i = 0; i < 2; ++i) {
+        snprintf(source_paths[i], sizeof(source_paths[i]), "%s/%c.mpf",
+                 dir, (char) ('a' + i));
+        snprintf(object_paths[i], sizeof(object_paths[i]), "%s/%c.o",
+                 dir, (char) ('a' + i));
+        test_write_file(source_paths[i], sources[i]);
+    }
+    char output_path[256];
+    snprintf(output_path, sizeof(output_path), "%s/out.elf", dir);
+
+    /* Assembled in one process */
+    char unit[4096];
+    build(unit, dir, "mpf");
+    struct str input = {
+        .data = (uint8_t*) unit,
+        .size = strlen(unit),
+    };
+    compile(&input, 2);
+    struct str expected = test_take_file(output_path);
+
+    /* Assembled separately and linked */
+    for (uint64_t i = 0; i < 2; ++i) {
+        struct str source = {
+            .data = (uint8_t*) sources[i],
+            .size = strlen(sources[i]),
+        };
+        compile_object(&source, object_paths[i], 2);
+    }
+    build(unit, dir, "o");
+    input.size = strlen(unit);
+    linker_link(&input, 2);
+    struct str actual = test_take_file(output_path);
+    assert(test_same(&actual, &expected));
+
+    free(actual.data);
+    free(expected.data);
+    test_remove_dir(dir);
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "compile.h"
+#include "test_files.h"
+
+#define VARIANTS 3
+
+static const char* source =
+    "func entry {\n"
+    "    jal ra, message\n"
+    "    jal ra, exit\n"
+    "}\n"
+    "\n"
+    TEST_FUNC_MESSAGE
+    "\n"
+    TEST_FUNC_EXIT
+    "\n"
+    "data buffer : 8B\n";
+
+/* Each variant has its own code base and pins a different function */
+static const char* variants[VARIANTS] = {
+    "code: 0x80000000, entry: entry, address(entry): 0x80000000,",
+    "code: 0x80200000, entry: entry, address(exit): 0x80200000,",
+    "code: 0x40000000, entry: message, address(message): 0x40000100,",
+};
+
+static int executable(char* buffer,
+                      uint64_t size,
+                      const char* dir,
+                      uint64_t variant) {
+    return snprintf(buffer, size,
+                    "executable \"%s/out-%d.elf\" {\n"
+                    "    files: [\"%s/source.mpf\"],\n"
+                    "    %s\n"
+                    "}\n",
+                    dir, (int) variant, dir, variants[variant]);
+}
+
+static void compile_c_str(char* c_str) {
+    struct str input = {
+        .data = (uint8_t*) c_str,
+        .size = strlen(c_str),
+    };
+    compile(&input, 4);
+}
+
+static struct str read_output(const char* dir, uint64_t variant) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/out-%d.elf", dir, (int) variant);
+    return test_take_file(path);
+}
+
+int main(void) {
+    char dir[] = "/tmp/mallard-multiple-executables-XXXXXX";
+    test_make_dir(dir);
+    char source_path[4096];
+    snprintf(source_path, sizeof(source_path), "%s/source.mpf", dir);
+    test_write_file(source_path, source);
+
+    /* Every variant on its own */
+    struct str expected[VARIANTS];
+    for (uint64_t i = 0; i < VARIANTS; ++i) {
+        char unit[8192];
+        executable(unit, sizeof(unit), dir, i);
+        compile_c_str(unit);
+        expected[i] = read_output(dir, i);
+    }
+
+    /* Every variant from one unit, sharing the parsed source */
+    char unit[8192];
+    int size = 0;
+    for (uint64_t i = 0; i < VARIANTS; ++i) {
+        size += executable(unit + size, sizeof(unit) - size, dir, i);
+    }
+    compile_c_str(unit);
+    for (uint64_t i = 0; i < VARIANTS; ++i) {
+        struct str actual = read_output(dir, i);
+        assert(test_same(&actual, &expected[i]));
+        free(actual.data);
+        free(expected[i].data);
+    }
+
+    test_remove_dir(dir);
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include "compile.h"
+#include "test_files.h"
+
+static const char* source =
+    "func entry {\n"
+    "    jal ra, message\n"
+    "    jal ra, exit\n"
+    "}\n"
+    "\n"
+    TEST_FUNC_MESSAGE
+    "\n"
+    TEST_FUNC_EXIT
+    "\n"
+    "data buffer : 8B\n";
+
+/* The code ends past a 64 KiB boundary so the hex output needs a second
+   extended address record */
+static const char* formats[] = {"elf", "binary", "ihex"};
+
+static struct str read_output(const char* dir, const char* format) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/out.%s", dir, format);
+    return test_take_file(path);
+}
+
+static uint64_t read_u64(uint8_t* data) {
+    uint64_t value = 0;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint8_t hex_byte(const uint8_t* data) {
+    char digits[3] = {data[0], data[1], '\0'};
+    return strtoul(digits, NULL, 16);
+}
+
+int main(void) {
+    char dir[] = "/tmp/mallard-output-formats-XXXXXX";
+    test_make_dir(dir);
+    char source_path[256];
+    snprintf(source_path, sizeof(source_path), "%s/source.mpf", dir);
+    test_write_file(source_path, source);
+
+    char unit[8192];
+    int size = 0;
+    for (uint64_t i = 0; i < 3; ++i) {
+        size += snprintf(unit + size, sizeof(unit) - size,
+                         "executable \"%s/out.%s\" {\n"
+                         "    files: [\"%s\"],\n"
+                         "    code: 0x8000FFF0,\n"
+                         "    entry: entry,\n"
+                         "    address(exit): 0x80010020,\n"
+                         "    output_format: %s,\n"
+                         "}\n",
+                         dir, formats[i], source_path, formats[i]);
+    }
+    struct str input = {
+        .data = (uint8_t*) unit,
+        .size = size,
+    };
+    compile(&input, 2);
+
+    /* The flat binary is the ELF file's code segment */
+    struct str elf = read_output(dir, "elf");
+    uint64_t entry = read_u64(elf.data + 24);
+    uint8_t* code_header = elf.data + read_u64(elf.data + 32);
+    uint64_t code_offset = read_u64(code_header + 8);
+    uint64_t code_address = read_u64(code_header + 16);
+    uint64_t code_size = read_u64(code_header + 32);
+    assert(code_address == 0x8000FFF0);
+    struct str binary = read_output(dir, "binary");
+    assert(binary.size == code_size);
+    assert(memcmp(binary.data, elf.data + code_offset, code_size) == 0);
+
+    /* Every record checks out and together they rebuild the binary */
+    struct str ihex = read_output(dir, "ihex");
+    uint8_t* image = calloc(1, code_size);
+    assert(image != NULL);
+    uint64_t upper = 0;
+    uint64_t loaded = 0;
+    uint64_t start = 0;
+    bool ended = false;
+    uint8_t* line = ihex.data;
+    uint8_t* end = ihex.data + ihex.size;
+    while (line < end) {
+        assert(!ended);
+        assert(line[0] == ':');
+        uint8_t length = hex_byte(line + 1);
+        uint8_t record[256 + 5];
+        uint8_t checksum = 0;
+        for (uint64_t i = 0; i < length + 5u; ++i) {
+            record[i] = hex_byte(line + 1 + i * 2);
+            checksum += record[i];
+        }
+        assert(checksum == 0);
+        assert(line[1 + (length + 5) * 2] == '\n');
+        line += 1 + (length + 5) * 2 + 1;
+
+        uint64_t address = upper | (record[1] << 8) | record[2];
+        uint8_t* data = record + 4;
+        switch (record[3]) {
+        case 0x00:
+            assert(address >= code_address);
+            assert(address + length <= code_address + code_size);
+            memcpy(image + (address - code_address), data, length);
+            loaded += length;
+            break;
+        case 0x01:
+            ended = true;
+            break;
+        case 0x04:
+            upper = ((uint64_t) data[0] << 24) | ((uint64_t) data[1] << 16);
+            break;
+        case 0x05:
+            start = ((uint64_t) data[0] << 24) | ((uint64_t) data[1] << 16)
+                    | ((uint64_t) data[2] << 8) | data[3];
+            break;
+        default:
+            assert(false);
+        }
+    }
+    assert(ended);
+    assert(start == entry);
+    assert(loaded == code_size);
+    assert(memcmp(image, binary.data, code_size) == 0);
+
+    free(image);
+    free(ihex.data);
+    free(binary.data);
+    free(elf.data);
+    test_remove_dir(dir);
+    return 0;
+}
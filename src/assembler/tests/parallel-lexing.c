@@ -0,0 +1,61 @@
+#include "lexer.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Large enough that lex_parallel splits it into several chunks */
+#define INPUT_SIZE (3 * 1024 * 1024)
+
+static const char* lines[] = {
+    "func f%lu {\n",
+    "    lui a1, 0x%lx\n",
+    "\taddiw a0, x0, 0x4d\n",
+    "    jal ra, function_%lu\n",
+    "}\n",
+    "executable \"out put %lu.elf\" {\n",
+    "    files: [\"a path  with\tspaces %lu\", \" \"],\n",
+    "data d%lu : 8B\n",
+    "\n\n\n",
+};
+
+int main(void) {
+    char* data = malloc(INPUT_SIZE + 256);
+    assert(data != NULL);
+    /* A fixed sequence, so every run splits at the same places */
+    uint64_t state = 1;
+    uint64_t size = 0;
+    while (size < INPUT_SIZE) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint64_t line = (state >> 33) % (sizeof(lines) / sizeof(lines[0]));
+        size += sprintf(data + size, lines[line],
+                        (unsigned long) (state >> 48));
+    }
+    struct str input = {
+        .data = (uint8_t*) data,
+        .size = size,
+    };
+
+    struct symbol_table* symbols = symbol_table_create();
+    struct tokens expected = lex(&input, symbols);
+    struct thread_pool* thread_pool = thread_pool_create(4);
+    struct tokens actual = lex_parallel(&input, symbols, thread_pool);
+    thread_pool_destroy(thread_pool);
+
+    assert(expected.length > 100000);
+    assert(actual.length == expected.length);
+    for (uint64_t i = 0; i < expected.length; ++i) {
+        struct token lhs = token_get(&expected, i);
+        struct token rhs = token_get(&actual, i);
+        assert(lhs.kind == rhs.kind);
+        assert(lhs.str.data == rhs.str.data);
+        assert(lhs.str.size == rhs.str.size);
+        assert(lhs.symbol == rhs.symbol);
+    }
+
+    token_free(&actual);
+    token_free(&expected);
+    symbol_table_destroy(symbols);
+    free(data);
+    return 0;
+}
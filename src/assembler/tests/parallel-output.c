@@ -0,0 +1,73 @@
+#include "compile.h"
+#include "test_files.h"
+
+#include <inttypes.h>
+
+#define FUNCTIONS 4000
+#define FILES 3
+
+static void write_source(const char* path, uint64_t file, uint64_t length) {
+    FILE* out = fopen(path, "w");
+    assert(out != NULL);
+    for (uint64_t i = 0; i < length; ++i) {
+        uint64_t callee = (i * 7919 + 1) % length;
+        fprintf(out,
+                "func f%" PRIu64 "_%" PRIu64 " {\n"
+                "    lui a1, 0x10\n"
+                "    addiw a0, x0, 0x%" PRIx64 "\n"
+                "    sw a0, 0(a1)\n"
+                "    sd a0, 0x20(sp)\n"
+                "    jal ra, f%" PRIu64 "_%" PRIu64 "\n"
+                "    jal ra, f0_%" PRIu64 "\n"
+                "    jalr x0, 0(ra)\n"
+                "}\n\n",
+                file, i, i & 0x7FF, file, callee, i % FUNCTIONS);
+    }
+    fprintf(out, "data buffer%" PRIu64 " : 8B\n", file);
+    fclose(out);
+}
+
+static struct str compile_with_jobs(const char* dir, uint64_t jobs) {
+    char output[4096];
+    snprintf(output, sizeof(output), "%s/out-%" PRIu64 ".elf", dir, jobs);
+    char executable[8192];
+    int size = snprintf(executable, sizeof(executable),
+        "executable \"%s\" {\n"
+        "    files: [\"%s/f0.mpf\", \"%s/f1.mpf\", \"%s/f2.mpf\"],\n"
+        "    code: 0x80000000,\n"
+        "    entry: f0_0,\n"
+        "    address(f0_0): 0x80000000,\n"
+        "}\n",
+        output, dir, dir, dir);
+    struct str input = {
+        .data = (uint8_t*) executable,
+        .size = size,
+    };
+    compile(&input, jobs);
+    return test_take_file(output);
+}
+
+int main(void) {
+    char dir[] = "/tmp/mallard-parallel-output-XXXXXX";
+    test_make_dir(dir);
+
+    /* One huge file and two small ones */
+    uint64_t lengths[FILES] = { FUNCTIONS, 10, 1 };
+    char paths[FILES][4096];
+    for (uint64_t i = 0; i < FILES; ++i) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/f%" PRIu64 ".mpf", dir, i);
+        write_source(paths[i], i, lengths[i]);
+    }
+
+    struct str expected = compile_with_jobs(dir, 1);
+    uint64_t jobs[] = { 2, 3, 8 };
+    for (uint64_t i = 0; i < sizeof(jobs) / sizeof(jobs[0]); ++i) {
+        struct str actual = compile_with_jobs(dir, jobs[i]);
+        assert(test_same(&actual, &expected));
+        free(actual.data);
+    }
+    free(expected.data);
+
+    test_remove_dir(dir);
+    return 0;
+}
@@ -0,0 +1,194 @@
+#include "compile.h"
+#include "serve.h"
+#include "test_files.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+static const char* sources[2] = {
+    "func entry {\n"
+    "    jal ra, message\n"
+    "    jal ra, exit\n"
+    "}\n",
+
+    TEST_FUNC_MESSAGE
+    "\n"
+    TEST_FUNC_EXIT,
+};
+
+/* Each edit changes the second file, one of them adds a function */
+static const char* edits[2] = {
+    "func message {\n"
+    "    lui a1, 0x10000\n"
+    "    addiw a0, x0, 0x4e\n"
+    "    sb a0, 0(a1)\n"
+    "    jal ra, newline\n"
+    "    jalr x0, 0(ra)\n"
+    "}\n"
+    "\n"
+    "func newline {\n"
+    "    addiw a0, x0, 0xa\n"
+    "    sb a0, 0(a1)\n"
+    "    jalr x0, 0(ra)\n"
+    "}\n"
+    "\n"
+    TEST_FUNC_EXIT,
+
+    "func message {\n"
+    "    jalr x0, 0(ra)\n"
+    "}\n"
+    "\n"
+    "func exit {\n"
+    "    lui a1, 0x100\n"
+    "    sw a0, 0(a1)\n"
+    "}\n",
+};
+
+static char dir[] = "/tmp/mallard-served-rebuilds-XXXXXX";
+static char source_paths[2][256];
+
+static void write_unit(char* unit, uint64_t size, const char* output) {
+    snprintf(unit, size,
+             "executable \"%s/%s\" {\n"
+             "    files: [\"%s\", \"%s\"],\n"
+             "    code: 0x80000000,\n"
+             "    entry: entry,\n"
+             "}\n",
+             dir, output, source_paths[0], source_paths[1]);
+}
+
+/* What a fresh build of the current sources writes */
+static struct str expected_output(void) {
+    char unit[4096];
+    write_unit(unit, sizeof(unit), "expected.elf");
+    struct str input = {
+        .data = (uint8_t*) unit,
+        .size = strlen(unit),
+    };
+    compile(&input, 2);
+    char path[256];
+    snprintf(path, sizeof(path), "%s/expected.elf", dir);
+    return test_take_file(path);
+}
+
+int main(void) {
+    test_make_dir(dir);
+    for (uint64_t i = 0; i < 2; ++i) {
+        snprintf(source_paths[i], sizeof(source_paths[i]), "%s/%c.mpf",
+                 dir, (char) ('a' + i));
+        test_write_file(source_paths[i], sources[i]);
+    }
+    char unit_path[256];
+    snprintf(unit_path, sizeof(unit_path), "%s/unit.mpf", dir);
+    char unit[4096];
+    write_unit(unit, sizeof(unit), "out.elf");
+    test_write_file(unit_path, unit);
+    char socket_path[256];
+    snprintf(socket_path, sizeof(socket_path), "%s/serve.sock", dir);
+    char output_path[256];
+    snprintf(output_path, sizeof(output_path), "%s/out.elf", dir);
+
+    pid_t pid = fork();
+    assert(pid != -1);
+    if (pid == 0) {
+        struct compile_options options = {
+            .jobs = 2,
+        };
+        serve(unit_path, socket_path, &options);
+        _exit(0);
+    }
+
+    /* The first build is done before the server answers */
+    char reply[256];
+    assert(serve_request(socket_path, "build", reply, sizeof(reply)));
+    struct str expected = expected_output();
+    struct str actual = test_read_file(output_path);
+    assert(test_same(&actual, &expected));
+    free(actual.data);
+    free(expected.data);
+
+    /* A build request picks up an edit made just before it */
+    test_write_file(source_paths[1], edits[0]);
+    assert(serve_request(socket_path, "build", reply, sizeof(reply)));
+    expected = expected_output();
+    actual = test_read_file(output_path);
+    assert(test_same(&actual, &expected));
+    free(actual.data);
+    free(expected.data);
+
+    /* Without a request, the server rebuilds once it sees the edit */
+    test_write_file(source_paths[1], edits[1]);
+    expected = expected_output();
+    bool rebuilt = false;
+    for (uint64_t i = 0; i < 500 && !rebuilt; ++i) {
+        usleep(10000);
+        actual = test_read_file(output_path);
+        rebuilt = test_same(&actual, &expected);
+        free(actual.data);
+    }
+    assert(rebuilt);
+    free(expected.data);
+
+    /* An error is reported and the last output stays until it is fixed */
+    test_write_file(source_paths[1], "func message {\n    addiw a0, x0\n}\n");
+    assert(!serve_request(socket_path, "build", reply, sizeof(reply)));
+    assert(strncmp(reply, "error expected comma", 20) == 0);
+    assert(!serve_request(socket_path, "build", reply, sizeof(reply)));
+    test_write_file(source_paths[1], edits[0]);
+    assert(serve_request(socket_path, "build", reply, sizeof(reply)));
+    expected = expected_output();
+    actual = test_read_file(output_path);
+    assert(test_same(&actual, &expected));
+    free(actual.data);
+
+    /* So is an error in the unit itself, or in laying out an executable,
+       and the old unit is kept until the new one builds */
+    test_write_file(unit_path, "executable \"out.elf\" {\n    files: [\n");
+    assert(!serve_request(socket_path, "build", reply, sizeof(reply)));
+    assert(strncmp(reply, "error ", 6) == 0);
+    snprintf(unit, sizeof(unit),
+             "executable \"%s/out.elf\" {\n"
+             "    files: [\"%s\"],\n"
+             "    code: 0x80000000,\n"
+             "    entry: missing,\n"
+             "}\n",
+             dir, source_paths[1]);
+    test_write_file(unit_path, unit);
+    assert(!serve_request(socket_path, "build", reply, sizeof(reply)));
+    assert(strncmp(reply, "error ", 6) == 0);
+    actual = test_read_file(output_path);
+    assert(test_same(&actual, &expected));
+    free(actual.data);
+    write_unit(unit, sizeof(unit), "out.elf");
+    test_write_file(unit_path, unit);
+    assert(serve_request(socket_path, "build", reply, sizeof(reply)));
+    actual = test_read_file(output_path);
+    assert(test_same(&actual, &expected));
+    free(actual.data);
+    free(expected.data);
+
+    /* A client that never finishes its command is dropped, the next one is
+       still answered */
+    int stalled = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(stalled != -1);
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    strcpy(address.sun_path, socket_path);
+    assert(connect(stalled, (struct sockaddr*) &address,
+                   sizeof(address)) == 0);
+    assert(write(stalled, "bui", 3) == 3);
+    assert(serve_request(socket_path, "build", reply, sizeof(reply)));
+    char dropped;
+    assert(read(stalled, &dropped, 1) == 0);
+    close(stalled);
+
+    assert(!serve_request(socket_path, "unknown", reply, sizeof(reply)));
+    assert(serve_request(socket_path, "stop", reply, sizeof(reply)));
+    int status = 0;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    assert(access(socket_path, F_OK) == -1);
+
+    test_remove_dir(dir);
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "str_table.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEYS 5000
+
+int main(void) {
+    /* DJB2 gave "au" and "bT" the same hash, and every pair made by adding
+       the same suffix to both */
+    char (*names)[32] = calloc(KEYS, sizeof(*names));
+    struct str* keys = calloc(KEYS, sizeof(struct str));
+    assert(names != NULL && keys != NULL);
+    for (uint64_t i = 0; i < KEYS; ++i) {
+        if (i < 1000) {
+            snprintf(names[i], sizeof(names[i]), "%s%lu",
+                     i % 2 == 0 ? "au" : "bT", (unsigned long) i / 2);
+        }
+        else {
+            snprintf(names[i], sizeof(names[i]), "function_%lu",
+                     (unsigned long) i);
+        }
+        keys[i].data = (uint8_t*) names[i];
+        keys[i].size = strlen(names[i]);
+    }
+
+    /* Grows from 16 slots through several resizes */
+    struct str_table* str_table = str_table_create();
+    for (uint64_t i = 0; i < KEYS; ++i) {
+        str_table_insert(str_table, &keys[i], &names[i]);
+    }
+    assert(str_table_size(str_table) == KEYS);
+
+    for (uint64_t i = 0; i < KEYS; ++i) {
+        /* A copy of the key, found by contents rather than by pointer */
+        char name[32];
+        memcpy(name, names[i], sizeof(name));
+        struct str key = {
+            .data = (uint8_t*) name,
+            .size = keys[i].size,
+        };
+        struct str_table_entry* entry = str_table_get(str_table, &key);
+        assert(entry != NULL);
+        assert(entry->key == &keys[i]);
+        assert(entry->val == &names[i]);
+    }
+
+    const char* missing_names[] = {"", "au", "bT", "function_", "au500",
+                                   "function_5000"};
+    for (uint64_t i = 0; i < sizeof(missing_names) / sizeof(char*); ++i) {
+        struct str missing = {
+            .data = (uint8_t*) missing_names[i],
+            .size = strlen(missing_names[i]),
+        };
+        assert(str_table_get(str_table, &missing) == NULL);
+    }
+
+    uint64_t index = 0;
+    struct str_table_entry* iterator = str_table_iterator(str_table);
+    while (iterator != NULL) {
+        assert(iterator->key == &keys[index]);
+        ++index;
+        str_table_iterator_next(str_table, &iterator);
+    }
+    assert(index == KEYS);
+
+    str_table_destroy(str_table);
+    free(keys);
+    free(names);
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include "compile.h"
+#include "test_files.h"
+
+#include <sys/wait.h>
+
+static const char* source =
+    "func entry {\n"
+    "    jal ra, message\n"
+    "    jal ra, exit\n"
+    "}\n"
+    "\n"
+    TEST_FUNC_MESSAGE
+    "\n"
+    TEST_FUNC_EXIT;
+
+/* Writes the unit a few bytes at a time from another process, so tokens
+   and items are split across reads */
+static void compile_piped(const char* unit, uint64_t piece) {
+    int fds[2];
+    assert(pipe(fds) == 0);
+    pid_t pid = fork();
+    assert(pid != -1);
+    if (pid == 0) {
+        close(fds[0]);
+        uint64_t size = strlen(unit);
+        for (uint64_t i = 0; i < size; i += piece) {
+            uint64_t length = size - i < piece ? size - i : piece;
+            assert(write(fds[1], unit + i, length) == (ssize_t) length);
+            usleep(100);
+        }
+        close(fds[1]);
+        _exit(0);
+    }
+    close(fds[1]);
+    struct compile_options options = {
+        .jobs = 2,
+    };
+    compile_fd(fds[0], &options);
+    close(fds[0]);
+    int status = 0;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+int main(void) {
+    char dir[] = "/tmp/mallard-streamed-input-XXXXXX";
+    test_make_dir(dir);
+    char source_path[256];
+    snprintf(source_path, sizeof(source_path), "%s/source.mpf", dir);
+    test_write_file(source_path, source);
+
+    char output_path[256];
+    snprintf(output_path, sizeof(output_path), "%s/out.elf", dir);
+    char second_path[256];
+    snprintf(second_path, sizeof(second_path), "%s/out-2.elf", dir);
+    char unit[8192];
+    snprintf(unit, sizeof(unit),
+             "executable \"%s\" {\n"
+             "    files: [\"%s\"],\n"
+             "    code: 0x80000000,\n"
+             "    entry: entry,\n"
+             "}\n"
+             "executable \"%s\" {\n"
+             "    files: [\"%s\"],\n"
+             "    code: 0x80200000,\n"
+             "    entry: message,\n"
+             "}",
+             output_path, source_path, second_path, source_path);
+
+    struct str input = {
+        .data = (uint8_t*) unit,
+        .size = strlen(unit),
+    };
+    compile(&input, 2);
+    struct str expected = test_take_file(output_path);
+    struct str expected_second = test_take_file(second_path);
+
+    uint64_t pieces[] = {1, 3, 7, 4096};
+    for (uint64_t i = 0; i < sizeof(pieces) / sizeof(pieces[0]); ++i) {
+        compile_piped(unit, pieces[i]);
+        struct str actual = test_take_file(output_path);
+        assert(test_same(&actual, &expected));
+        free(actual.data);
+        actual = test_take_file(second_path);
+        assert(test_same(&actual, &expected_second));
+        free(actual.data);
+    }
+    free(expected.data);
+    free(expected_second.data);
+
+    test_remove_dir(dir);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include "symbol_table.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Enough names to need new segments, slot resizes and several chunks */
+#define NAMES 100000
+
+static uint32_t intern_name(struct symbol_table* symbols, uint64_t i) {
+    char name[32];
+    /* Long names fill the 64 KiB chunks quickly */
+    int size = snprintf(name, sizeof(name), "a_rather_long_name_%lu",
+                        (unsigned long) i);
+    return symbol_table_intern(symbols, (uint8_t*) name, size);
+}
+
+int main(void) {
+    struct symbol_table* symbols = symbol_table_create();
+    uint32_t kept = intern_name(symbols, 0);
+    uint64_t length = symbol_table_length(symbols);
+    assert(length == SYMBOL_PREDEFINED_LENGTH + 1);
+
+    /* Each round gives the names the same symbols as the first did */
+    for (uint64_t round = 0; round < 3; ++round) {
+        for (uint64_t i = 1; i < NAMES; ++i) {
+            assert(intern_name(symbols, i) == length + i - 1);
+        }
+        assert(symbol_table_length(symbols) == length + NAMES - 1);
+        symbol_table_truncate(symbols, length);
+        assert(symbol_table_length(symbols) == length);
+
+        /* Kept symbols are still found, removed ones are new again */
+        assert(intern_name(symbols, 0) == kept);
+        struct str str = symbol_table_str(symbols, kept);
+        assert(str.size == strlen("a_rather_long_name_0"));
+        assert(memcmp(str.data, "a_rather_long_name_0", str.size) == 0);
+        for (uint32_t i = 1; i < SYMBOL_PREDEFINED_LENGTH; ++i) {
+            str = symbol_table_str(symbols, i);
+            assert(symbol_table_intern(symbols, str.data, str.size) == i);
+        }
+        assert(symbol_table_length(symbols) == length);
+    }
+
+    symbol_table_destroy(symbols);
+    return 0;
+}
@@ -0,0 +1,166 @@
+#ifndef MALLARD_TEST_FILES_H
+#define MALLARD_TEST_FILES_H
+
+/* Scratch files for the tests, each test works in its own directory under
+   /tmp and removes it at the end */
+
+#include "file.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* The calls are made outside assert, which NDEBUG leaves empty */
+
+/* Creates the directory, dir is a template ending in XXXXXX */
+static inline void test_make_dir(char* dir) {
+    [[maybe_unused]] char* made = mkdtemp(dir);
+    assert(made != NULL);
+}
+
+/* Removes the directory and everything in it */
+static inline void test_remove_dir(const char* dir) {
+    DIR* entries = opendir(dir);
+    assert(entries != NULL);
+    struct dirent* entry = NULL;
+    while ((entry = readdir(entries)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0
+            || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        struct stat stat;
+        [[maybe_unused]] int result = lstat(path, &stat);
+        assert(result == 0);
+        if (S_ISDIR(stat.st_mode)) {
+            test_remove_dir(path);
+        }
+        else {
+            result = unlink(path);
+            assert(result == 0);
+        }
+    }
+    closedir(entries);
+    [[maybe_unused]] int result = rmdir(dir);
+    assert(result == 0);
+}
+
+/* Number of entries in the directory, other than . and .. */
+static inline uint64_t test_count_entries(const char* dir) {
+    DIR* entries = opendir(dir);
+    assert(entries != NULL);
+    uint64_t length = 0;
+    struct dirent* entry = NULL;
+    while ((entry = readdir(entries)) != NULL) {
+        if (strcmp(entry->d_name, ".") != 0
+            && strcmp(entry->d_name, "..") != 0) {
+            ++length;
+        }
+    }
+    closedir(entries);
+    return length;
+}
+
+static inline void test_write_file(const char* path, const char* contents) {
+    FILE* out = fopen(path, "w");
+    assert(out != NULL);
+    fputs(contents, out);
+    [[maybe_unused]] int result = fclose(out);
+    assert(result == 0);
+}
+
+/* A copy of the file, the caller frees its data */
+static inline struct str test_read_file(const char* path) {
+    struct str mapped = file_open_read_mmap(path);
+    struct str copy = {
+        .data = malloc(mapped.size + 1),
+        .size = mapped.size,
+    };
+    assert(copy.data != NULL);
+    memcpy(copy.data, mapped.data, mapped.size);
+    /* Text files can be used as C strings */
+    copy.data[mapped.size] = '\0';
+    file_close_mmap(&mapped);
+    return copy;
+}
+
+/* Reads the file like test_read_file, then removes it */
+static inline struct str test_take_file(const char* path) {
+    struct str copy = test_read_file(path);
+    [[maybe_unused]] int result = unlink(path);
+    assert(result == 0);
+    return copy;
+}
+
+static inline bool test_same(struct str* a, struct str* b) {
+    return a->size == b->size && memcmp(a->data, b->data, a->size) == 0;
+}
+
+/* Functions the test sources share, message writes M to the UART and exit
+   stops QEMU through its test device */
+#define TEST_FUNC_MESSAGE \
+    "func message {\n" \
+    "    lui a1, 0x10000\n" \
+    "    addiw a0, x0, 0x4d\n" \
+    "    sb a0, 0(a1)\n" \
+    "    jalr x0, 0(ra)\n" \
+    "}\n"
+#define TEST_FUNC_EXIT \
+    "func exit {\n" \
+    "    lui a0, 0x5\n" \
+    "    addiw a0, a0, 0x555\n" \
+    "    lui a1, 0x100\n" \
+    "    sw a0, 0(a1)\n" \
+    "}\n"
+
+#define TEST_UNIT_FILES 2
+
+/* Two files, the entry in the first calls exit in the second */
+static const char* test_unit_sources[TEST_UNIT_FILES] = {
+    "func entry {\n"
+    "    jal ra, exit\n"
+    "}\n",
+
+    TEST_FUNC_EXIT,
+};
+
+struct test_unit {
+    char source_paths[TEST_UNIT_FILES][256];
+    /* Links both files into dir/a.elf */
+    char unit[4096];
+    struct str input;
+};
+
+/* Writes the sources into dir as 0.mpf and 1.mpf, or as names */
+static inline void test_write_unit(struct test_unit* unit,
+                                   const char* dir,
+                                   const char** names) {
+    for (uint64_t i = 0; i < TEST_UNIT_FILES; ++i) {
+        if (names == NULL) {
+            snprintf(unit->source_paths[i], sizeof(unit->source_paths[i]),
+                     "%s/%lu.mpf", dir, (unsigned long) i);
+        }
+        else {
+            snprintf(unit->source_paths[i], sizeof(unit->source_paths[i]),
+                     "%s/%s", dir, names[i]);
+        }
+        test_write_file(unit->source_paths[i], test_unit_sources[i]);
+    }
+    snprintf(unit->unit, sizeof(unit->unit),
+             "executable \"%s/a.elf\" {\n"
+             "    files: [\"%s\", \"%s\"],\n"
+             "    code: 0x80000000,\n"
+             "    entry: entry,\n"
+             "}\n",
+             dir, unit->source_paths[0], unit->source_paths[1]);
+    unit->input.data = (uint8_t*) unit->unit;
+    unit->input.size = strlen(unit->unit);
+}
+
+#endif /* ifndef MALLARD_TEST_FILES_H */
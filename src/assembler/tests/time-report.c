@@ -0,0 +1,61 @@
+#include "compile.h"
+#include "test_files.h"
+#include "time_report.h"
+
+int main(void) {
+    char dir[] = "/tmp/mallard-time-report-XXXXXX";
+    test_make_dir(dir);
+    struct test_unit unit;
+    test_write_unit(&unit, dir, NULL);
+    struct time_report* time_report = time_report_create();
+    struct compile_options options = {
+        .jobs = 2,
+        .time_report = time_report,
+    };
+    compile_with_options(&unit.input, &options);
+
+    /* Every phase ran, and the front end of each file is reported */
+    assert(time_report->nanoseconds > 0);
+    for (uint64_t i = 0; i < TIME_PHASE_LENGTH; ++i) {
+        assert(time_report->phases[i].nanoseconds > 0);
+    }
+    assert(time_report->phases[TIME_PHASE_LEX].allocations > 0);
+    assert(time_report->phases[TIME_PHASE_FINALIZE].allocations > 0);
+    assert(time_report->phases[TIME_PHASE_WRITE].allocations > 0);
+    assert(time_report->phases[TIME_PHASE_PARSE].bytes > 0);
+    assert(time_report->files_length == 2);
+    for (uint64_t i = 0; i < 2; ++i) {
+        struct time_report_file* file = &time_report->files[i];
+        assert(strcmp(file->path, unit.source_paths[i]) == 0);
+        assert(file->size == strlen(test_unit_sources[i]));
+        assert(file->phases[TIME_PHASE_LEX].nanoseconds > 0);
+        assert(file->phases[TIME_PHASE_PARSE].allocations > 0);
+        assert(file->phases[TIME_PHASE_ANALYZE].nanoseconds > 0);
+        assert(file->phases[TIME_PHASE_LEX].nanoseconds
+               <= time_report->phases[TIME_PHASE_LEX].nanoseconds);
+    }
+    if (time_report->hardware_counters) {
+        assert(time_report->phases[TIME_PHASE_LEX].instructions > 0);
+    }
+
+    char json_path[256];
+    snprintf(json_path, sizeof(json_path), "%s/report.json", dir);
+    time_report_write_json(time_report, json_path);
+    struct str json = test_take_file(json_path);
+    char* text = (char*) json.data;
+    assert(strncmp(text, "{\"nanoseconds\": ", 16) == 0);
+    assert(strstr(text, "\"finalize\": {\"nanoseconds\": ") != NULL);
+    char path_key[512];
+    snprintf(path_key, sizeof(path_key), "{\"path\": \"%s\", \"size\": %lu",
+             unit.source_paths[1],
+             (unsigned long) strlen(test_unit_sources[1]));
+    assert(strstr(text, path_key) != NULL);
+    if (!time_report->hardware_counters) {
+        assert(strstr(text, "\"cycles\": null") != NULL);
+    }
+    free(json.data);
+    time_report_destroy(time_report);
+
+    test_remove_dir(dir);
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include "compile.h"
+#include "test_files.h"
+#include "trace.h"
+
+static uint64_t count(const char* text, const char* needle) {
+    uint64_t found = 0;
+    for (const char* c = strstr(text, needle); c != NULL;
+         c = strstr(c + 1, needle)) {
+        ++found;
+    }
+    return found;
+}
+
+int main(void) {
+    char dir[] = "/tmp/mallard-trace-events-XXXXXX";
+    test_make_dir(dir);
+    struct test_unit unit;
+    test_write_unit(&unit, dir, NULL);
+    char trace_path[256];
+    snprintf(trace_path, sizeof(trace_path), "%s/trace.json", dir);
+
+    /* A second trace on the same threads starts with empty buffers */
+    for (uint64_t run = 0; run < 2; ++run) {
+        struct compile_options options = {
+            .jobs = 2,
+            .trace = trace_create(),
+        };
+        compile_with_options(&unit.input, &options);
+        trace_write_json(options.trace, trace_path);
+        trace_destroy(options.trace);
+
+        struct str trace = test_take_file(trace_path);
+        char* text = (char*) trace.data;
+        assert(strncmp(text, "{\"displayTimeUnit\": \"ns\", "
+                             "\"traceEvents\": [", 40) == 0);
+        /* The unit and each file are lexed once */
+        assert(count(text, "{\"name\": \"lex\"") == 3);
+        assert(count(text, "{\"name\": \"encode\"") == 2);
+        assert(count(text, "{\"name\": \"fixup\"") == 1);
+        assert(count(text, "{\"name\": \"layout\"") == 1);
+        assert(count(text, "{\"name\": \"write\"") == 1);
+        for (uint64_t i = 0; i < 2; ++i) {
+            char detail[1024];
+            snprintf(detail, sizeof(detail), "\"args\": {\"detail\": \"%s\"}",
+                     unit.source_paths[i]);
+            /* Lexed, parsed and one function analyzed */
+            assert(count(text, detail) == 3);
+        }
+        assert(count(text, "\"args\": {\"detail\": \"exit\"}") == 1);
+        free(text);
+    }
+
+    test_remove_dir(dir);
+    return 0;
+}
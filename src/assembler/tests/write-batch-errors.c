@@ -0,0 +1,57 @@
+#include "fatal_error.h"
+#include "test_files.h"
+
+#define FILES 3
+
+/* Writes length files, the last over a directory, which fails */
+static void write_failing(const char* dir, uint64_t length) {
+    char paths[FILES][256];
+    char data[] = "contents";
+    struct iovec iov = {
+        .iov_base = data,
+        .iov_len = sizeof(data),
+    };
+    struct file_write writes[FILES];
+    for (uint64_t i = 0; i < length; ++i) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/%lu", dir,
+                 (unsigned long) i);
+        writes[i].path = paths[i];
+        writes[i].iov = &iov;
+        writes[i].iov_length = 1;
+    }
+    char blocker[256];
+    snprintf(blocker, sizeof(blocker), "%s/blocker", paths[length - 1]);
+    assert(mkdir(paths[length - 1], 0777) == 0);
+    assert(mkdir(blocker, 0777) == 0);
+
+    struct fatal_error_context context;
+    struct fatal_error_context* previous = fatal_error_set_context(&context);
+    if (setjmp(context.jump) == 0) {
+        file_write_batch(writes, length);
+        assert(false);
+    }
+    fatal_error_set_context(previous);
+    assert(strcmp(context.message, "file rename failed") == 0);
+
+    /* The others were written whole, the failed one left no temporary */
+    for (uint64_t i = 0; i + 1 < length; ++i) {
+        struct str written = test_take_file(paths[i]);
+        assert(written.size == sizeof(data));
+        assert(memcmp(written.data, data, sizeof(data)) == 0);
+        free(written.data);
+    }
+    assert(test_count_entries(dir) == 1);
+
+    rmdir(blocker);
+    rmdir(paths[length - 1]);
+}
+
+int main(void) {
+    char dir[] = "/tmp/mallard-write-batch-errors-XXXXXX";
+    test_make_dir(dir);
+    /* One file is written without io_uring, several with it if allowed */
+    write_failing(dir, 1);
+    write_failing(dir, FILES);
+    test_remove_dir(dir);
+    return 0;
+}
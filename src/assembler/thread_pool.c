@@ -0,0 +1,282 @@
+#include "thread_pool.h"
+
+#include "alloc.h"
+#include "fatal_error.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct thread_pool_job {
+    void (*function)(void* arg);
+    void* arg;
+};
+
+/* A ring buffer of jobs that have not started. The owning worker pushes and
+   pops at the bottom, other workers steal from the top. */
+struct thread_pool_deque {
+    pthread_mutex_t mutex;
+    struct thread_pool_job* jobs;
+    uint64_t capacity;
+    uint64_t head;
+    uint64_t length;
+};
+
+struct thread_pool {
+    /* One deque per worker */
+    struct thread_pool_deque* deques;
+    /* Deque for the next job submitted from outside the pool */
+    uint64_t next_deque;
+
+    /* Jobs in a deque, and jobs that were submitted and have not finished */
+    uint64_t pending;
+    uint64_t outstanding;
+
+    pthread_mutex_t mutex;
+    /* Signaled when a job is submitted to sleeping workers or the pool is
+       shutting down */
+    pthread_cond_t job_available;
+    /* Signaled when the last outstanding job finishes */
+    pthread_cond_t jobs_done;
+    uint64_t sleeping;
+    bool shutdown;
+
+    pthread_t* threads;
+    uint64_t threads_length;
+};
+
+struct thread_pool_worker_arg {
+    struct thread_pool* thread_pool;
+    uint64_t index;
+};
+
+/* Set for the workers of a pool, so a job submitting another job can push
+   to its own deque */
+static _Thread_local struct thread_pool* current_thread_pool = NULL;
+static _Thread_local uint64_t current_worker_index = 0;
+
+uint64_t thread_pool_default_threads(void) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online < 1) {
+        return 1;
+    }
+    return online;
+}
+
+static void thread_pool_deque_init(struct thread_pool_deque* deque) {
+    pthread_mutex_init(&deque->mutex, NULL);
+    deque->capacity = 64;
+    deque->jobs = xcalloc(deque->capacity, sizeof(struct thread_pool_job));
+}
+
+static void thread_pool_deque_grow(struct thread_pool_deque* deque) {
+    uint64_t capacity = deque->capacity * 2;
+    struct thread_pool_job* jobs
+        = xcalloc(capacity, sizeof(struct thread_pool_job));
+    for (uint64_t i = 0; i < deque->length; ++i) {
+        jobs[i] = deque->jobs[(deque->head + i) % deque->capacity];
+    }
+    free(deque->jobs);
+    deque->jobs = jobs;
+    deque->capacity = capacity;
+    deque->head = 0;
+}
+
+static void thread_pool_deque_push(struct thread_pool_deque* deque,
+                                   struct thread_pool_job job) {
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->length == deque->capacity) {
+        thread_pool_deque_grow(deque);
+    }
+    deque->jobs[(deque->head + deque->length) % deque->capacity] = job;
+    ++(deque->length);
+    pthread_mutex_unlock(&deque->mutex);
+}
+
+/* The newest job, its data is the most likely to still be in cache */
+static bool thread_pool_deque_pop(struct thread_pool_deque* deque,
+                                  struct thread_pool_job* job) {
+    pthread_mutex_lock(&deque->mutex);
+    bool found = deque->length != 0;
+    if (found) {
+        --(deque->length);
+        *job = deque->jobs[(deque->head + deque->length) % deque->capacity];
+    }
+    pthread_mutex_unlock(&deque->mutex);
+    return found;
+}
+
+/* The oldest job, which tends to be the largest piece of work left */
+static bool thread_pool_deque_steal(struct thread_pool_deque* deque,
+                                    struct thread_pool_job* job) {
+    pthread_mutex_lock(&deque->mutex);
+    bool found = deque->length != 0;
+    if (found) {
+        *job = deque->jobs[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+        --(deque->length);
+    }
+    pthread_mutex_unlock(&deque->mutex);
+    return found;
+}
+
+static void thread_pool_deque_destroy(struct thread_pool_deque* deque) {
+    pthread_mutex_destroy(&deque->mutex);
+    free(deque->jobs);
+}
+
+static bool thread_pool_take(struct thread_pool* thread_pool,
+                             uint64_t index,
+                             struct thread_pool_job* job) {
+    if (thread_pool_deque_pop(&thread_pool->deques[index], job)) {
+        return true;
+    }
+    for (uint64_t i = 1; i < thread_pool->threads_length; ++i) {
+        uint64_t victim = (index + i) % thread_pool->threads_length;
+        if (thread_pool_deque_steal(&thread_pool->deques[victim], job)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void* thread_pool_worker(void* arg) {
+    struct thread_pool_worker_arg* worker_arg = arg;
+    struct thread_pool* thread_pool = worker_arg->thread_pool;
+    uint64_t index = worker_arg->index;
+    free(worker_arg);
+
+    current_thread_pool = thread_pool;
+    current_worker_index = index;
+
+    while (true) {
+        struct thread_pool_job job;
+        if (thread_pool_take(thread_pool, index, &job)) {
+            __atomic_sub_fetch(&thread_pool->pending, 1, __ATOMIC_SEQ_CST);
+            job.function(job.arg);
+            if (__atomic_sub_fetch(&thread_pool->outstanding, 1,
+                                   __ATOMIC_SEQ_CST) == 0) {
+                pthread_mutex_lock(&thread_pool->mutex);
+                pthread_cond_broadcast(&thread_pool->jobs_done);
+                pthread_mutex_unlock(&thread_pool->mutex);
+            }
+            continue;
+        }
+
+        /* Announce sleeping before checking for jobs, a submit either sees
+           a sleeper to wake or this sees its job */
+        pthread_mutex_lock(&thread_pool->mutex);
+        __atomic_add_fetch(&thread_pool->sleeping, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&thread_pool->pending, __ATOMIC_SEQ_CST) == 0
+               && !thread_pool->shutdown) {
+            pthread_cond_wait(&thread_pool->job_available, &thread_pool->mutex);
+        }
+        __atomic_sub_fetch(&thread_pool->sleeping, 1, __ATOMIC_SEQ_CST);
+        bool shutdown = thread_pool->shutdown
+            && __atomic_load_n(&thread_pool->pending, __ATOMIC_SEQ_CST) == 0;
+        pthread_mutex_unlock(&thread_pool->mutex);
+        if (shutdown) {
+            break;
+        }
+    }
+
+    current_thread_pool = NULL;
+    return NULL;
+}
+
+struct thread_pool* thread_pool_create(uint64_t threads) {
+    if (threads == 0) {
+        fatal_error("thread pool needs at least one thread");
+    }
+
+    struct thread_pool* thread_pool = xcalloc(1, sizeof(struct thread_pool));
+    pthread_mutex_init(&thread_pool->mutex, NULL);
+    pthread_cond_init(&thread_pool->job_available, NULL);
+    pthread_cond_init(&thread_pool->jobs_done, NULL);
+
+    thread_pool->deques = xcalloc(threads, sizeof(struct thread_pool_deque));
+    for (uint64_t i = 0; i < threads; ++i) {
+        thread_pool_deque_init(&thread_pool->deques[i]);
+    }
+    thread_pool->threads_length = threads;
+
+    thread_pool->threads = xcalloc(threads, sizeof(pthread_t));
+    for (uint64_t i = 0; i < threads; ++i) {
+        struct thread_pool_worker_arg* worker_arg
+            = xmalloc(sizeof(struct thread_pool_worker_arg));
+        worker_arg->thread_pool = thread_pool;
+        worker_arg->index = i;
+        if (pthread_create(&thread_pool->threads[i], NULL,
+                           thread_pool_worker, worker_arg) != 0) {
+            fatal_error("thread pool thread create failed");
+        }
+    }
+
+    return thread_pool;
+}
+
+uint64_t thread_pool_threads(struct thread_pool* thread_pool) {
+    return thread_pool->threads_length;
+}
+
+uint64_t thread_pool_worker_index(struct thread_pool* thread_pool) {
+    if (current_thread_pool != thread_pool) {
+        return thread_pool->threads_length;
+    }
+    return current_worker_index;
+}
+
+void thread_pool_submit(struct thread_pool* thread_pool,
+                        void (*function)(void* arg),
+                        void* arg) {
+    struct thread_pool_job job = {
+        .function = function,
+        .arg = arg,
+    };
+    uint64_t index = thread_pool_worker_index(thread_pool);
+    if (index == thread_pool->threads_length) {
+        index = __atomic_fetch_add(&thread_pool->next_deque, 1,
+                                   __ATOMIC_RELAXED)
+                % thread_pool->threads_length;
+    }
+    /* Counted before the push, so taking the job never underflows */
+    __atomic_add_fetch(&thread_pool->outstanding, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&thread_pool->pending, 1, __ATOMIC_SEQ_CST);
+    thread_pool_deque_push(&thread_pool->deques[index], job);
+
+    if (__atomic_load_n(&thread_pool->sleeping, __ATOMIC_SEQ_CST) != 0) {
+        pthread_mutex_lock(&thread_pool->mutex);
+        pthread_cond_signal(&thread_pool->job_available);
+        pthread_mutex_unlock(&thread_pool->mutex);
+    }
+}
+
+void thread_pool_wait(struct thread_pool* thread_pool) {
+    pthread_mutex_lock(&thread_pool->mutex);
+    while (__atomic_load_n(&thread_pool->outstanding, __ATOMIC_SEQ_CST) != 0) {
+        pthread_cond_wait(&thread_pool->jobs_done, &thread_pool->mutex);
+    }
+    pthread_mutex_unlock(&thread_pool->mutex);
+}
+
+void thread_pool_destroy(struct thread_pool* thread_pool) {
+    pthread_mutex_lock(&thread_pool->mutex);
+    thread_pool->shutdown = true;
+    pthread_cond_broadcast(&thread_pool->job_available);
+    pthread_mutex_unlock(&thread_pool->mutex);
+
+    for (uint64_t i = 0; i < thread_pool->threads_length; ++i) {
+        pthread_join(thread_pool->threads[i], NULL);
+    }
+
+    for (uint64_t i = 0; i < thread_pool->threads_length; ++i) {
+        thread_pool_deque_destroy(&thread_pool->deques[i]);
+    }
+    pthread_cond_destroy(&thread_pool->jobs_done);
+    pthread_cond_destroy(&thread_pool->job_available);
+    pthread_mutex_destroy(&thread_pool->mutex);
+    free(thread_pool->deques);
+    free(thread_pool->threads);
+    free(thread_pool);
+}
@@ -0,0 +1,22 @@
+#ifndef MALLARD_THREAD_POOL_H
+#define MALLARD_THREAD_POOL_H
+
+#include <stdint.h>
+
+struct thread_pool;
+
+uint64_t thread_pool_default_threads(void);
+struct thread_pool* thread_pool_create(uint64_t threads);
+uint64_t thread_pool_threads(struct thread_pool* thread_pool);
+/* The calling worker's index, or thread_pool_threads outside the pool */
+uint64_t thread_pool_worker_index(struct thread_pool* thread_pool);
+/* Jobs submitted by a job run on the same worker unless another worker
+   steals them */
+void thread_pool_submit(struct thread_pool* thread_pool,
+                        void (*function)(void* arg),
+                        void* arg);
+/* Waits for every job, a job must not call this on its own pool */
+void thread_pool_wait(struct thread_pool* thread_pool);
+void thread_pool_destroy(struct thread_pool* thread_pool);
+
+#endif /* ifndef MALLARD_THREAD_POOL_H */
@@ -0,0 +1,316 @@
+#include "time_report.h"
+
+#include "alloc.h"
+#include "fatal_error.h"
+
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TIME_PERF_LENGTH 3
+
+static const uint64_t time_perf_configs[TIME_PERF_LENGTH] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+};
+
+static const char* time_phase_names[TIME_PHASE_LENGTH] = {
+    "read", "lex", "parse", "analyze", "finalize", "write",
+};
+
+/* Each thread counts its own events, the counters are opened the first
+   time a thread takes a sample and closed when it exits */
+struct time_perf {
+    int fds[TIME_PERF_LENGTH];
+};
+
+static pthread_once_t time_perf_once = PTHREAD_ONCE_INIT;
+static pthread_key_t time_perf_key;
+static bool time_perf_available = false;
+static _Thread_local struct time_perf* time_perf = NULL;
+
+static void time_perf_close(void* arg) {
+    struct time_perf* perf = arg;
+    for (uint64_t i = 0; i < TIME_PERF_LENGTH; ++i) {
+        close(perf->fds[i]);
+    }
+    free(perf);
+}
+
+static struct time_perf* time_perf_open(void) {
+    struct time_perf* perf = xcalloc(1, sizeof(struct time_perf));
+    for (uint64_t i = 0; i < TIME_PERF_LENGTH; ++i) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = time_perf_configs[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        /* This thread only, on any CPU */
+        perf->fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (perf->fds[i] == -1) {
+            for (uint64_t j = 0; j < i; ++j) {
+                close(perf->fds[j]);
+            }
+            free(perf);
+            return NULL;
+        }
+    }
+    return perf;
+}
+
+static void time_perf_init(void) {
+    /* Containers and virtual machines often have no counters to give */
+    struct time_perf* perf = time_perf_open();
+    if (perf == NULL) {
+        return;
+    }
+    time_perf_close(perf);
+    if (pthread_key_create(&time_perf_key, time_perf_close) != 0) {
+        fatal_error("time report key create failed");
+    }
+    time_perf_available = true;
+}
+
+static void time_perf_read(struct time_counters* counters) {
+    if (!time_perf_available) {
+        return;
+    }
+    if (time_perf == NULL) {
+        time_perf = time_perf_open();
+        if (time_perf == NULL) {
+            return;
+        }
+        pthread_setspecific(time_perf_key, time_perf);
+    }
+    uint64_t* values[TIME_PERF_LENGTH] = {
+        &counters->cycles, &counters->instructions, &counters->cache_misses,
+    };
+    for (uint64_t i = 0; i < TIME_PERF_LENGTH; ++i) {
+        uint64_t value = 0;
+        if (read(time_perf->fds[i], &value, sizeof(value)) == sizeof(value)) {
+            *values[i] = value;
+        }
+    }
+}
+
+struct time_report* time_report_create(void) {
+    struct time_report* time_report = xcalloc(1, sizeof(struct time_report));
+    pthread_once(&time_perf_once, time_perf_init);
+    time_report->hardware_counters = time_perf_available;
+    return time_report;
+}
+
+void time_report_destroy(struct time_report* time_report) {
+    for (uint64_t i = 0; i < time_report->files_length; ++i) {
+        free((void*) time_report->files[i].path);
+    }
+    free(time_report->files);
+    free(time_report);
+}
+
+struct time_report_file* time_report_add_files(
+    struct time_report* time_report,
+    uint64_t length
+) {
+    uint64_t files_length = time_report->files_length + length;
+    struct time_report_file* files
+        = xrealloc(time_report->files,
+                   (files_length + 1) * sizeof(struct time_report_file));
+    memset(files + time_report->files_length, 0,
+           (length + 1) * sizeof(struct time_report_file));
+    struct time_report_file* added = files + time_report->files_length;
+    time_report->files = files;
+    time_report->files_length = files_length;
+    return added;
+}
+
+const char* time_phase_name(enum time_phase phase) {
+    return time_phase_names[phase];
+}
+
+uint64_t time_report_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void time_counters_now(struct time_counters* counters) {
+    counters->nanoseconds = time_report_now();
+    counters->allocations = alloc_allocations;
+    counters->bytes = alloc_bytes;
+    time_perf_read(counters);
+}
+
+void time_sample_start(struct time_sample* sample) {
+    memset(&sample->start, 0, sizeof(sample->start));
+    time_counters_now(&sample->start);
+}
+
+static void time_counters_add(struct time_counters* total,
+                              struct time_counters* delta) {
+    if (total == NULL) {
+        return;
+    }
+    __atomic_add_fetch(&total->nanoseconds, delta->nanoseconds,
+                       __ATOMIC_RELAXED);
+    __atomic_add_fetch(&total->allocations, delta->allocations,
+                       __ATOMIC_RELAXED);
+    __atomic_add_fetch(&total->bytes, delta->bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&total->cycles, delta->cycles, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&total->instructions, delta->instructions,
+                       __ATOMIC_RELAXED);
+    __atomic_add_fetch(&total->cache_misses, delta->cache_misses,
+                       __ATOMIC_RELAXED);
+}
+
+void time_sample_stop(struct time_sample* sample,
+                      struct time_counters* total,
+                      struct time_counters* file_total) {
+    struct time_counters now;
+    memset(&now, 0, sizeof(now));
+    time_counters_now(&now);
+    struct time_counters delta = {
+        .nanoseconds = now.nanoseconds - sample->start.nanoseconds,
+        .allocations = now.allocations - sample->start.allocations,
+        .bytes = now.bytes - sample->start.bytes,
+        .cycles = now.cycles - sample->start.cycles,
+        .instructions = now.instructions - sample->start.instructions,
+        .cache_misses = now.cache_misses - sample->start.cache_misses,
+    };
+    time_counters_add(total, &delta);
+    time_counters_add(file_total, &delta);
+}
+
+static void time_report_print_row(struct time_report* time_report,
+                                  FILE* out,
+                                  const char* name,
+                                  struct time_counters* counters) {
+    fprintf(out, "  %-10s %10.3f %12lu %14lu", name,
+            counters->nanoseconds / 1e6,
+            (unsigned long) counters->allocations,
+            (unsigned long) counters->bytes);
+    if (time_report->hardware_counters) {
+        fprintf(out, " %14lu %14lu %12lu",
+                (unsigned long) counters->cycles,
+                (unsigned long) counters->instructions,
+                (unsigned long) counters->cache_misses);
+    }
+    fprintf(out, "\n");
+}
+
+static void time_report_print_header(struct time_report* time_report,
+                                     FILE* out) {
+    fprintf(out, "  %-10s %10s %12s %14s", "phase", "ms", "allocations",
+            "bytes");
+    if (time_report->hardware_counters) {
+        fprintf(out, " %14s %14s %12s", "cycles", "instructions",
+                "cache misses");
+    }
+    fprintf(out, "\n");
+}
+
+void time_report_print(struct time_report* time_report, FILE* out) {
+    fprintf(out, "time report: %.3f ms wall, phases add up across "
+                 "threads\n", time_report->nanoseconds / 1e6);
+    if (!time_report->hardware_counters) {
+        fprintf(out, "hardware counters are not available\n");
+    }
+    time_report_print_header(time_report, out);
+    for (uint64_t i = 0; i < TIME_PHASE_LENGTH; ++i) {
+        time_report_print_row(time_report, out, time_phase_names[i],
+                              &time_report->phases[i]);
+    }
+    for (uint64_t i = 0; i < time_report->files_length; ++i) {
+        struct time_report_file* file = &time_report->files[i];
+        fprintf(out, "%s (%lu bytes)\n", file->path,
+                (unsigned long) file->size);
+        /* Only the front end runs per file */
+        for (uint64_t j = TIME_PHASE_LEX; j <= TIME_PHASE_ANALYZE; ++j) {
+            time_report_print_row(time_report, out, time_phase_names[j],
+                                  &file->phases[j]);
+        }
+    }
+}
+
+void time_report_json_string(FILE* out, const char* data, uint64_t size) {
+    fputc('"', out);
+    for (uint64_t i = 0; i < size; ++i) {
+        unsigned char c = data[i];
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        }
+        else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        }
+        else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void time_report_json_phases(struct time_report* time_report,
+                                    FILE* out,
+                                    struct time_counters* phases,
+                                    uint64_t first,
+                                    uint64_t last) {
+    fprintf(out, "{");
+    for (uint64_t i = first; i <= last; ++i) {
+        struct time_counters* counters = &phases[i];
+        fprintf(out, "%s\"%s\": {\"nanoseconds\": %lu, \"allocations\": %lu, "
+                     "\"bytes\": %lu",
+                i == first ? "" : ", ", time_phase_names[i],
+                (unsigned long) counters->nanoseconds,
+                (unsigned long) counters->allocations,
+                (unsigned long) counters->bytes);
+        if (time_report->hardware_counters) {
+            fprintf(out, ", \"cycles\": %lu, \"instructions\": %lu, "
+                         "\"cache_misses\": %lu",
+                    (unsigned long) counters->cycles,
+                    (unsigned long) counters->instructions,
+                    (unsigned long) counters->cache_misses);
+        }
+        else {
+            fprintf(out, ", \"cycles\": null, \"instructions\": null, "
+                         "\"cache_misses\": null");
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "}");
+}
+
+void time_report_write_json(struct time_report* time_report,
+                            const char* path) {
+    FILE* out = fopen(path, "w");
+    if (out == NULL) {
+        fatal_error("time report open failed");
+    }
+    fprintf(out, "{\"nanoseconds\": %lu, \"hardware_counters\": %s, "
+                 "\"phases\": ",
+            (unsigned long) time_report->nanoseconds,
+            time_report->hardware_counters ? "true" : "false");
+    time_report_json_phases(time_report, out, time_report->phases,
+                            0, TIME_PHASE_LENGTH - 1);
+    fprintf(out, ", \"files\": [");
+    for (uint64_t i = 0; i < time_report->files_length; ++i) {
+        struct time_report_file* file = &time_report->files[i];
+        fprintf(out, "%s{\"path\": ", i == 0 ? "" : ", ");
+        time_report_json_string(out, file->path, strlen(file->path));
+        fprintf(out, ", \"size\": %lu, \"phases\": ",
+                (unsigned long) file->size);
+        time_report_json_phases(time_report, out, file->phases,
+                                TIME_PHASE_LEX, TIME_PHASE_ANALYZE);
+        fprintf(out, "}");
+    }
+    fprintf(out, "]}\n");
+    if (fclose(out) != 0) {
+        fatal_error("time report write failed");
+    }
+}
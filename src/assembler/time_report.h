@@ -0,0 +1,71 @@
+#ifndef MALLARD_TIME_REPORT_H
+#define MALLARD_TIME_REPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum time_phase {
+    TIME_PHASE_READ,
+    TIME_PHASE_LEX,
+    TIME_PHASE_PARSE,
+    TIME_PHASE_ANALYZE,
+    TIME_PHASE_FINALIZE,
+    TIME_PHASE_WRITE,
+    TIME_PHASE_LENGTH,
+};
+
+/* What one thread spent. Phases on several threads at once add up, so a
+   phase's time can be more than the wall time. */
+struct time_counters {
+    uint64_t nanoseconds;
+    uint64_t allocations;
+    uint64_t bytes;
+    /* Only counted where perf_event_open is allowed */
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t cache_misses;
+};
+
+struct time_report_file {
+    const char* path;
+    uint64_t size;
+    struct time_counters phases[TIME_PHASE_LENGTH];
+};
+
+struct time_report {
+    uint64_t nanoseconds;
+    bool hardware_counters;
+    struct time_counters phases[TIME_PHASE_LENGTH];
+    struct time_report_file* files;
+    uint64_t files_length;
+};
+
+/* The counters of the calling thread at the start of a phase */
+struct time_sample {
+    struct time_counters start;
+};
+
+struct time_report* time_report_create(void);
+void time_report_destroy(struct time_report* time_report);
+/* Adds length files, the caller sets their paths, which the report frees,
+   and sizes */
+struct time_report_file* time_report_add_files(
+    struct time_report* time_report,
+    uint64_t length
+);
+uint64_t time_report_now(void);
+const char* time_phase_name(enum time_phase phase);
+void time_sample_start(struct time_sample* sample);
+/* Adds what the thread spent since the start to each non-NULL total, other
+   threads may add to the same totals at once */
+void time_sample_stop(struct time_sample* sample,
+                      struct time_counters* total,
+                      struct time_counters* file_total);
+void time_report_print(struct time_report* time_report, FILE* out);
+void time_report_write_json(struct time_report* time_report,
+                            const char* path);
+/* Writes size bytes of data as a quoted JSON string, for the trace too */
+void time_report_json_string(FILE* out, const char* data, uint64_t size);
+
+#endif /* ifndef MALLARD_TIME_REPORT_H */
@@ -25,6 +25,8 @@ enum token_kind {
 struct token {
     uint64_t kind;
     struct str str;
+    /* Only identifiers have a symbol, other tokens are SYMBOL_NONE */
+    uint32_t symbol;
 };
 
 bool token_equals_c_str(struct token* token, const char* c_str);
@@ -1,47 +1,158 @@
 #include "tokens.h"
 #include "token.h"
 
+#include "alloc.h"
+#include "fatal_error.h"
+
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-void token_init(struct tokens* tokens) {
-    tokens->vector.capacity = 4 * 4096;
-    tokens->vector.data = malloc(tokens->vector.capacity);
-    if (tokens->vector.data == NULL) {
-        exit(1);
+static void token_reserve(struct tokens* tokens, uint64_t length) {
+    if (tokens->capacity >= length) {
+        return;
+    }
+    uint64_t capacity = tokens->capacity * 2;
+    if (capacity < length) {
+        capacity = length;
     }
-    tokens->vector.size = 0;
+    tokens->kinds = xrealloc(tokens->kinds, capacity * sizeof(uint8_t));
+    tokens->offsets = xrealloc(tokens->offsets, capacity * sizeof(uint32_t));
+    tokens->lengths = xrealloc(tokens->lengths, capacity * sizeof(uint16_t));
+    tokens->capacity = capacity;
+}
+
+void token_init(struct tokens* tokens,
+                uint8_t* source,
+                struct symbol_table* symbols) {
+    tokens->source = source;
+    tokens->symbols = symbols;
+    tokens->kinds = NULL;
+    tokens->offsets = NULL;
+    tokens->lengths = NULL;
     tokens->length = 0;
+    tokens->capacity = 0;
+    token_reserve(tokens, 1024);
 }
 
-static struct token* token_new(struct tokens* tokens) {
-    if (tokens->vector.capacity
-        < (tokens->vector.size + sizeof(struct token))) {
-        exit(1);
+void token_free(struct tokens* tokens) {
+    free(tokens->kinds);
+    free(tokens->offsets);
+    free(tokens->lengths);
+    tokens->kinds = NULL;
+    tokens->offsets = NULL;
+    tokens->lengths = NULL;
+    tokens->length = 0;
+    tokens->capacity = 0;
+}
+
+struct token token_get(struct tokens* tokens, uint64_t index) {
+    if (index >= tokens->length) {
+        fatal_error("token index out of range");
     }
-    tokens->vector.size += sizeof(struct token);
-    uint64_t index = tokens->length;
-    ++(tokens->length);
-    return token_get(tokens, index);
+    struct token token = {
+        .kind = tokens->kinds[index],
+        .symbol = SYMBOL_NONE,
+    };
+    if (token.kind == TOKEN_IDENTIFIER) {
+        token.symbol = tokens->offsets[index];
+        token.str = symbol_table_str(tokens->symbols, token.symbol);
+    }
+    else {
+        token.str.data = tokens->source + tokens->offsets[index];
+        token.str.size = tokens->lengths[index];
+    }
+    return token;
 }
 
-struct token* token_get(struct tokens* tokens, uint64_t index) {
+enum token_kind token_get_kind(struct tokens* tokens, uint64_t index) {
     if (index >= tokens->length) {
-        exit(1);
+        fatal_error("token index out of range");
     }
-    struct token* base = (struct token*) ((void*) tokens->vector.data);
-    return &(base[index]);
+    return tokens->kinds[index];
 }
 
 void token_push(struct tokens* tokens,
                 enum token_kind token_kind,
                 uint8_t* token_start,
                 uint64_t token_length) {
-    struct token* token = token_new(tokens);
-    token->kind = token_kind;
-    token->str.data = token_start;
-    token->str.size = token_length;
+    if (token_length > TOKEN_LENGTH_MAX) {
+        fatal_error("token too long");
+    }
+    if (tokens->length == tokens->capacity) {
+        token_reserve(tokens, tokens->length + 1);
+    }
+    uint64_t index = tokens->length;
+    tokens->kinds[index] = token_kind;
+    tokens->offsets[index] = token_start - tokens->source;
+    tokens->lengths[index] = token_length;
+    ++(tokens->length);
+}
+
+void token_push_identifier(struct tokens* tokens,
+                           uint8_t* token_start,
+                           uint64_t token_length) {
+    if (token_length > TOKEN_LENGTH_MAX) {
+        fatal_error("token too long");
+    }
+    if (tokens->length == tokens->capacity) {
+        token_reserve(tokens, tokens->length + 1);
+    }
+    uint64_t index = tokens->length;
+    tokens->kinds[index] = TOKEN_IDENTIFIER;
+    tokens->offsets[index]
+        = symbol_table_intern(tokens->symbols, token_start, token_length);
+    tokens->lengths[index] = token_length;
+    ++(tokens->length);
+}
+
+/* The other tokens must come from later in the same source buffer */
+void token_append(struct tokens* tokens, struct tokens* other) {
+    if (other->length == 0) {
+        return;
+    }
+
+    uint32_t* remap = NULL;
+    if (other->symbols != tokens->symbols) {
+        remap = symbol_table_intern_table(tokens->symbols, other->symbols);
+    }
+
+    uint64_t rebase = other->source - tokens->source;
+    uint64_t length = tokens->length;
+    token_reserve(tokens, length + other->length);
+    memcpy(tokens->kinds + length, other->kinds,
+           other->length * sizeof(uint8_t));
+    memcpy(tokens->lengths + length, other->lengths,
+           other->length * sizeof(uint16_t));
+    uint32_t* offsets = tokens->offsets + length;
+    for (uint64_t i = 0; i < other->length; ++i) {
+        if (other->kinds[i] != TOKEN_IDENTIFIER) {
+            offsets[i] = other->offsets[i] + rebase;
+        }
+        else if (remap != NULL) {
+            offsets[i] = remap[other->offsets[i]];
+        }
+        else {
+            offsets[i] = other->offsets[i];
+        }
+    }
+    tokens->length += other->length;
+    free(remap);
+}
+
+void token_rebind(struct tokens* tokens, struct symbol_table* symbols) {
+    if (tokens->symbols == symbols) {
+        return;
+    }
+    uint32_t* remap = symbol_table_intern_table(symbols, tokens->symbols);
+    for (uint64_t i = 0; i < tokens->length; ++i) {
+        if (tokens->kinds[i] == TOKEN_IDENTIFIER) {
+            tokens->offsets[i] = remap[tokens->offsets[i]];
+        }
+    }
+    tokens->symbols = symbols;
+    free(remap);
 }
 
 const char* token_kind_c_str(uint64_t token_kind) {
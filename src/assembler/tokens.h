@@ -1,20 +1,41 @@
 #ifndef MALLARD_TOKENS_H
 #define MALLARD_TOKENS_H
 
+#include "symbol_table.h"
 #include "token.h"
-#include "vector.h"
 
+/* Tokens are stored as parallel arrays, a token is 7 bytes in total. The
+   offsets are relative to the source buffer the tokens were lexed from,
+   except for identifiers where the offset is the interned symbol. */
 struct tokens {
-    struct vector vector;
+    uint8_t* source;
+    struct symbol_table* symbols;
+    uint8_t* kinds;
+    uint32_t* offsets;
+    uint16_t* lengths;
     uint64_t length;
+    uint64_t capacity;
 };
 
-void token_init(struct tokens* tokens);
-struct token* token_get(struct tokens* tokens, uint64_t index);
+#define TOKEN_LENGTH_MAX UINT16_MAX
+#define TOKEN_SOURCE_SIZE_MAX UINT32_MAX
+
+void token_init(struct tokens* tokens,
+                uint8_t* source,
+                struct symbol_table* symbols);
+void token_free(struct tokens* tokens);
+struct token token_get(struct tokens* tokens, uint64_t index);
+enum token_kind token_get_kind(struct tokens* tokens, uint64_t index);
 void token_push(struct tokens* tokens,
                 enum token_kind token_kind,
                 uint8_t* token_start,
                 uint64_t token_length);
+void token_push_identifier(struct tokens* tokens,
+                           uint8_t* token_start,
+                           uint64_t token_length);
+void token_append(struct tokens* tokens, struct tokens* other);
+/* Moves the identifiers over to another symbol table */
+void token_rebind(struct tokens* tokens, struct symbol_table* symbols);
 const char* token_kind_c_str(uint64_t token_kind);
 void token_print(struct token* token);
 
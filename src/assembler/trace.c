@@ -0,0 +1,169 @@
+#include "trace.h"
+
+#include "alloc.h"
+#include "fatal_error.h"
+#include "time_report.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct trace_event {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+    /* Into the buffer's details, detail_size is 0 without one */
+    uint64_t detail_offset;
+    uint64_t detail_size;
+};
+
+/* Only its thread writes to a buffer, the trace reads them once the
+   threads are done */
+struct trace_buffer {
+    struct trace_buffer* next;
+    uint64_t trace_id;
+    long thread_id;
+    struct trace_event* events;
+    uint64_t events_length;
+    uint64_t events_capacity;
+    char* details;
+    uint64_t details_size;
+    uint64_t details_capacity;
+};
+
+struct trace {
+    /* Tells a thread's buffer for this trace from one left by an earlier
+       trace, whose memory may be reused */
+    uint64_t id;
+    uint64_t start;
+    struct trace_buffer* buffers;
+};
+
+static uint64_t trace_next_id = 1;
+static _Thread_local struct trace_buffer* trace_buffer = NULL;
+static _Thread_local uint64_t trace_buffer_id = 0;
+
+struct trace* trace_create(void) {
+    struct trace* trace = xcalloc(1, sizeof(struct trace));
+    trace->id = __atomic_fetch_add(&trace_next_id, 1, __ATOMIC_RELAXED);
+    trace->start = time_report_now();
+    return trace;
+}
+
+void trace_destroy(struct trace* trace) {
+    struct trace_buffer* buffer = trace->buffers;
+    while (buffer != NULL) {
+        struct trace_buffer* next = buffer->next;
+        free(buffer->events);
+        free(buffer->details);
+        free(buffer);
+        buffer = next;
+    }
+    free(trace);
+}
+
+static struct trace_buffer* trace_thread_buffer(struct trace* trace) {
+    if (trace_buffer_id == trace->id) {
+        return trace_buffer;
+    }
+    struct trace_buffer* buffer = xcalloc(1, sizeof(struct trace_buffer));
+    buffer->trace_id = trace->id;
+    buffer->thread_id = syscall(SYS_gettid);
+    /* Other threads push their buffers at the same time */
+    buffer->next = __atomic_load_n(&trace->buffers, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&trace->buffers, &buffer->next,
+                                        buffer, true, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+    }
+    trace_buffer = buffer;
+    trace_buffer_id = trace->id;
+    return buffer;
+}
+
+void trace_span_begin(struct trace_span* span) {
+    span->start = time_report_now();
+}
+
+void trace_span_end(struct trace* trace,
+                    struct trace_span* span,
+                    const char* name,
+                    const char* detail,
+                    uint64_t detail_size) {
+    uint64_t end = time_report_now();
+    struct trace_buffer* buffer = trace_thread_buffer(trace);
+    if (buffer->events_length == buffer->events_capacity) {
+        uint64_t capacity = buffer->events_capacity == 0
+                            ? 256 : buffer->events_capacity * 2;
+        buffer->events = xrealloc(buffer->events,
+                                  capacity * sizeof(struct trace_event));
+        buffer->events_capacity = capacity;
+    }
+    if (detail == NULL) {
+        detail_size = 0;
+    }
+    if (buffer->details_size + detail_size > buffer->details_capacity) {
+        uint64_t capacity = buffer->details_capacity == 0
+                            ? 4096 : buffer->details_capacity * 2;
+        while (capacity < buffer->details_size + detail_size) {
+            capacity *= 2;
+        }
+        buffer->details = xrealloc(buffer->details, capacity);
+        buffer->details_capacity = capacity;
+    }
+    struct trace_event* event = &buffer->events[buffer->events_length++];
+    event->name = name;
+    event->start = span->start;
+    event->end = end;
+    event->detail_offset = buffer->details_size;
+    event->detail_size = detail_size;
+    if (detail_size != 0) {
+        memcpy(buffer->details + buffer->details_size, detail, detail_size);
+        buffer->details_size += detail_size;
+    }
+}
+
+/* Microseconds since the trace started, the unit trace viewers expect */
+static double trace_microseconds(struct trace* trace, uint64_t time) {
+    return (time - trace->start) / 1e3;
+}
+
+void trace_write_json(struct trace* trace, const char* path) {
+    FILE* out = fopen(path, "w");
+    if (out == NULL) {
+        fatal_error("trace open failed");
+    }
+    long process_id = getpid();
+    fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    bool first = true;
+    struct trace_buffer* buffer
+        = __atomic_load_n(&trace->buffers, __ATOMIC_ACQUIRE);
+    for (; buffer != NULL; buffer = buffer->next) {
+        for (uint64_t i = 0; i < buffer->events_length; ++i) {
+            struct trace_event* event = &buffer->events[i];
+            /* A complete event is one span, its begin and its duration */
+            fprintf(out, "%s{\"name\": \"%s\", \"cat\": \"mallard\", "
+                         "\"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                         "\"pid\": %ld, \"tid\": %ld",
+                    first ? "" : ",\n", event->name,
+                    trace_microseconds(trace, event->start),
+                    (event->end - event->start) / 1e3,
+                    process_id, buffer->thread_id);
+            if (event->detail_size != 0) {
+                fprintf(out, ", \"args\": {\"detail\": ");
+                time_report_json_string(out,
+                                        buffer->details + event->detail_offset,
+                                        event->detail_size);
+                fprintf(out, "}");
+            }
+            fprintf(out, "}");
+            first = false;
+        }
+    }
+    fprintf(out, "\n]}\n");
+    if (fclose(out) != 0) {
+        fatal_error("trace write failed");
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef MALLARD_TRACE_H
+#define MALLARD_TRACE_H
+
+#include <stdint.h>
+
+/* Spans recorded for the Chrome and Perfetto trace viewers. Each thread
+   appends to its own buffer, so recording takes no locks. */
+struct trace;
+
+/* A span in progress on the calling thread */
+struct trace_span {
+    uint64_t start;
+};
+
+struct trace* trace_create(void);
+/* Every thread that recorded must be done with the trace */
+void trace_destroy(struct trace* trace);
+void trace_span_begin(struct trace_span* span);
+/* Records the span on the calling thread. The name must outlive the trace,
+   detail, shown with the span, is copied and may be NULL. */
+void trace_span_end(struct trace* trace,
+                    struct trace_span* span,
+                    const char* name,
+                    const char* detail,
+                    uint64_t detail_size);
+/* Writes every span as a trace event, once every thread is done */
+void trace_write_json(struct trace* trace, const char* path);
+
+#endif /* ifndef MALLARD_TRACE_H */